@@ -31,6 +31,16 @@ bool AlcEnabler::init() {
 		return false;
 	}
 	
+	// Patcher load callbacks run before the kext list is loaded, so unused kexts are never read
+	error = lilu.onPatcherLoad([](void *user, KernelPatcher &patcher) {
+		callbackAlc = static_cast<AlcEnabler *>(user);
+		callbackPatcher = &patcher;
+		callbackAlc->filterKexts(patcher);
+	}, this);
+	
+	if (error != LiluAPI::Error::NoError)
+		SYSLOG("alc @ failed to register kext filtering %d, all the kexts will be loaded", error);
+	
 	if (getKernelVersion() >= KernelVersion::Sierra) {
 		char tmp[16];
 		// Unlock custom audio engines by disabling Apple private entitlement verification
@@ -164,6 +174,60 @@ void AlcEnabler::processKext(KernelPatcher &patcher, size_t index, mach_vm_addre
 	patcher.clearError();
 }
 
+void AlcEnabler::filterKexts(KernelPatcher &patcher) {
+	grabControllers();
+	
+	// Keep the original behaviour if the controllers are not published yet
+	if (controllers.size() == 0) {
+		DBGLOG("alc @ no controllers found at patcher load, loading all the kexts");
+		return;
+	}
+	
+	progressState |= ProcessingState::ControllersLoaded;
+	
+	// Codecs only appear once AppleHDAController starts, so any codec may still need its kexts
+	bool wantCodecs {false};
+	for (size_t i = 0, num = controllers.size(); i < num; i++) {
+		if (controllers[i]->detect)
+			wantCodecs = true;
+	}
+	
+	for (size_t k = 0; k < ADDPR(kextListSize); k++) {
+		auto &kext = ADDPR(kextList)[k];
+		
+		// Codec detection and resource callback routing are bound to these kexts
+		bool needed = wantCodecs && kext.user[0];
+		
+		for (size_t i = 0, num = controllers.size(); !needed && i < num; i++) {
+			auto info = controllers[i]->info;
+			if (info)
+				needed = patchesKext(patcher, &kext, info->patches, info->patchNum);
+		}
+		
+		for (size_t v = 0; wantCodecs && !needed && v < ADDPR(vendorModSize); v++) {
+			for (size_t c = 0; !needed && c < ADDPR(vendorMod)[v].codecsNum; c++) {
+				auto &info = ADDPR(vendorMod)[v].codecs[c];
+				needed = patchesKext(patcher, &kext, info.patches, info.patchNum);
+			}
+		}
+		
+		if (!needed) {
+			DBGLOG("alc @ disabling %s kext, no detected hardware needs it", kext.id);
+			// Lilu does not load kexts without paths
+			kext.pathNum = 0;
+		}
+	}
+}
+
+bool AlcEnabler::patchesKext(KernelPatcher &patcher, const KernelPatcher::KextInfo *kext, const KextPatch *patches, size_t patchNum) {
+	for (size_t p = 0; p < patchNum; p++) {
+		if (patches[p].patch.kext == kext && patcher.compatibleKernel(patches[p].minKernel, patches[p].maxKernel))
+			return true;
+	}
+	
+	return false;
+}
+
 void AlcEnabler::hookEntitlementVerification(KernelPatcher &patcher) {
 	auto entitlement = patcher.solveSymbol(KernelPatcher::KernelID, "__ZN12IOUserClient21copyClientEntitlementEP4taskPKc");
 	
@@ -308,7 +372,7 @@ bool AlcEnabler::grabCodecs() {
 				
 				return true;
 			
-			} : nullptr, last, this);
+			} : static_cast<bool (*)(void *, IORegistryEntry *)>(nullptr), last, this);
 		}
 	}
 
@@ -28,6 +28,26 @@ private:
 	 */
 	void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 	
+	/**
+	 *  Detect controllers and disable the kexts no detected hardware may need
+	 *  Must be called at patcher load, before the kext list is loaded.
+	 *
+	 *  @param patcher KernelPatcher instance
+	 */
+	void filterKexts(KernelPatcher &patcher);
+	
+	/**
+	 *  Check whether any kernel compatible patch targets a kext
+	 *
+	 *  @param patcher    KernelPatcher instance
+	 *  @param kext       kext info
+	 *  @param patches    patch list
+	 *  @param patchNum   patch number
+	 *
+	 *  @return true if the kext is patched
+	 */
+	bool patchesKext(KernelPatcher &patcher, const KernelPatcher::KextInfo *kext, const KextPatch *patches, size_t patchNum);
+	
 	/**
 	 *  Enable audio host entitlements for all processes
 	 *
@@ -140,6 +140,19 @@ public:
 	 */
 	EXPORT Error onProcLoad(UserPatcher::ProcInfo *infos, size_t num, UserPatcher::t_BinaryLoaded callback, void *user=nullptr, UserPatcher::BinaryModInfo *mods=nullptr, size_t modnum=0);
 
+	/**
+	 *  Declares the kernel and kext symbols the plugin is going to solve
+	 *  Once every loaded plugin declared its symbols, only the declared ones are kept when plugin
+	 *  registration is over, otherwise every defined symbol is kept.
+	 *
+	 *  @param product  product name passed to shouldLoad
+	 *  @param symbols  your symbol list (make sure to point to const memory)
+	 *  @param num      number of provided symbols
+	 *
+	 *  @return Error::NoError on success
+	 */
+	EXPORT Error declareSymbols(const char *product, const char * const symbols[], size_t num);
+	
 	/**
 	 *  Processes all the registered patcher load callbacks
 	 *
@@ -175,6 +188,13 @@ public:
 	 */
 	void processBinaryLoadCallbacks(UserPatcher &patcher, vm_map_t map, const char *path, size_t len);
 	
+	/**
+	 *  Compacts the kinfo symbols keeping the declared ones if every plugin declared them
+	 *
+	 *  @param patcher kernel patcher instance
+	 */
+	void compactSymbols(KernelPatcher &patcher);
+	
 	/**
 	 *  Activates patchers
 	 *
@@ -236,6 +256,31 @@ private:
 	 *  List of processed binary mods
 	 */
 	evector<UserPatcher::BinaryModInfo *> storedBinaryMods;
+	
+	/**
+	 *  List of plugins allowed to load
+	 */
+	evector<const char *> loadedPlugins;
+	
+	/**
+	 *  List of plugins, which declared their symbols
+	 */
+	evector<const char *> declaringPlugins;
+	
+	/**
+	 *  List of declared symbols
+	 */
+	evector<const char *> declaredSymbols;
+	
+	/**
+	 *  Add a product name unless already present
+	 *
+	 *  @param list    product list
+	 *  @param product product name
+	 *
+	 *  @return true on success
+	 */
+	static bool addPlugin(evector<const char *> &list, const char *product);
 };
 
 EXPORT extern LiluAPI lilu;
@@ -47,6 +47,66 @@ struct CompressedHeader {
  */
 EXPORT uint8_t *decompressData(uint32_t compression, uint32_t dstlen, uint8_t *src, uint32_t srclen);
 
+/**
+ *  Typed decompressing function verifying the decompressed data
+ *
+ *  @param compression compression type
+ *  @param dstlen      decompression buffer size
+ *  @param src         compressed data
+ *  @param srclen      compressed data size
+ *  @param hash        expected adler32 of decompressed data
+ *
+ *  @return decompressed buffer or nullptr on checksum mismatch
+ */
+EXPORT uint8_t *decompressData(uint32_t compression, uint32_t dstlen, uint8_t *src, uint32_t srclen, uint32_t hash);
+
+/**
+ *  Calculate adler32 checksum as stored in CompressedHeader
+ *
+ *  @param data buffer to checksum
+ *  @param size buffer size
+ *
+ *  @return checksum
+ */
+EXPORT uint32_t computeAdler32(const uint8_t *data, size_t size);
+
+/**
+ *  Decompressed data range to keep
+ */
+struct DecompressWindow {
+	uint8_t *buffer;
+	uint32_t offset;
+	uint32_t size;
+};
+
+/**
+ *  Compressed data reader
+ *
+ *  @param user   user data
+ *  @param buffer destination buffer
+ *  @param offset compressed data offset
+ *  @param size   bytes to read
+ *
+ *  @return bytes read or 0 on failure
+ */
+using t_compressedReader = uint32_t (*)(void *user, uint8_t *buffer, uint32_t offset, uint32_t size);
+
+/**
+ *  Typed streaming decompressing function keeping only the requested ranges
+ *  Compressed data is read in small chunks and decompression stops once the last range is filled.
+ *
+ *  @param compression compression type
+ *  @param dstlen      decompressed data size
+ *  @param reader      compressed data reader
+ *  @param user        user data passed to the reader
+ *  @param srclen      compressed data size
+ *  @param windows     decompressed data ranges to fill
+ *  @param num         number of ranges
+ *
+ *  @return true if all the ranges were filled, false on failure or unsupported compression
+ */
+EXPORT bool decompressWindows(uint32_t compression, uint32_t dstlen, t_compressedReader reader, void *user, uint32_t srclen, const DecompressWindow *windows, size_t num);
+
 #endif /* COMPRESSION_SUPPORT */
 
 #endif /* kern_compression_hpp */
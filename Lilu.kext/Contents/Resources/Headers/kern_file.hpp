@@ -38,6 +38,52 @@ namespace FileIO {
 	 */
 	EXPORT int readFileData(void *buffer, off_t off, size_t sz, vnode_t vnode, vfs_context_t ctxt);
 	
+	/**
+	 *  File range to read
+	 */
+	struct Range {
+		void *buffer;
+		off_t offset;
+		size_t size;
+	};
+	
+	/**
+	 *  Read several file ranges from a vnode
+	 *  Ranges are sorted by offset, and adjacent or close enough ones are read
+	 *  by a single vectored read scattering the data into their buffers.
+	 *
+	 *  @param vnode  file node
+	 *  @param ctxt   filesystem context
+	 *  @param ranges ranges to read
+	 *  @param num    number of ranges
+	 *
+	 *  @return 0 on success
+	 */
+	EXPORT int readFileRanges(vnode_t vnode, vfs_context_t ctxt, const Range *ranges, size_t num);
+	
+	/**
+	 *  Default read cache size limit
+	 */
+	static constexpr size_t ReadCacheLimit {8*1024*1024};
+	
+	/**
+	 *  Start caching the data read by readFileData and readFileRanges
+	 *  Meant to be used during patcher initialisation, when several MachInfo instances
+	 *  may read the same files. Cached reads are identified by vnode and its generation,
+	 *  and a read is served from the cache when a cached one fully covers it.
+	 *  The oldest reads are evicted once the limit is reached.
+	 *
+	 *  @param limit maximum amount of cached bytes
+	 *
+	 *  @return true on success
+	 */
+	EXPORT bool enableReadCache(size_t limit=ReadCacheLimit);
+	
+	/**
+	 *  Stop caching file reads and free all the cached data
+	 */
+	EXPORT void disableReadCache();
+	
 	/**
 	 *  Read file size from a vnode
 	 *
@@ -48,6 +94,16 @@ namespace FileIO {
 	 */
 	EXPORT size_t readFileSize(vnode_t vnode, vfs_context_t ctxt);
 	
+	/**
+	 *  Check whether a file may be written at path
+	 *  The volume of the parent directory is checked for missing files.
+	 *
+	 *  @param path full file path
+	 *
+	 *  @return true if the volume is mounted read-write
+	 */
+	EXPORT bool isWritablePath(const char *path);
+	
 	/**
 	 *  Writes buffer to a file at path
 	 *
@@ -12,31 +12,55 @@
 
 #include <Headers/kern_config.hpp>
 #include <Headers/kern_util.hpp>
+#ifdef COMPRESSION_SUPPORT
+#include <Headers/kern_compression.hpp>
+#endif /* COMPRESSION_SUPPORT */
 
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/vnode.h>
 #include <mach-o/loader.h>
+#include <mach-o/nlist.h>
 #include <mach/vm_param.h>
 
+class SymbolCache;
+
 class MachInfo {
 	mach_vm_address_t running_text_addr {0}; // the address of running __TEXT segment
 	mach_vm_address_t disk_text_addr {0};    // the same address at from a file
 	mach_vm_address_t kaslr_slide {0};       // the kernel aslr slide, computed as the difference between above's addresses
 #ifdef COMPRESSION_SUPPORT
 	uint8_t *file_buf {nullptr};             // read file data if decompression was used
+	uint8_t *compressed_buf {nullptr};       // read compressed data awaiting full decompression
+	off_t compressed_offset {0};             // compressed data file offset if streaming decompression is used
+	uint32_t compressed_size {0};            // compressed data size or 0 if streaming decompression is not used
+	uint32_t decompressed_size {0};          // decompressed data size
+	uint32_t compression_type {0};           // compression type
+	uint32_t compression_hash {0};           // decompressed data adler32
 #endif /* COMPRESSION_SUPPORT */
 	uint8_t *linkedit_buf {nullptr};         // pointer to __LINKEDIT buffer containing symbols to solve
+	char *linkedit_path {nullptr};           // file to read __LINKEDIT from at the first symbol lookup
 	uint64_t linkedit_fileoff {0};           // __LINKEDIT file offset so we can read
 	uint64_t linkedit_size {0};
 	uint32_t symboltable_fileoff {0};        // file offset to symbol table - used to position inside the __LINKEDIT buffer
 	uint32_t symboltable_nr_symbols {0};
 	uint32_t stringtable_fileoff {0};        // file offset to string table
+	uint32_t stringtable_size {0};           // string table size
+	uint32_t extdefsym_index {0};            // first external defined symbol from LC_DYSYMTAB
+	uint32_t extdefsym_num {0};              // number of external defined symbols or 0 if no LC_DYSYMTAB
+	uint32_t *symbol_index {nullptr};        // open addressing symbol hash index, symbol number + 1 or 0 for free slots
+	uint32_t symbol_index_mask {0};          // symbol hash index size - 1
+	uint32_t *symbol_sorted {nullptr};       // symbol numbers sorted by name, built on first prefix lookup
 	mach_header_64 *running_mh {nullptr};    // pointer to mach-o header of running kernel item
+	SymbolCache *symbol_cache {nullptr};     // persistent symbol cache or nullptr
+	uint8_t file_uuid[16] {};                // UUID of the read binary used as the symbol cache key
+	bool file_uuid_set {false};              // the read binary has LC_UUID
+	bool symbols_compacted {false};          // symbol table was compacted, so missing symbols are not cached
 	off_t fat_offset {0};                    // additional fat offset
 	size_t memory_size {HeaderSize};         // memory size
 	bool kaslr_slide_set {false};            // kaslr can be null, used for disambiguation
 	bool allow_decompress {true};            // allows mach decompression
+	bool verify_decompress {false};          // verifies decompressed mach checksum
 	
 	/**
 	 *  16 byte IDT descriptor, used for 32 and 64 bits kernels (64 bit capable cpus!)
@@ -98,7 +122,8 @@ class MachInfo {
 	kern_return_t readMachHeader(uint8_t *buffer, vnode_t vnode, vfs_context_t ctxt, off_t off=0);
 
 	/**
-	 *  retrieve the whole linkedit segment into target buffer from kernel binary at disk
+	 *  retrieve symbol and string tables into linkedit buffer from kernel binary at disk
+	 *  the whole linkedit segment is copied for decompressed binaries
 	 *
 	 *  @param vnode file node
 	 *  @param ctxt  filesystem context
@@ -107,6 +132,142 @@ class MachInfo {
 	 */
 	kern_return_t readLinkedit(vnode_t vnode, vfs_context_t ctxt);
 	
+#ifdef COMPRESSION_SUPPORT
+	/**
+	 *  decompress the requested ranges of compressed binary at disk
+	 *
+	 *  @param vnode   file node
+	 *  @param ctxt    filesystem context
+	 *  @param windows decompressed data ranges to fill
+	 *  @param num     number of ranges
+	 *
+	 *  @return true on success
+	 */
+	bool readCompressedWindows(vnode_t vnode, vfs_context_t ctxt, const DecompressWindow *windows, size_t num);
+	
+	/**
+	 *  decompress the whole binary once its header was accepted
+	 *  does nothing unless the header was decompressed separately
+	 *
+	 *  @return KERN_SUCCESS on success
+	 */
+	kern_return_t finishDecompression();
+	
+	/**
+	 *  release the decompression buffers of a rejected binary
+	 */
+	void releaseDecompression();
+#endif /* COMPRESSION_SUPPORT */
+	
+	/**
+	 *  copy symbol and string tables of a running binary into linkedit buffer
+	 *  every load command and table bound is checked, and the tables must still be mapped,
+	 *  kext symbol values are brought to the unslid form of the disk tables
+	 *
+	 *  @param header   running mach header
+	 *  @param size     running image size for kexts or 0 for the kernel
+	 *  @param textAddr running __TEXT vm address
+	 *
+	 *  @return KERN_SUCCESS if the running binary has usable symbol tables
+	 */
+	kern_return_t readRunningLinkedit(mach_header_64 *header, size_t size, mach_vm_address_t &textAddr);
+	
+	/**
+	 *  resolve the running kernel from memory without touching the filesystem
+	 *
+	 *  @return KERN_SUCCESS if kernel symbol tables are available in memory
+	 */
+	kern_return_t initFromMemory();
+	
+	/**
+	 *  retrieve the postponed linkedit segment by the stored file path
+	 *
+	 *  @return KERN_SUCCESS on success
+	 */
+	kern_return_t loadLinkedit();
+	
+	/**
+	 *  check that a file still holds the binary read at init before reading its tables
+	 *  the header is reread at the same place and must have the same UUID, __LINKEDIT and symbol tables
+	 *
+	 *  @param vnode file node
+	 *  @param ctxt  filesystem context
+	 *
+	 *  @return true if the binary did not change
+	 */
+	bool isReadBinary(vnode_t vnode, vfs_context_t ctxt);
+	
+	/**
+	 *  build a hash index over the symbol table for faster symbol solving
+	 *
+	 *  @param symbols symbol table
+	 *  @param strings string table
+	 *
+	 *  @return true on success
+	 */
+	bool buildSymbolIndex(const nlist_64 *symbols, const char *strings);
+	
+	/**
+	 *  build an index of symbols sorted by their names for prefix lookups
+	 *
+	 *  @param symbols symbol table
+	 *  @param strings string table
+	 *
+	 *  @return true on success
+	 */
+	bool buildSortedSymbolIndex(const nlist_64 *symbols, const char *strings);
+	
+	/**
+	 *  find the first sorted index position with a name not less than the passed one
+	 *
+	 *  @param symbols symbol table
+	 *  @param strings string table
+	 *  @param symbol  symbol name or prefix
+	 *
+	 *  @return sorted index position or symbol number if none
+	 */
+	uint32_t findSortedSymbol(const nlist_64 *symbols, const char *strings, const char *symbol);
+	
+	/**
+	 *  check that the symbol cache may be used for this binary
+	 *  the running binary must be known and be the read one
+	 *
+	 *  @return true if the symbol cache is usable
+	 */
+	bool canUseSymbolCache();
+	
+	/**
+	 *  check that an address belongs to a loaded segment of the running binary
+	 *  the symbol cache file is not trusted to point anywhere else
+	 *
+	 *  @param address running address
+	 *
+	 *  @return true if the address is within the running binary
+	 */
+	bool isRunningAddress(mach_vm_address_t address);
+	
+	/**
+	 *  solve symbols by the symbol cache alone
+	 *
+	 *  @param symbols   symbols to solve
+	 *  @param addresses running symbol addresses or 0 for missing symbols
+	 *  @param num       number of symbols
+	 *  @param solved    number of solved symbols
+	 *
+	 *  @return true if every symbol was cached
+	 */
+	bool solveCachedSymbols(const char * const symbols[], mach_vm_address_t addresses[], size_t num, size_t &solved);
+	
+	/**
+	 *  retrieve symbol and string tables from the loaded __LINKEDIT
+	 *
+	 *  @param symbols symbol table
+	 *  @param strings string table
+	 *
+	 *  @return true on success
+	 */
+	bool getSymbolTables(const nlist_64 *&symbols, const char *&strings);
+	
 	/**
 	 *  retrieve necessary mach-o header information from the mach header
 	 *
@@ -191,6 +352,13 @@ public:
 	 */
 	EXPORT void getRunningPosition(uint8_t * &header, size_t &size);
 
+	/**
+	 *  retrieve running mach uuid (running addresses must be calculated)
+	 *
+	 *  @return 16 byte uuid or nullptr
+	 */
+	EXPORT const uint8_t *getRunningUUID();
+
 	/**
 	 *  solve a mach symbol (running addresses must be calculated)
 	 *
@@ -199,6 +367,57 @@ public:
 	 *  @return running symbol address or 0
 	 */
 	EXPORT mach_vm_address_t solveSymbol(const char *symbol);
+	
+	/**
+	 *  solve multiple mach symbols at once (running addresses must be calculated)
+	 *
+	 *  @param symbols   symbols to solve
+	 *  @param addresses running symbol addresses or 0 for missing symbols
+	 *  @param num       number of symbols
+	 *
+	 *  @return number of solved symbols
+	 */
+	EXPORT size_t solveSymbols(const char * const symbols[], mach_vm_address_t addresses[], size_t num);
+	
+	/**
+	 *  use a persistent symbol cache for the symbol lookups
+	 *
+	 *  @param cache symbol cache or nullptr
+	 */
+	void setSymbolCache(SymbolCache *cache) {
+		symbol_cache = cache;
+	}
+	
+	/**
+	 *  Symbol enumeration handler, returns false to stop
+	 */
+	using t_symbolHandler = bool (*)(void *user, const char *symbol, mach_vm_address_t address);
+	
+	/**
+	 *  solve all mach symbols starting with a prefix in name order (running addresses must be calculated)
+	 *  Builds a sorted symbol index on first use, no memory is allocated per lookup.
+	 *
+	 *  @param prefix  symbol prefix
+	 *  @param handler invoked for every matching symbol
+	 *  @param user    user data passed to the handler
+	 *
+	 *  @return number of symbols passed to the handler
+	 */
+	EXPORT size_t solveSymbolsWithPrefix(const char *prefix, t_symbolHandler handler, void *user=nullptr);
+	
+	/**
+	 *  replace __LINKEDIT with a compact table of the symbols still needed
+	 *  Relocations, signatures and other __LINKEDIT contents are dropped along with
+	 *  undefined and debugging symbols, symbol indexes are rebuilt on demand.
+	 *  Does nothing until the first symbol lookup reads __LINKEDIT and after the first compaction.
+	 *
+	 *  @param keep     symbols to keep or nullptr to keep every defined symbol
+	 *  @param num      number of symbols to keep
+	 *  @param external keep only external defined symbols when no list is passed
+	 *
+	 *  @return reclaimed memory in bytes
+	 */
+	EXPORT size_t compactSymbols(const char * const keep[]=nullptr, size_t num=0, bool external=false);
 
 	/**
 	 *  find the kernel base address (mach-o header)
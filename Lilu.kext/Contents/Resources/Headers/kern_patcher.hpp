@@ -16,6 +16,7 @@
 #include <mach/mach_types.h>
 
 namespace Patch { union All; void deleter(All *); }
+class WorkQueue;
 #ifdef KEXTPATCH_SUPPORT
 struct OSKextLoadedKextSummaryHeader;
 struct OSKextLoadedKextSummary;
@@ -102,6 +103,16 @@ public:
 	 *  @return loaded kinfo id
 	 */
 	EXPORT size_t loadKinfo(KextInfo *info);
+	
+	/**
+	 *  Read and parse kext info files on a work queue ahead of loadKinfo
+	 *  loadKinfo takes the prepared MachInfo once the queue is joined, so the kinfo
+	 *  indexes still follow the loadKinfo call order.
+	 *
+	 *  @param info  kext to prepare
+	 *  @param queue work queue to use
+	 */
+	void prepareKinfo(KextInfo *info, WorkQueue &queue);
 #endif /* KEXTPATCH_SUPPORT */
 
 	/**
@@ -144,6 +155,62 @@ public:
 	 */
 	EXPORT mach_vm_address_t solveSymbol(size_t id, const char *symbol);
 	
+	/**
+	 *  Solve multiple kinfo symbols at once
+	 *  Sets NoSymbolFound error if any of the symbols is missing.
+	 *
+	 *  @param id      loaded kinfo id
+	 *  @param symbols symbols to solve
+	 *  @param out     running symbol addresses or 0 for missing symbols
+	 *  @param num     number of symbols
+	 *
+	 *  @return number of solved symbols
+	 */
+	EXPORT size_t solveSymbols(size_t id, const char * const symbols[], mach_vm_address_t out[], size_t num);
+	
+	/**
+	 *  Solve all kinfo symbols starting with a prefix
+	 *  Sets NoSymbolFound error if nothing matches.
+	 *
+	 *  @param id      loaded kinfo id
+	 *  @param prefix  symbol prefix
+	 *  @param handler invoked for every matching symbol in name order, returns false to stop
+	 *  @param user    user data passed to the handler
+	 *
+	 *  @return number of symbols passed to the handler
+	 */
+	EXPORT size_t solveSymbolsWithPrefix(size_t id, const char *prefix, MachInfo::t_symbolHandler handler, void *user=nullptr);
+	
+	/**
+	 *  Free kinfo __LINKEDIT keeping only a compact symbol table
+	 *
+	 *  @param id       loaded kinfo id
+	 *  @param keep     symbols to keep or nullptr to keep every defined symbol
+	 *  @param num      number of symbols to keep
+	 *  @param external keep only external defined symbols when no list is passed
+	 *
+	 *  @return reclaimed memory in bytes
+	 */
+	EXPORT size_t compactSymbols(size_t id, const char * const keep[]=nullptr, size_t num=0, bool external=false);
+	
+	/**
+	 *  Compact the symbols of every loaded kinfo, called once plugin registration is over
+	 *  Kinfos reading their symbols afterwards are compacted right after their first lookup.
+	 *
+	 *  @param keep  symbols to keep or nullptr to keep every defined symbol (make sure to point to const memory)
+	 *  @param num   number of symbols to keep
+	 */
+	void compactSymbols(const char * const keep[]=nullptr, size_t num=0);
+	
+	/**
+	 *  Use a persistent symbol cache for the kinfos loaded afterwards
+	 *
+	 *  @param cache symbol cache or nullptr
+	 */
+	void setSymbolCache(SymbolCache *cache) {
+		symbolCache = cache;
+	}
+	
 	/**
 	 *  Hook kext loading and unloading to access kexts at early stage
 	 */
@@ -194,6 +261,15 @@ public:
 	 */
 	void updateKextHandlerFeatures(KextInfo *info);
 
+	/**
+	 *  Expected find/replace patch offsets for a particular kext build
+	 */
+	struct LookupHint {
+		uint8_t uuid[16];
+		const size_t *offsets;
+		size_t offsetNum;
+	};
+
 	/**
 	 *  Arbitrary kext find/replace patch
 	 */
@@ -205,12 +281,41 @@ public:
 		size_t count;
 	};
 	
+	/**
+	 *  Find/replace patch with expected offsets for known kext builds
+	 *  When a hint matches the running kext uuid and the find bytes are present
+	 *  at every hinted offset no lookup is performed.
+	 */
+	struct HintedLookupPatch {
+		LookupPatch patch;
+		const LookupHint *hints;
+		size_t hintNum;
+	};
+	
 	/**
 	 *  Apply a find/replace patch
 	 *
 	 *  @param patch patch to apply
 	 */
 	EXPORT void applyLookupPatch(const LookupPatch *patch);
+	
+	/**
+	 *  Apply a find/replace patch using its hints when possible
+	 *
+	 *  @param patch patch to apply
+	 */
+	EXPORT void applyLookupPatch(const HintedLookupPatch *patch);
+
+	/**
+	 *  Apply multiple find/replace patches in a single pass
+	 *  All the patches must belong to the same kext. The result is the same as applying
+	 *  the patches one after another: patches, which may affect each other's matches,
+	 *  are applied sequentially in their order after the rest.
+	 *
+	 *  @param patches patches to apply
+	 *  @param num     number of patches
+	 */
+	EXPORT void applyLookupPatches(const LookupPatch *patches, size_t num);
 #endif /* KEXTPATCH_SUPPORT */
 
 	/**
@@ -296,6 +401,28 @@ private:
 	 */
 	void processAlreadyLoadedKexts(OSKextLoadedKextSummary *summaries, size_t num);
 	
+	/**
+	 *  Apply independent find/replace patches of the same kext in a single pass
+	 *
+	 *  @param patches patches to apply
+	 *  @param num     number of patches
+	 *
+	 *  @return false if nothing was changed and the patches need to be applied one by one
+	 */
+	bool applyLookupPatchesInPass(const LookupPatch *patches, size_t num);
+	
+	/**
+	 *  Find a lookup patch hint valid for the running kext contents
+	 *
+	 *  @param patch patch to check
+	 *  @param uuid  running kext uuid or nullptr
+	 *  @param off   running kext start
+	 *  @param size  running kext size
+	 *
+	 *  @return hint with verified offsets or nullptr
+	 */
+	static const LookupHint *findLookupHint(const HintedLookupPatch &patch, const uint8_t *uuid, const uint8_t *off, size_t size);
+	
 #endif /* KEXTPATCH_SUPPORT */
 	
 	/**
@@ -308,6 +435,62 @@ private:
 	 */
 	evector<MachInfo *, MachInfo::deleter> kinfos;
 	
+	/**
+	 *  Persistent symbol cache passed to the loaded kinfos
+	 */
+	SymbolCache *symbolCache {nullptr};
+	
+	/**
+	 *  Plugin registration is over, kinfo symbols are compacted after their lookups
+	 */
+	bool symbolsCompacted {false};
+	
+	/**
+	 *  Symbols kept at compaction or nullptr for every defined symbol
+	 */
+	const char * const *keptSymbols {nullptr};
+	
+	/**
+	 *  Number of symbols kept at compaction
+	 */
+	size_t keptSymbolNum {0};
+	
+	/**
+	 *  Compact the symbols of a kinfo, which read __LINKEDIT after compactSymbols
+	 *
+	 *  @param id  loaded kinfo id
+	 */
+	void compactLateSymbols(size_t id);
+	
+	/**
+	 *  Kinfo read ahead of loadKinfo
+	 */
+	struct PreparedKinfo {
+		const char * const *paths;
+		size_t num;
+		MachInfo *info;
+		kern_return_t result;
+		
+		static PreparedKinfo *create(const char *id, const char * const paths[], size_t num);
+		static void deleter(PreparedKinfo *kinfo);
+	};
+	
+	/**
+	 *  Kinfos awaiting loadKinfo, released once plugin registration is over
+	 */
+	evector<PreparedKinfo *, PreparedKinfo::deleter> preparedKinfos;
+	
+	/**
+	 *  Take a prepared kinfo
+	 *
+	 *  @param id     kernel item identifier
+	 *  @param info   prepared MachInfo
+	 *  @param result MachInfo initialisation result
+	 *
+	 *  @return true if the kinfo was prepared
+	 */
+	bool takePreparedKinfo(const char *id, MachInfo *&info, kern_return_t &result);
+	
 	/**
 	 *  Applied patches
 	 */
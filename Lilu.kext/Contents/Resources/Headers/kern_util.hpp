@@ -63,6 +63,21 @@ EXPORT const char *strstr(const char *stack, const char *needle, size_t len=0);
  */
 EXPORT char *strrchr(const char *stack, int ch);
 
+/**
+ *  Byte pattern search
+ *  Candidate offsets are prefiltered by the first and the last pattern bytes a machine word at a time,
+ *  and only the candidates are compared completely.
+ *
+ *  @param pattern     pattern to search for
+ *  @param patternSize pattern size
+ *  @param data        buffer to search in
+ *  @param dataSize    buffer size
+ *  @param dataOffset  offset to start the search from, updated to the found offset on success
+ *
+ *  @return true if the pattern was found
+ */
+EXPORT bool findPattern(const void *pattern, size_t patternSize, const void *data, size_t dataSize, size_t &dataOffset);
+
 /**
  *  Count array elements
  *
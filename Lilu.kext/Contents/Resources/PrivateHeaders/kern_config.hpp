@@ -12,6 +12,7 @@
 #include <Headers/kern_user.hpp>
 #include <Headers/kern_policy.hpp>
 #include <Headers/kern_util.hpp>
+#include <PrivateHeaders/kern_symcache.hpp>
 
 class Configuration {
 	/**
@@ -24,6 +25,13 @@ class Configuration {
 	static constexpr const char *bootargSlow {"-liluslow"};		// Prefer less destructive userspace measures
 	static constexpr const char *bootargFast {"-lilufast"};		// Prefer faster userspace measures
 	static constexpr const char *bootargLowMem {"-lilulowmem"};	// Disable decompression
+	static constexpr const char *bootargVerify {"-liluverify"};	// Verify decompressed data checksums
+	static constexpr const char *bootargNoCache {"-lilunocache"};	// Disable the persistent symbol cache
+	
+	/**
+	 *  Persistent symbol cache location
+	 */
+	static constexpr const char *symbolCachePath {"/private/var/db/.lilu_symbols"};
 	
 	/**
 	 * Minimal required kernel version
@@ -97,6 +105,16 @@ public:
 	 */
 	bool allowDecompress {true};
 	
+	/**
+	 *  Verify decompressed data checksums
+	 */
+	bool verifyDecompress {false};
+	
+	/**
+	 *  Use the persistent symbol cache
+	 */
+	bool useSymbolCache {true};
+	
 	/**
 	 *  Install or recovery
 	 */
@@ -117,6 +135,11 @@ public:
 	 */
 	KernelPatcher kernelPatcher;
 	
+	/**
+	 *  Persistent symbol cache
+	 */
+	SymbolCache symbolCache;
+	
 	/**
 	 *  Policy controller
 	 */
@@ -0,0 +1,342 @@
+//
+//  kern_lookup.hpp
+//  Lilu
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#ifndef kern_lookup_hpp
+#define kern_lookup_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Aho-Corasick automaton over a set of byte patterns
+ *  Lets one find all the occurrences of every pattern in a single pass.
+ *  Has no dependencies on purpose, storage is provided by the caller.
+ */
+class LookupAutomaton {
+	/**
+	 *  Missing node or pattern marker
+	 */
+	static constexpr uint32_t None {0xFFFFFFFF};
+
+	/**
+	 *  Root node index
+	 */
+	static constexpr uint32_t Root {0};
+
+	/**
+	 *  Trie node
+	 */
+	struct Node {
+		uint32_t edge;    // first outgoing edge or None
+		uint32_t fail;    // longest proper suffix node
+		uint32_t output;  // closest suffix node terminating a pattern or None
+		uint32_t pattern; // first pattern terminating at this node or None
+	};
+
+	/**
+	 *  Trie edge, siblings are chained
+	 */
+	struct Edge {
+		uint32_t to;
+		uint32_t next;
+		uint8_t value;
+	};
+
+	Node *nodes {nullptr};
+	Edge *edges {nullptr};
+	uint32_t *samePattern {nullptr}; // next pattern with the same contents or None
+	uint32_t *queue {nullptr};       // bfs queue used at construction
+	uint32_t rootMap[256] {};        // dense root transitions, Root means no transition
+	uint32_t nodeNum {0};
+	uint32_t edgeNum {0};
+
+	/**
+	 *  Find an explicit trie transition
+	 *
+	 *  @param node  source node
+	 *  @param value input byte
+	 *
+	 *  @return destination node or None
+	 */
+	uint32_t findEdge(uint32_t node, uint8_t value) const {
+		if (node == Root)
+			return rootMap[value] != Root ? rootMap[value] : None;
+		for (uint32_t e = nodes[node].edge; e != None; e = edges[e].next) {
+			if (edges[e].value == value)
+				return edges[e].to;
+		}
+		return None;
+	}
+
+	/**
+	 *  Perform an automaton transition
+	 *
+	 *  @param node  current node
+	 *  @param value input byte
+	 *
+	 *  @return next node
+	 */
+	uint32_t step(uint32_t node, uint8_t value) const {
+		while (node != Root) {
+			uint32_t to = findEdge(node, value);
+			if (to != None)
+				return to;
+			node = nodes[node].fail;
+		}
+		return rootMap[value];
+	}
+
+	/**
+	 *  Align storage chunks to 8 bytes
+	 */
+	static constexpr size_t align(size_t size) {
+		return (size + 7) & ~static_cast<size_t>(7);
+	}
+
+	/**
+	 *  Maximum node amount for the patterns
+	 */
+	template <typename T>
+	static size_t maxNodes(const T *patterns, size_t num) {
+		size_t total = 1;
+		for (size_t i = 0; i < num; i++)
+			total += patterns[i].size;
+		return total;
+	}
+
+	/**
+	 *  Check whether two byte strings agree on every byte they share at some relative position
+	 *
+	 *  @param a     first string
+	 *  @param asize first string size
+	 *  @param b     second string
+	 *  @param bsize second string size
+	 *
+	 *  @return true if the strings may overlap in a buffer
+	 */
+	static bool mayOverlap(const uint8_t *a, size_t asize, const uint8_t *b, size_t bsize) {
+		// b starts shift bytes before the end of a, every shift leaves at least one common byte
+		for (size_t shift = 1; shift < asize + bsize; shift++) {
+			size_t aStart = shift < bsize ? 0 : shift - bsize;
+			size_t bStart = shift < bsize ? bsize - shift : 0;
+			size_t common = asize - aStart < bsize - bStart ? asize - aStart : bsize - bStart;
+			size_t i = 0;
+			while (i < common && a[aStart + i] == b[bStart + i])
+				i++;
+			if (i == common)
+				return true;
+		}
+		return false;
+	}
+
+public:
+	/**
+	 *  Find the patterns, which may affect each other when replaced one after another
+	 *  A pattern interacts with another one when its find bytes may overlap the find or
+	 *  the replace bytes of the other one. Only the patterns without interactions may be
+	 *  replaced by replaceAll, the others need to be replaced sequentially in their order.
+	 *
+	 *  @param patterns  pattern list, each having find, replace and size fields
+	 *  @param num       number of patterns
+	 *  @param conflicts per pattern interaction flags of num elements, updated
+	 *
+	 *  @return number of interacting patterns
+	 */
+	template <typename T>
+	static size_t findConflicts(const T *patterns, size_t num, bool *conflicts) {
+		for (size_t i = 0; i < num; i++)
+			conflicts[i] = false;
+
+		size_t total {0};
+		for (size_t i = 0; i < num; i++) {
+			auto &a = patterns[i];
+			for (size_t j = i + 1; a.size > 0 && j < num; j++) {
+				auto &b = patterns[j];
+				if (b.size == 0 || (conflicts[i] && conflicts[j]))
+					continue;
+				if (mayOverlap(a.find, a.size, b.find, b.size) ||
+					mayOverlap(a.find, a.size, b.replace, b.size) ||
+					mayOverlap(b.find, b.size, a.replace, a.size)) {
+					total += !conflicts[i] + !conflicts[j];
+					conflicts[i] = conflicts[j] = true;
+				}
+			}
+		}
+
+		return total;
+	}
+
+	/**
+	 *  Calculate the storage necessary to build the automaton
+	 *
+	 *  @param patterns pattern list, each having find and size fields
+	 *  @param num      number of patterns
+	 *
+	 *  @return storage size in bytes
+	 */
+	template <typename T>
+	static size_t storageSize(const T *patterns, size_t num) {
+		size_t n = maxNodes(patterns, num);
+		return align(n * sizeof(Node)) + align(n * sizeof(Edge)) + align(num * sizeof(uint32_t)) + align(n * sizeof(uint32_t));
+	}
+
+	/**
+	 *  Build the automaton
+	 *
+	 *  @param patterns pattern list, each having find and size fields
+	 *  @param num      number of patterns
+	 *  @param storage  memory of at least storageSize bytes, must outlive the automaton
+	 *
+	 *  @return true on success
+	 */
+	template <typename T>
+	bool init(const T *patterns, size_t num, void *storage) {
+		size_t n = maxNodes(patterns, num);
+		if (!storage || n >= None || num >= None)
+			return false;
+
+		auto ptr = static_cast<uint8_t *>(storage);
+		nodes = reinterpret_cast<Node *>(ptr);
+		ptr += align(n * sizeof(Node));
+		edges = reinterpret_cast<Edge *>(ptr);
+		ptr += align(n * sizeof(Edge));
+		samePattern = reinterpret_cast<uint32_t *>(ptr);
+		ptr += align(num * sizeof(uint32_t));
+		queue = reinterpret_cast<uint32_t *>(ptr);
+
+		nodes[Root] = {None, Root, None, None};
+		for (size_t i = 0; i < 256; i++)
+			rootMap[i] = Root;
+		nodeNum = 1;
+		edgeNum = 0;
+
+		// Build the trie
+		for (uint32_t p = 0; p < num; p++) {
+			samePattern[p] = None;
+			if (patterns[p].size == 0)
+				continue;
+
+			uint32_t node = Root;
+			for (size_t i = 0; i < patterns[p].size; i++) {
+				uint8_t value = patterns[p].find[i];
+				uint32_t to = findEdge(node, value);
+				if (to == None) {
+					to = nodeNum++;
+					nodes[to] = {None, Root, None, None};
+					if (node == Root) {
+						rootMap[value] = to;
+					} else {
+						edges[edgeNum] = {to, nodes[node].edge, value};
+						nodes[node].edge = edgeNum++;
+					}
+				}
+				node = to;
+			}
+
+			// Preserve the original order for equal patterns
+			if (nodes[node].pattern == None) {
+				nodes[node].pattern = p;
+			} else {
+				uint32_t last = nodes[node].pattern;
+				while (samePattern[last] != None)
+					last = samePattern[last];
+				samePattern[last] = p;
+			}
+		}
+
+		// Calculate failure and output links breadth-first
+		uint32_t head = 0, tail = 0;
+		for (size_t i = 0; i < 256; i++) {
+			if (rootMap[i] != Root)
+				queue[tail++] = rootMap[i];
+		}
+
+		while (head < tail) {
+			uint32_t node = queue[head++];
+			auto &curr = nodes[node];
+			curr.output = nodes[curr.fail].pattern != None ? curr.fail : nodes[curr.fail].output;
+
+			for (uint32_t e = curr.edge; e != None; e = edges[e].next) {
+				uint32_t to = edges[e].to;
+				nodes[to].fail = step(curr.fail, edges[e].value);
+				queue[tail++] = to;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 *  Report all the pattern occurrences in the buffer
+	 *  Matches are reported in the order of their end offsets, longer patterns first.
+	 *
+	 *  @param data   buffer to look in
+	 *  @param size   buffer size
+	 *  @param match  functor invoked as match(pattern index, match end offset), returns false to stop
+	 */
+	template <typename F>
+	void scan(const uint8_t *data, size_t size, F match) const {
+		uint32_t node = Root;
+		for (size_t i = 0; i < size; i++) {
+			node = step(node, data[i]);
+			uint32_t out = nodes[node].pattern != None ? node : nodes[node].output;
+			while (out != None) {
+				for (uint32_t p = nodes[out].pattern; p != None; p = samePattern[p]) {
+					if (!match(p, i + 1))
+						return;
+				}
+				out = nodes[out].output;
+			}
+		}
+	}
+
+	/**
+	 *  Find the occurrences to replace like a sequential replacement would do
+	 *  A pattern stops being looked for once its count is reached (0 means unlimited),
+	 *  and a match overlapping an already accepted one is skipped. Only the original
+	 *  contents are looked at, so the result matches sequential replacement only when
+	 *  findConflicts reports no interactions between the patterns.
+	 *
+	 *  @param patterns pattern list the automaton was built with, each also having a count field
+	 *  @param num      number of patterns
+	 *  @param data     buffer to look in
+	 *  @param size     buffer size
+	 *  @param changes  per pattern accepted match counters of num elements, updated
+	 *  @param accept   functor invoked as accept(pattern index, match start offset)
+	 */
+	template <typename T, typename F>
+	void replaceAll(const T *patterns, size_t num, const uint8_t *data, size_t size, size_t *changes, F accept) const {
+		// Stop early once every counted pattern is done unless some pattern is unlimited
+		size_t pending {0};
+		bool unlimited {false};
+		for (size_t p = 0; p < num; p++) {
+			changes[p] = 0;
+			if (patterns[p].count == 0)
+				unlimited = true;
+			else
+				pending++;
+		}
+
+		// Replaced bytes must not be touched by other patterns
+		size_t replacedEnd {0};
+
+		scan(data, size, [&](size_t p, size_t end) {
+			auto &pattern = patterns[p];
+			size_t start = end - pattern.size;
+			if ((pattern.count > 0 && changes[p] == pattern.count) || start < replacedEnd)
+				return true;
+
+			accept(p, start);
+			changes[p]++;
+			replacedEnd = end;
+
+			return unlimited || pattern.count == 0 || changes[p] != pattern.count || --pending > 0;
+		});
+	}
+};
+
+#endif /* kern_lookup_hpp */
@@ -0,0 +1,195 @@
+//
+//  kern_symcache.hpp
+//  Lilu
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#ifndef kern_symcache_hpp
+#define kern_symcache_hpp
+
+#include <Headers/kern_config.hpp>
+#include <Headers/kern_util.hpp>
+
+#include <IOKit/IOLocks.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Persistent cache of solved symbols
+ *  Keeps unslid symbol values keyed by the binary UUID and the symbol name, so that
+ *  the next boots solve the same symbols without touching __LINKEDIT. Missing symbols
+ *  are remembered as well. A binary update changes its UUID, so the stale entries
+ *  are never matched and disappear after not being used for MaxAge written boots.
+ *  The file is not trusted: MachInfo only uses it for a running binary of the same UUID
+ *  and drops the values outside of the running binary segments.
+ */
+class SymbolCache {
+public:
+	/**
+	 *  Mach-O UUID size
+	 */
+	static constexpr size_t UUIDSize {16};
+	
+	/**
+	 *  Allocate the resources
+	 *
+	 *  @return true on success
+	 */
+	bool init();
+	
+	/**
+	 *  Release the resources and the entries
+	 */
+	void deinit();
+	
+	/**
+	 *  Read the cache file, any invalid file is treated as an empty cache
+	 *
+	 *  @param path cache file path
+	 *
+	 *  @return true if the file was loaded
+	 */
+	bool load(const char *path);
+	
+	/**
+	 *  Write the cache file if any entries changed since the last write
+	 *  Nothing is done while the file volume is read-only, so it is fine to call repeatedly.
+	 *
+	 *  @param path cache file path
+	 *
+	 *  @return true if the file was written
+	 */
+	bool flush(const char *path);
+	
+	/**
+	 *  Replace the entries with the serialised ones
+	 *
+	 *  @param data serialised cache
+	 *  @param size data size
+	 *
+	 *  @return true if the data was valid
+	 */
+	bool deserialize(const uint8_t *data, size_t size);
+	
+	/**
+	 *  Serialise the entries dropping the ones unused for too long
+	 *
+	 *  @param size serialised data size
+	 *
+	 *  @return allocated buffer or nullptr
+	 */
+	uint8_t *serialize(size_t &size);
+	
+	/**
+	 *  Look up a symbol
+	 *
+	 *  @param uuid   binary UUID
+	 *  @param symbol symbol name
+	 *  @param value  unslid symbol value
+	 *  @param found  false if the symbol is known to be missing
+	 *
+	 *  @return true if the symbol is cached
+	 */
+	bool lookup(const uint8_t *uuid, const char *symbol, uint64_t &value, bool &found);
+	
+	/**
+	 *  Remember a symbol lookup result
+	 *
+	 *  @param uuid   binary UUID
+	 *  @param symbol symbol name
+	 *  @param value  unslid symbol value
+	 *  @param found  false if the symbol is missing
+	 */
+	void store(const uint8_t *uuid, const char *symbol, uint64_t value, bool found);
+	
+private:
+	/**
+	 *  File format identification
+	 */
+	static constexpr uint32_t Magic {0x4359534C}; // LSYC
+	static constexpr uint32_t Version {1};
+	
+	/**
+	 *  Maximum number of written boots an entry may stay unused
+	 */
+	static constexpr uint32_t MaxAge {8};
+	
+	/**
+	 *  Maximum accepted file size
+	 */
+	static constexpr size_t MaxFileSize {1024*1024};
+	
+	/**
+	 *  Serialised cache header followed by the entries and the string table
+	 *  checksum is FNV-1a of everything after the header.
+	 */
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryNum;
+		uint32_t stringSize;
+		uint32_t checksum;
+		uint32_t reserved;
+	};
+	
+	/**
+	 *  Serialised cache entry
+	 */
+	struct FileEntry {
+		uint8_t uuid[UUIDSize];
+		uint64_t value;
+		uint32_t name;  // string table offset
+		uint16_t age;   // written boots since the last use
+		uint16_t flags;
+	};
+	
+	static_assert(sizeof(FileEntry) == 32, "Unexpected FileEntry layout");
+	
+	/**
+	 *  FileEntry flags
+	 */
+	static constexpr uint16_t FlagFound {1};
+	
+	/**
+	 *  Cached symbol
+	 */
+	struct Entry {
+		uint8_t uuid[UUIDSize];
+		uint64_t value;
+		uint32_t age;
+		bool found;
+		bool used;
+		char *name;
+		
+		static Entry *create(const uint8_t *uuid, const char *symbol, uint64_t value, bool found, uint32_t age, bool used);
+		static void deleter(Entry *entry);
+	};
+	
+	/**
+	 *  Find an entry, must be called with the lock held
+	 *
+	 *  @param uuid   binary UUID
+	 *  @param symbol symbol name
+	 *
+	 *  @return entry or nullptr
+	 */
+	Entry *find(const uint8_t *uuid, const char *symbol);
+	
+	/**
+	 *  Cached symbols
+	 */
+	evector<Entry *, Entry::deleter> entries;
+	
+	/**
+	 *  Entry access lock
+	 */
+	IOLock *lock {nullptr};
+	
+	/**
+	 *  Set when the entries changed since the last write
+	 */
+	bool dirty {false};
+};
+
+#endif /* kern_symcache_hpp */
@@ -0,0 +1,99 @@
+//
+//  kern_workqueue.hpp
+//  Lilu
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#ifndef kern_workqueue_hpp
+#define kern_workqueue_hpp
+
+#include <Headers/kern_config.hpp>
+#include <Headers/kern_util.hpp>
+
+#include <IOKit/IOLocks.h>
+#include <kern/thread_call.h>
+#include <stddef.h>
+
+/**
+ *  Initialisation time work queue
+ *  Runs independent jobs on thread calls, so that file reading and parsing done
+ *  on the boot critical path overlaps. Jobs must not depend on each other and
+ *  must only write to their own parameter, the results are meant to be consumed
+ *  in the submission order after wait() or join().
+ */
+class WorkQueue {
+public:
+	/**
+	 *  Job function type
+	 */
+	using t_job = void (*)(void *param);
+	
+	/**
+	 *  Allocate the resources
+	 *
+	 *  @return true on success
+	 */
+	bool init();
+	
+	/**
+	 *  Wait for the submitted jobs and release the resources
+	 */
+	void deinit();
+	
+	/**
+	 *  Queue a job, it is performed right away if it cannot be queued
+	 *
+	 *  @param job   job function
+	 *  @param param job parameter
+	 */
+	void submit(t_job job, void *param);
+	
+	/**
+	 *  Wait for a submitted job to complete
+	 *
+	 *  @param param job parameter, jobs performed right away are not waited for
+	 */
+	void wait(void *param);
+	
+	/**
+	 *  Wait for all the submitted jobs to complete
+	 */
+	void join();
+
+private:
+	/**
+	 *  Queued job
+	 */
+	struct Job {
+		t_job func;
+		void *param;
+		WorkQueue *queue;
+		thread_call_t call;
+		bool done;
+		
+		static Job *create(WorkQueue *queue, t_job func, void *param);
+		static void deleter(Job *job);
+	};
+	
+	/**
+	 *  Thread call entry point
+	 *
+	 *  @param job   queued job
+	 *  @param param unused
+	 */
+	static void perform(thread_call_param_t job, thread_call_param_t param);
+	
+	/**
+	 *  Submitted jobs, freed at join
+	 */
+	evector<Job *, Job::deleter> jobs;
+	
+	/**
+	 *  Completion lock and the number of jobs not yet completed
+	 */
+	IOLock *lock {nullptr};
+	size_t pending {0};
+};
+
+#endif /* kern_workqueue_hpp */
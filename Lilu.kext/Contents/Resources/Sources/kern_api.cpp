@@ -7,6 +7,7 @@
 
 #include <Headers/kern_config.hpp>
 #include <Headers/kern_api.hpp>
+#include <PrivateHeaders/kern_workqueue.hpp>
 
 #include <IOKit/IOLib.h>
 #include <IOKit/IORegistryEntry.h>
@@ -88,6 +89,30 @@ LiluAPI::Error LiluAPI::shouldLoad(const char *product, size_t version, const ch
 		}
 	}
 	
+	if (!addPlugin(loadedPlugins, product)) {
+		SYSLOG("api @ failed to store %s plugin", product);
+		return Error::MemoryError;
+	}
+	
+	return Error::NoError;
+}
+
+LiluAPI::Error LiluAPI::declareSymbols(const char *product, const char * const symbols[], size_t num) {
+	if (apiRequestsOver)
+		return Error::TooLate;
+	
+	for (size_t i = 0; i < num; i++) {
+		if (!declaredSymbols.push_back(symbols[i])) {
+			SYSLOG("api @ failed to store declared symbol %s", symbols[i]);
+			return Error::MemoryError;
+		}
+	}
+	
+	if (!addPlugin(declaringPlugins, product)) {
+		SYSLOG("api @ failed to store %s symbol declaration", product);
+		return Error::MemoryError;
+	}
+	
 	return Error::NoError;
 }
 
@@ -205,6 +230,17 @@ void LiluAPI::processPatcherLoadCallbacks(KernelPatcher &patcher) {
 		p->first(p->second, patcher);
 	}
 	
+	// Read and parse the kext files concurrently, they are still loaded in order below
+	WorkQueue queue;
+	if (queue.init()) {
+		for (size_t i = 0; i < storedKexts.size(); i++) {
+			auto stored = storedKexts[i];
+			for (size_t j = 0; j < stored->second; j++)
+				patcher.prepareKinfo(&stored->first[j], queue);
+		}
+		queue.deinit();
+	}
+	
 	// Queue the kexts we are in need of waiting
 	for (size_t i = 0; i < storedKexts.size(); i++) {
 		auto stored = storedKexts[i];
@@ -298,6 +334,42 @@ void LiluAPI::processBinaryLoadCallbacks(UserPatcher &patcher, vm_map_t map, con
 	}
 }
 
+void LiluAPI::compactSymbols(KernelPatcher &patcher) {
+	// Kernel symbols setupKextListening may still solve when a plugin calls it late
+	static const char * const patcherSymbols[] {
+		"_gLoadedKextSummaries",
+		"__ZN6OSKext25updateLoadedKextSummariesEv",
+		"_OSKextLoadedKextSummariesUpdated"
+	};
+	
+	// Undeclared plugins may solve any symbol, and plugins that did not load need none
+	bool declared = loadedPlugins.size() > 0;
+	for (size_t i = 0; i < loadedPlugins.size() && declared; i++) {
+		declared = false;
+		for (size_t j = 0; j < declaringPlugins.size() && !declared; j++)
+			declared = !strcmp(loadedPlugins[i], declaringPlugins[j]);
+	}
+	
+	for (size_t i = 0; i < arrsize(patcherSymbols) && declared; i++)
+		declared = declaredSymbols.push_back(patcherSymbols[i]);
+	
+	if (declared) {
+		DBGLOG("api @ keeping %zu declared symbols of %zu plugins", declaredSymbols.size(), loadedPlugins.size());
+		patcher.compactSymbols(declaredSymbols.data(), declaredSymbols.size());
+	} else {
+		patcher.compactSymbols();
+	}
+}
+
+bool LiluAPI::addPlugin(evector<const char *> &list, const char *product) {
+	for (size_t i = 0; i < list.size(); i++) {
+		if (!strcmp(list[i], product))
+			return true;
+	}
+	
+	return list.push_back(product);
+}
+
 void LiluAPI::activate(KernelPatcher &kpatcher, UserPatcher &upatcher) {
 	kpatcher.activate();
 	upatcher.activate();
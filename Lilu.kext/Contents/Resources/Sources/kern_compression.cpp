@@ -14,53 +14,448 @@
 
 #include <stdint.h>
 #include <sys/types.h>
-
-#include <FastCompression.hpp>
+#include <kern/clock.h>
 
 const size_t N = 4096;      /* size of ring buffer - must be power of 2 */
 const size_t F = 18;        /* upper limit for match_length */
 const size_t THRESHOLD = 2; /* encode string into position and length if match_length is greater than this */
 
-// Taken from kext_tools/compression.c
+// Based on kext_tools/compression.c, but decodes straight from the output buffer
+// The ring buffer of the original code always holds the last N output bytes, preceded by
+// spaces at start, so a match is a back reference into the output with spaces before it.
 static size_t decompress_lzss(uint8_t *dst, uint32_t dstlen, uint8_t *src, uint32_t srclen) {
-	/* ring buffer of size N, with extra F-1 bytes to aid string comparison */
-	uint8_t text_buf[N + F - 1];
 	uint8_t *dststart = dst;
 	const uint8_t *dstend = dst + dstlen;
 	const uint8_t *srcend = src + srclen;
-	int  i, j, k, r, c;
-	unsigned int flags;
-	
-	dst = dststart;
-	for (i = 0; i < N - F; i++)
-		text_buf[i] = ' ';
-	r = N - F;
-	flags = 0;
+	unsigned int flags = 0;
+	
 	for ( ; ; ) {
 		if (((flags >>= 1) & 0x100) == 0) {
-			if (src < srcend) c = *src++; else break;
+			if (src == srcend) break;
+			flags = *src++ | 0xFF00;  /* uses higher byte cleverly */
+			
+			// Eight literals in a row are copied at once
+			if (flags == 0xFFFF && srcend - src >= 8 && dstend - dst >= 8) {
+				memcpy(dst, src, 8);
+				dst += 8;
+				src += 8;
+				flags = 0;
+				continue;
+			}
+		}   /* to count eight */
+		
+		if (flags & 1) {
+			if (src == srcend || dst == dstend) break;
+			*dst++ = *src++;
+		} else {
+			if (srcend - src < 2) break;
+			size_t pos = src[0] | ((src[1] & 0xF0) << 4);
+			size_t len = (src[1] & 0x0F) + THRESHOLD + 1;
+			src += 2;
+			
+			// Distance between the ring buffer write and read positions, N when they are equal
+			size_t done = dst - dststart;
+			size_t dist = (N - F + done - pos) & (N - 1);
+			if (dist == 0)
+				dist = N;
+			
+			bool full = static_cast<size_t>(dstend - dst) <= len;
+			if (full)
+				len = dstend - dst;
+			
+			// Back references before the output start read the initial spaces
+			if (dist > done) {
+				size_t spaces = dist - done < len ? dist - done : len;
+				memset(dst, ' ', spaces);
+				dst += spaces;
+				len -= spaces;
+			}
+			
+			const uint8_t *from = dst - dist;
+			if (dist >= sizeof(uint64_t) && static_cast<size_t>(dstend - dst) >= F + sizeof(uint64_t)) {
+				// Non-overlapping words, the tail written past len is overwritten by the next tokens
+				for (size_t k = 0; k < len; k += sizeof(uint64_t)) {
+					uint64_t word;
+					memcpy(&word, from + k, sizeof(uint64_t));
+					memcpy(dst + k, &word, sizeof(uint64_t));
+				}
+				dst += len;
+			} else {
+				for (size_t k = 0; k < len; k++)
+					*dst++ = from[k];
+			}
+			
+			if (full) break;
+		}
+	}
+	
+	return dst - dststart;
+}
+
+/**
+ *  LZVN opcode kinds
+ *  Every opcode may be followed by L literal bytes and then copies M bytes from D bytes back,
+ *  a missing distance means the previous one.
+ */
+enum LzvnOpcode : uint8_t {
+	LzvnSmlD, // LLMMMDDD DDDDDDDD, 2 bytes
+	LzvnMedD, // 101LLMMM DDDDDDMM DDDDDDDD, 3 bytes
+	LzvnLrgD, // LLMMM111 DDDDDDDD DDDDDDDD, 3 bytes
+	LzvnPreD, // LLMMM110, 1 byte
+	LzvnSmlM, // 1111MMMM, 1 byte, no literals
+	LzvnLrgM, // 11110000 MMMMMMMM, 2 bytes, no literals
+	LzvnSmlL, // 1110LLLL, 1 byte, no match
+	LzvnLrgL, // 11100000 LLLLLLLL, 2 bytes, no match
+	LzvnNop,  // 00001110 or 00010110
+	LzvnEos,  // 00000110 followed by 7 zero bytes
+	LzvnUdef
+};
+
+/**
+ *  Classify LZVN opcode
+ *
+ *  @param op opcode byte
+ *
+ *  @return opcode kind
+ */
+static constexpr LzvnOpcode lzvnOpcode(uint8_t op) {
+	return op >= 0xF0 ? (op == 0xF0 ? LzvnLrgM : LzvnSmlM) :
+		op >= 0xE0 ? (op == 0xE0 ? LzvnLrgL : LzvnSmlL) :
+		op >= 0xD0 || (op >= 0x70 && op < 0x80) ? LzvnUdef :
+		op >= 0xA0 && op < 0xC0 ? LzvnMedD :
+		(op & 7) == 7 ? LzvnLrgD :
+		(op & 7) != 6 ? LzvnSmlD :
+		op >= 0x40 ? LzvnPreD :
+		op == 0x06 ? LzvnEos :
+		op == 0x0E || op == 0x16 ? LzvnNop : LzvnUdef;
+}
+
+/**
+ *  Length of LZVN opcode with its operands
+ *
+ *  @param kind opcode kind
+ *
+ *  @return opcode length in bytes
+ */
+static constexpr size_t lzvnOpcodeLength(LzvnOpcode kind) {
+	return kind == LzvnMedD || kind == LzvnLrgD ? 3 :
+		kind == LzvnSmlD || kind == LzvnLrgM || kind == LzvnLrgL ? 2 : 1;
+}
+
+/**
+ *  Decode LZVN opcode fields
+ *
+ *  @param kind opcode kind, with literals or a match
+ *  @param op   opcode bytes, lzvnOpcodeLength of them
+ *  @param lit  literal count
+ *  @param len  match length
+ *  @param dist match distance, unchanged for the opcodes reusing it
+ */
+static inline void lzvnFields(LzvnOpcode kind, const uint8_t *op, size_t &lit, size_t &len, size_t &dist) {
+	lit = len = 0;
+	switch (kind) {
+		case LzvnSmlD:
+			lit = op[0] >> 6;
+			len = ((op[0] >> 3) & 7) + 3;
+			dist = ((op[0] & 7) << 8) | op[1];
+			break;
+		case LzvnMedD:
+			lit = (op[0] >> 3) & 3;
+			len = (((op[0] & 7) << 2) | (op[1] & 3)) + 3;
+			dist = (op[1] >> 2) | (op[2] << 6);
+			break;
+		case LzvnLrgD:
+			lit = op[0] >> 6;
+			len = ((op[0] >> 3) & 7) + 3;
+			dist = op[1] | (op[2] << 8);
+			break;
+		case LzvnPreD:
+			lit = op[0] >> 6;
+			len = ((op[0] >> 3) & 7) + 3;
+			break;
+		case LzvnSmlM:
+			len = op[0] & 0xF;
+			break;
+		case LzvnLrgM:
+			len = op[1] + 16;
+			break;
+		case LzvnSmlL:
+			lit = op[0] & 0xF;
+			break;
+		case LzvnLrgL:
+			lit = op[1] + 16;
+			break;
+		default:
+			break;
+	}
+}
+
+// Compatible with lzvn_decode from FastCompression, strictly checks every opcode against the buffer bounds
+// Decoding stops at the end of stream opcode, when the destination is full, or on malformed input (returns 0).
+static size_t decompress_lzvn(uint8_t *dst, uint32_t dstlen, const uint8_t *src, uint32_t srclen) {
+	uint8_t *dststart = dst;
+	const uint8_t *dstend = dst + dstlen;
+	const uint8_t *srcend = src + srclen;
+	size_t dist = 0;
+	
+	while (src < srcend) {
+		auto kind = lzvnOpcode(src[0]);
+		if (kind == LzvnNop) {
+			src++;
+			continue;
+		} else if (kind == LzvnEos) {
+			return dst - dststart;
+		} else if (kind == LzvnUdef) {
+			return 0;
+		}
+		
+		size_t oplen = lzvnOpcodeLength(kind), lit, len;
+		size_t avail = srcend - src;
+		if (avail < oplen) return 0;
+		lzvnFields(kind, src, lit, len, dist);
+		
+		if (avail - oplen < lit) return 0;
+		src += oplen;
+		
+		if (lit > 0) {
+			if (static_cast<size_t>(dstend - dst) <= lit) {
+				memcpy(dst, src, dstend - dst);
+				return dstlen;
+			}
+			memcpy(dst, src, lit);
+			dst += lit;
+			src += lit;
+		}
+		
+		if (len > 0) {
+			if (dist == 0 || dist > static_cast<size_t>(dst - dststart)) return 0;
+			
+			bool full = static_cast<size_t>(dstend - dst) <= len;
+			if (full)
+				len = dstend - dst;
+			
+			const uint8_t *from = dst - dist;
+			if (dist >= sizeof(uint64_t) && static_cast<size_t>(dstend - dst) - len >= sizeof(uint64_t)) {
+				// Non-overlapping words, the tail written past len is overwritten by the next opcodes
+				for (size_t k = 0; k < len; k += sizeof(uint64_t)) {
+					uint64_t word;
+					memcpy(&word, from + k, sizeof(uint64_t));
+					memcpy(dst + k, &word, sizeof(uint64_t));
+				}
+				dst += len;
+			} else {
+				for (size_t k = 0; k < len; k++)
+					*dst++ = from[k];
+			}
+			
+			if (full) return dstlen;
+		}
+	}
+	
+	return dst - dststart;
+}
+
+/**
+ *  Compressed data input for streaming decompression
+ */
+struct StreamInput {
+	static constexpr uint32_t ChunkSize {64*1024};
+	t_compressedReader reader;
+	void *user;
+	uint32_t offset; // next compressed data offset to read
+	uint32_t left;   // compressed data left to read
+	uint8_t *chunk;
+	uint32_t pos;
+	uint32_t size;
+	
+	bool next(uint8_t &c) {
+		if (pos == size) {
+			if (left == 0)
+				return false;
+			uint32_t want = left < ChunkSize ? left : ChunkSize;
+			uint32_t got = reader(user, chunk, offset, want);
+			if (got == 0 || got > want)
+				return false;
+			offset += got;
+			left -= got;
+			pos = 0;
+			size = got;
+		}
+		c = chunk[pos++];
+		return true;
+	}
+};
+
+/**
+ *  Decompressed data output for streaming decompression
+ */
+struct StreamOutput {
+	const DecompressWindow *windows;
+	size_t num;
+	uint32_t pos; // decompressed data offset
+	uint32_t end; // last needed decompressed data offset
+	
+	void put(uint8_t c) {
+		for (size_t i = 0; i < num; i++) {
+			if (pos - windows[i].offset < windows[i].size)
+				windows[i].buffer[pos - windows[i].offset] = c;
+		}
+		pos++;
+	}
+};
+
+// Streaming version of decompress_lzss, the ring buffer is all the history it needs
+// Like in kext_tools the whole ring buffer starts with spaces, so that back references
+// to the slots not yet written are decoded the same way as by decompress_lzss.
+static bool decompress_lzss_windows(StreamInput &in, StreamOutput &out) {
+	uint8_t text_buf[N];
+	size_t r = N - F;
+	unsigned int flags = 0;
+	uint8_t c, d;
+	
+	memset(text_buf, ' ', sizeof(text_buf));
+	while (out.pos < out.end) {
+		if (((flags >>= 1) & 0x100) == 0) {
+			if (!in.next(c)) break;
 			flags = c | 0xFF00;  /* uses higher byte cleverly */
 		}   /* to count eight */
 		if (flags & 1) {
-			if (src < srcend) c = *src++; else break;
-			if (dst < dstend) *dst++ = c; else break;
+			if (!in.next(c)) break;
+			out.put(c);
 			text_buf[r++] = c;
 			r &= (N - 1);
 		} else {
-			if (src < srcend) i = *src++; else break;
-			if (src < srcend) j = *src++; else break;
-			i |= ((j & 0xF0) << 4);
-			j  =  (j & 0x0F) + THRESHOLD;
-			for (k = 0; k <= j; k++) {
-				c = text_buf[(i + k) & (N - 1)];
-				if (dst < dstend) *dst++ = c; else break;
+			if (!in.next(c)) break;
+			if (!in.next(d)) break;
+			size_t pos = c | ((d & 0xF0) << 4);
+			size_t len = (d & 0x0F) + THRESHOLD;
+			for (size_t k = 0; k <= len && out.pos < out.end; k++) {
+				c = text_buf[(pos + k) & (N - 1)];
+				out.put(c);
 				text_buf[r++] = c;
 				r &= (N - 1);
 			}
 		}
 	}
 	
-	return dst - dststart;
+	return out.pos == out.end;
+}
+
+/**
+ *  LZVN history size, covers the largest match distance of 0xFFFF
+ */
+static constexpr size_t LzvnHistory {64*1024};
+
+// Streaming version of decompress_lzvn, keeps the last LzvnHistory output bytes for the matches
+// Literals are read completely even past the last needed byte, so that truncated input fails
+// exactly like with decompress_lzvn.
+static bool decompress_lzvn_windows(StreamInput &in, StreamOutput &out, uint8_t *history) {
+	size_t dist = 0;
+	uint8_t op[3], c;
+	
+	while (out.pos < out.end) {
+		if (!in.next(op[0])) break;
+		auto kind = lzvnOpcode(op[0]);
+		if (kind == LzvnNop)
+			continue;
+		else if (kind == LzvnEos || kind == LzvnUdef)
+			break;
+		
+		size_t oplen = lzvnOpcodeLength(kind), lit, len;
+		for (size_t k = 1; k < oplen; k++) {
+			if (!in.next(op[k])) return false;
+		}
+		lzvnFields(kind, op, lit, len, dist);
+		
+		for (size_t k = 0; k < lit; k++) {
+			if (!in.next(c)) return false;
+			if (out.pos < out.end) {
+				history[out.pos & (LzvnHistory - 1)] = c;
+				out.put(c);
+			}
+		}
+		
+		if (len > 0 && out.pos < out.end) {
+			if (dist == 0 || dist > out.pos) return false;
+			for (size_t k = 0; k < len && out.pos < out.end; k++) {
+				c = history[(out.pos - dist) & (LzvnHistory - 1)];
+				history[out.pos & (LzvnHistory - 1)] = c;
+				out.put(c);
+			}
+		}
+	}
+	
+	return out.pos == out.end;
+}
+
+bool decompressWindows(uint32_t compression, uint32_t dstlen, t_compressedReader reader, void *user, uint32_t srclen, const DecompressWindow *windows, size_t num) {
+	StreamOutput out {windows, num, 0, 0};
+	for (size_t i = 0; i < num; i++) {
+		if (windows[i].offset > dstlen || dstlen - windows[i].offset < windows[i].size) {
+			SYSLOG("compression @ window %zu is out of decompressed data bounds", i);
+			return false;
+		}
+		if (windows[i].offset + windows[i].size > out.end)
+			out.end = windows[i].offset + windows[i].size;
+	}
+	
+	if (compression != CompressionLZSS && compression != CompressionLZVN) {
+		DBGLOG("compression @ no streaming support for %X compression", compression);
+		return false;
+	}
+	
+	StreamInput in {reader, user, 0, srclen, Buffer::create<uint8_t>(StreamInput::ChunkSize), 0, 0};
+	uint8_t *history = compression == CompressionLZVN ? Buffer::create<uint8_t>(LzvnHistory) : nullptr;
+	if (!in.chunk || (compression == CompressionLZVN && !history)) {
+		SYSLOG("compression @ failed to allocate memory for streaming decompression");
+		Buffer::deleter(in.chunk);
+		Buffer::deleter(history);
+		return false;
+	}
+	
+	bool result = compression == CompressionLZSS ? decompress_lzss_windows(in, out) : decompress_lzvn_windows(in, out, history);
+	if (!result)
+		SYSLOG("compression @ failed to decompress the data up to %u bytes", out.end);
+	
+	Buffer::deleter(history);
+	Buffer::deleter(in.chunk);
+	return result;
+}
+
+uint32_t computeAdler32(const uint8_t *data, size_t size) {
+	// Largest block keeping the sums within 32 bits before the modulo, see zlib
+	constexpr uint32_t Base {65521};
+	constexpr size_t Block {5552};
+	constexpr uint64_t Mask {0x00FF00FF00FF00FFULL};
+	uint32_t s1 {1}, s2 {0};
+	
+	while (size > 0) {
+		size_t n = size < Block ? size : Block;
+		size -= n;
+		
+		// Bytes of two words are spread over 16-bit lanes, and multiplication by the per lane
+		// weights adds them up into the top lane: the plain sum for s1 and the weighted one for s2.
+		for ( ; n >= 2 * sizeof(uint64_t); n -= 2 * sizeof(uint64_t), data += 2 * sizeof(uint64_t)) {
+			uint64_t w0, w1;
+			memcpy(&w0, data, sizeof(uint64_t));
+			memcpy(&w1, data + sizeof(uint64_t), sizeof(uint64_t));
+			uint64_t e0 = w0 & Mask, o0 = (w0 >> 8) & Mask;
+			uint64_t e1 = w1 & Mask, o1 = (w1 >> 8) & Mask;
+			s2 += 16 * s1 + static_cast<uint32_t>((e0 * 0x0010000E000C000AULL + o0 * 0x000F000D000B0009ULL +
+												   e1 * 0x0008000600040002ULL + o1 * 0x0007000500030001ULL) >> 48);
+			s1 += static_cast<uint32_t>(((e0 + o0 + e1 + o1) * 0x0001000100010001ULL) >> 48);
+		}
+		
+		for ( ; n > 0; n--) {
+			s1 += *data++;
+			s2 += s1;
+		}
+		
+		s1 %= Base;
+		s2 %= Base;
+	}
+	
+	return (s2 << 16) | s1;
 }
 
 uint8_t *decompressData(uint32_t compression, uint32_t dstlen, uint8_t *src, uint32_t srclen) {
@@ -72,7 +467,7 @@ uint8_t *decompressData(uint32_t compression, uint32_t dstlen, uint8_t *src, uin
 				size = decompress_lzss(decompressedBuf, dstlen, src, srclen);
 				break;
 			case CompressionLZVN:
-				size = lzvn_decode(decompressedBuf, dstlen, src, srclen);
+				size = decompress_lzvn(decompressedBuf, dstlen, src, srclen);
 				break;
 			default:
 				SYSLOG("compression @ unsupported compression %X", compression);
@@ -91,4 +486,24 @@ uint8_t *decompressData(uint32_t compression, uint32_t dstlen, uint8_t *src, uin
 	return 0;
 }
 
+uint8_t *decompressData(uint32_t compression, uint32_t dstlen, uint8_t *src, uint32_t srclen, uint32_t hash) {
+	auto decompressedBuf = decompressData(compression, dstlen, src, srclen);
+	if (!decompressedBuf)
+		return nullptr;
+	
+	uint64_t start, end, ns;
+	clock_get_uptime(&start);
+	uint32_t checksum = computeAdler32(decompressedBuf, dstlen);
+	clock_get_uptime(&end);
+	absolutetime_to_nanoseconds(end - start, &ns);
+	DBGLOG("compression @ verified %u bytes in %llu us", dstlen, ns / 1000);
+	
+	if (checksum == hash)
+		return decompressedBuf;
+	
+	SYSLOG("compression @ checksum mismatch %08X instead of %08X", checksum, hash);
+	Buffer::deleter(decompressedBuf);
+	return nullptr;
+}
+
 #endif /* COMPRESSION_SUPPORT */
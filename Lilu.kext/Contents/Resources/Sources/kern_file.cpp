@@ -9,10 +9,138 @@
 #include <Headers/kern_file.hpp>
 #include <Headers/kern_util.hpp>
 
+#include <IOKit/IOLocks.h>
 #include <sys/time.h>
 #include <sys/vnode.h>
 #include <sys/fcntl.h>
 
+/**
+ *  Data of a completed read kept for the read cache
+ */
+struct CachedRead {
+	vnode_t vnode;
+	uint32_t vid;
+	off_t offset;
+	size_t size;
+	uint8_t *data;
+	
+	static void deleter(CachedRead *read) {
+		Buffer::deleter(read->data);
+		delete read;
+	}
+};
+
+/**
+ *  Read cache state, the lock is allocated once and kept
+ */
+static IOLock *readCacheLock {nullptr};
+static evector<CachedRead *, CachedRead::deleter> readCache;
+static size_t readCacheLimit {0};
+static size_t readCacheUsed {0};
+
+#ifdef DEBUG
+/**
+ *  Read cache statistics
+ */
+static size_t readCacheHits {0};
+static size_t readCacheMisses {0};
+static size_t readCacheSaved {0};
+#endif
+
+/**
+ *  Copy the data from a cached read covering the range
+ *
+ *  @param buffer output buffer
+ *  @param off    file offset
+ *  @param size   bytes to read
+ *  @param vnode  file node
+ *
+ *  @return true if the range was served from the cache
+ */
+static bool readCacheLookup(void *buffer, off_t off, size_t size, vnode_t vnode) {
+	if (!readCacheLock)
+		return false;
+	
+	bool found {false};
+	IOLockLock(readCacheLock);
+	if (readCacheLimit > 0) {
+		uint32_t vid = vnode_vid(vnode);
+		for (size_t i = 0; i < readCache.size(); i++) {
+			auto read = readCache[i];
+			if (read->vnode == vnode && read->vid == vid && read->offset <= off &&
+				static_cast<size_t>(off - read->offset) + size <= read->size) {
+				memcpy(buffer, read->data + (off - read->offset), size);
+				found = true;
+				break;
+			}
+		}
+#ifdef DEBUG
+		if (found) {
+			readCacheHits++;
+			readCacheSaved += size;
+		} else {
+			readCacheMisses++;
+		}
+#endif
+	}
+	IOLockUnlock(readCacheLock);
+	
+	return found;
+}
+
+/**
+ *  Remember the data of a completed read evicting the oldest reads if necessary
+ *
+ *  @param buffer read data
+ *  @param off    file offset
+ *  @param size   bytes read
+ *  @param vnode  file node
+ */
+static void readCacheStore(const void *buffer, off_t off, size_t size, vnode_t vnode) {
+	if (!readCacheLock)
+		return;
+	
+	IOLockLock(readCacheLock);
+	if (size > 0 && size <= readCacheLimit) {
+		while (readCacheUsed + size > readCacheLimit) {
+			readCacheUsed -= readCache[0]->size;
+			readCache.erase(0);
+		}
+		
+		auto data = Buffer::create<uint8_t>(size);
+		auto read = data ? new CachedRead {vnode, vnode_vid(vnode), off, size, data} : nullptr;
+		if (read) {
+			memcpy(data, buffer, size);
+			if (readCache.push_back(read))
+				readCacheUsed += size;
+			else
+				CachedRead::deleter(read);
+		} else {
+			Buffer::deleter(data);
+		}
+	}
+	IOLockUnlock(readCacheLock);
+}
+
+/**
+ *  Forget the cached reads of a vnode
+ *
+ *  @param vnode file node
+ */
+static void readCacheInvalidate(vnode_t vnode) {
+	if (!readCacheLock)
+		return;
+	
+	IOLockLock(readCacheLock);
+	for (size_t i = readCache.size(); i > 0; i--) {
+		if (readCache[i-1]->vnode == vnode) {
+			readCacheUsed -= readCache[i-1]->size;
+			readCache.erase(i-1);
+		}
+	}
+	IOLockUnlock(readCacheLock);
+}
+
 uint8_t *FileIO::readFileToBuffer(const char *path, size_t &size) {
 	vnode_t vnode = NULLVP;
 	vfs_context_t ctxt = vfs_context_create(nullptr);
@@ -50,7 +178,143 @@ uint8_t *FileIO::readFileToBuffer(const char *path, size_t &size) {
 
 
 int FileIO::readFileData(void *buffer, off_t off, size_t size, vnode_t vnode, vfs_context_t ctxt) {
-	return performFileIO(buffer, off, size, vnode, ctxt, false);
+	if (readCacheLookup(buffer, off, size, vnode))
+		return 0;
+	
+	int error = performFileIO(buffer, off, size, vnode, ctxt, false);
+	if (!error)
+		readCacheStore(buffer, off, size, vnode);
+	return error;
+}
+
+int FileIO::readFileRanges(vnode_t vnode, vfs_context_t ctxt, const Range *ranges, size_t num) {
+	// Skipping up to this many bytes between two ranges is cheaper than another read
+	static constexpr size_t MaxGap {64*1024};
+	
+	if (num == 0)
+		return 0;
+	
+	auto order = Buffer::create<size_t>(num);
+	if (!order) {
+		SYSLOG("file @ failed to allocate memory for %zu ranges", num);
+		return ENOMEM;
+	}
+	
+	// Few ranges are expected, insertion sort is fine, cached and empty ranges need no reading
+	size_t pending {0};
+	for (size_t i = 0; i < num; i++) {
+		if (ranges[i].size == 0 || readCacheLookup(ranges[i].buffer, ranges[i].offset, ranges[i].size, vnode))
+			continue;
+		size_t j = pending++;
+		for (; j > 0 && ranges[order[j-1]].offset > ranges[i].offset; j--)
+			order[j] = order[j-1];
+		order[j] = i;
+	}
+	
+	uint8_t *gap {nullptr};
+	int error {0};
+	size_t reads {0};
+	
+	for (size_t start = 0; start < pending && !error; ) {
+		// Grow the group while the next range does not overlap and starts close enough
+		off_t end = ranges[order[start]].offset + ranges[order[start]].size;
+		size_t last = start + 1, iovs = 1;
+		bool gaps {false};
+		for (; last < pending; last++) {
+			auto &next = ranges[order[last]];
+			if (next.offset < end || static_cast<size_t>(next.offset - end) > MaxGap)
+				break;
+			if (next.offset > end) {
+				gaps = true;
+				iovs++;
+			}
+			iovs++;
+			end = next.offset + next.size;
+		}
+		
+		if (gaps && !gap) {
+			gap = Buffer::create<uint8_t>(MaxGap);
+			if (!gap) {
+				SYSLOG("file @ failed to allocate memory for range gaps");
+				error = ENOMEM;
+				break;
+			}
+		}
+		
+		uio_t uio = uio_create(static_cast<int>(iovs), ranges[order[start]].offset, UIO_SYSSPACE, UIO_READ);
+		if (!uio) {
+			SYSLOG("file @ uio_create returned null!");
+			error = EINVAL;
+			break;
+		}
+		
+		// Skipped bytes all go to the same scratch buffer
+		off_t pos = ranges[order[start]].offset;
+		for (size_t i = start; i < last && !error; i++) {
+			auto &range = ranges[order[i]];
+			if (range.offset > pos)
+				error = uio_addiov(uio, CAST_USER_ADDR_T(gap), range.offset - pos);
+			if (!error)
+				error = uio_addiov(uio, CAST_USER_ADDR_T(range.buffer), range.size);
+			pos = range.offset + range.size;
+		}
+		
+		if (error) {
+			SYSLOG("file @ uio_addiov returned error %d!", error);
+		} else {
+			error = VNOP_READ(vnode, uio, 0, ctxt);
+			if (error) {
+				SYSLOG("file @ VNOP_READ failed %d!", error);
+			} else if (uio_resid(uio)) {
+				SYSLOG("file @ uio_resid returned non-null!");
+				error = EINVAL;
+			}
+		}
+		
+		uio_free(uio);
+		reads++;
+		start = last;
+	}
+	
+	for (size_t i = 0; i < pending && !error; i++)
+		readCacheStore(ranges[order[i]].buffer, ranges[order[i]].offset, ranges[order[i]].size, vnode);
+	
+	DBGLOG("file @ read %zu ranges with %zu reads", num, reads);
+	
+	Buffer::deleter(gap);
+	Buffer::deleter(order);
+	return error;
+}
+
+bool FileIO::enableReadCache(size_t limit) {
+	if (!readCacheLock) {
+		readCacheLock = IOLockAlloc();
+		if (!readCacheLock) {
+			SYSLOG("file @ failed to allocate read cache lock");
+			return false;
+		}
+	}
+	
+	IOLockLock(readCacheLock);
+	readCacheLimit = limit;
+#ifdef DEBUG
+	readCacheHits = readCacheMisses = readCacheSaved = 0;
+#endif
+	IOLockUnlock(readCacheLock);
+	
+	return true;
+}
+
+void FileIO::disableReadCache() {
+	if (!readCacheLock)
+		return;
+	
+	IOLockLock(readCacheLock);
+	DBGLOG("file @ read cache served %zu of %zu reads saving %zu bytes, %zu bytes were cached", readCacheHits,
+		   readCacheHits + readCacheMisses, readCacheSaved, readCacheUsed);
+	readCache.deinit();
+	readCacheLimit = readCacheUsed = 0;
+	IOLockUnlock(readCacheLock);
 }
 
 size_t FileIO::readFileSize(vnode_t vnode, vfs_context_t ctxt) {
@@ -61,6 +325,37 @@ size_t FileIO::readFileSize(vnode_t vnode, vfs_context_t ctxt) {
 	return vnode_getattr(vnode, &va, ctxt) ? 0 : va.va_data_size;
 }
 
+bool FileIO::isWritablePath(const char *path) {
+	vnode_t vnode = NULLVP;
+	vfs_context_t ctxt = vfs_context_create(nullptr);
+	
+	errno_t err = vnode_lookup(path, 0, &vnode, ctxt);
+	if (err == ENOENT) {
+		// A missing file goes to its parent directory
+		auto slash = strrchr(path, '/');
+		size_t len = slash ? slash - path : 0;
+		auto dir = Buffer::create<char>(len + 2);
+		if (dir) {
+			memcpy(dir, path, len);
+			dir[len > 0 ? len : 1] = '\0';
+			if (len == 0)
+				dir[0] = '/';
+			err = vnode_lookup(dir, 0, &vnode, ctxt);
+			Buffer::deleter(dir);
+		}
+	}
+	
+	bool writable {false};
+	if (!err && vnode != NULLVP) {
+		writable = !vfs_isrdonly(vnode_mount(vnode));
+		vnode_put(vnode);
+	}
+	
+	vfs_context_rele(ctxt);
+	
+	return writable;
+}
+
 int FileIO::writeBufferToFile(const char *path, void *buffer, size_t size, int fmode, int cmode) {
 	vnode_t vnode = NULLVP;
 	vfs_context_t ctxt = vfs_context_create(nullptr);
@@ -85,6 +380,7 @@ int FileIO::writeBufferToFile(const char *path, void *buffer, size_t size, int f
 }
 
 int FileIO::writeFileData(void *buffer, off_t off, size_t size, vnode_t vnode, vfs_context_t ctxt) {
+	readCacheInvalidate(vnode);
 	return performFileIO(buffer, off, size, vnode, ctxt, true);
 }
 
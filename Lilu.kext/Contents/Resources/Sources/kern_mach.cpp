@@ -10,6 +10,7 @@
 #include <Headers/kern_config.hpp>
 #include <PrivateHeaders/kern_config.hpp>
 #include <Headers/kern_mach.hpp>
+#include <PrivateHeaders/kern_symcache.hpp>
 #ifdef COMPRESSION_SUPPORT
 #include <Headers/kern_compression.hpp>
 #endif /* COMPRESSION_SUPPORT */
@@ -29,10 +30,41 @@
 
 extern proc_t kernproc;
 
+/**
+ *  Physical page lookup used to check that running symbol tables are still mapped
+ */
+extern "C" ppnum_t pmap_find_phys(struct pmap *pmap, addr64_t va);
+extern struct pmap *kernel_pmap;
+
+/**
+ *  Check that every page of a kernel memory range is mapped
+ *
+ *  @param addr range start
+ *  @param size range size
+ *
+ *  @return true if the range may be read
+ */
+static bool isMemoryMapped(mach_vm_address_t addr, uint64_t size) {
+	if (addr + size < addr)
+		return false;
+	
+	for (mach_vm_address_t page = trunc_page_64(addr); page < addr + size; page += PAGE_SIZE_64) {
+		if (!pmap_find_phys(kernel_pmap, page))
+			return false;
+	}
+	
+	return true;
+}
+
 kern_return_t MachInfo::init(const char * const paths[], size_t num) {
 	kern_return_t error = KERN_FAILURE;
 	
 	allow_decompress = config.allowDecompress;
+	verify_decompress = config.verifyDecompress;
+	
+	// the running kernel usually still has its symbol tables in memory at this point
+	if (isKernel && initFromMemory() == KERN_SUCCESS)
+		return KERN_SUCCESS;
 
 	// Check if we have a proper credential, prevents a race-condition panic on 10.11.4 Beta
 	// When calling kauth_cred_get() for the current_thread.
@@ -52,23 +84,43 @@ kern_return_t MachInfo::init(const char * const paths[], size_t num) {
 	vnode_t vnode = NULLVP;
 	vfs_context_t ctxt = nullptr;
 	bool found = false;
+	size_t pathIndex = 0;
 
 	for (size_t i = 0; i < num; i++) {
 		vnode = NULLVP;
 		ctxt = vfs_context_create(nullptr);
+#ifdef COMPRESSION_SUPPORT
+		compressed_size = 0;
+#endif /* COMPRESSION_SUPPORT */
 		
 		errno_t err = vnode_lookup(paths[i], 0, &vnode, ctxt);
 		if (!err) {
 			kern_return_t readError = readMachHeader(machHeader, vnode, ctxt);
 			if (readError == KERN_SUCCESS) {
 				if (isKernel && !isCurrentKernel(machHeader)) {
+#ifdef COMPRESSION_SUPPORT
+					releaseDecompression();
+#endif /* COMPRESSION_SUPPORT */
 					vnode_put(vnode);
-				} else {
+				}
+#ifdef COMPRESSION_SUPPORT
+				else if (finishDecompression() != KERN_SUCCESS) {
+					releaseDecompression();
+					vnode_put(vnode);
+				}
+#endif /* COMPRESSION_SUPPORT */
+				else {
 					DBGLOG("mach @ Found executable at path: %s", paths[i]);
 					found = true;
+					pathIndex = i;
 					break;
 				}
 			}
+#ifdef COMPRESSION_SUPPORT
+			else {
+				releaseDecompression();
+			}
+#endif /* COMPRESSION_SUPPORT */
 		}
 		
 		vfs_context_rele(ctxt);
@@ -81,11 +133,32 @@ kern_return_t MachInfo::init(const char * const paths[], size_t num) {
 	}
 	
 	processMachHeader(machHeader);
+	auto uuid = getUUID(machHeader);
+	if (uuid) {
+		memcpy(file_uuid, uuid, sizeof(file_uuid));
+		file_uuid_set = true;
+	}
+	
 	if (linkedit_fileoff && symboltable_fileoff) {
-		// read linkedit from filesystem
-		error = readLinkedit(vnode, ctxt);
-		if (error != KERN_SUCCESS) {
-			SYSLOG("mach @ could not read the linkedit segment");
+#ifdef COMPRESSION_SUPPORT
+		if (file_buf) {
+			// decompressed data is not kept, so linkedit has to be copied right away
+			error = readLinkedit(vnode, ctxt);
+			if (error != KERN_SUCCESS) {
+				SYSLOG("mach @ could not read the linkedit segment");
+			}
+		} else
+#endif /* COMPRESSION_SUPPORT */
+		{
+			// otherwise postpone reading linkedit till the first symbol lookup
+			size_t len = strlen(paths[pathIndex]) + 1;
+			linkedit_path = Buffer::create<char>(len);
+			if (linkedit_path) {
+				memcpy(linkedit_path, paths[pathIndex], len);
+				error = KERN_SUCCESS;
+			} else {
+				SYSLOG("mach @ could not allocate linkedit path");
+			}
 		}
 	} else {
 		SYSLOG("mach @ couldn't find the necessary mach segments or sections (linkedit %llX, sym %X)",
@@ -114,6 +187,22 @@ void MachInfo::deinit() {
 		Buffer::deleter(linkedit_buf);
 		linkedit_buf = nullptr;
 	}
+	
+	if (linkedit_path) {
+		Buffer::deleter(linkedit_path);
+		linkedit_path = nullptr;
+	}
+	
+	if (symbol_index) {
+		Buffer::deleter(symbol_index);
+		symbol_index = nullptr;
+		symbol_index_mask = 0;
+	}
+	
+	if (symbol_sorted) {
+		Buffer::deleter(symbol_sorted);
+		symbol_sorted = nullptr;
+	}
 }
 
 mach_vm_address_t MachInfo::findKernelBase() {
@@ -170,45 +259,404 @@ kern_return_t MachInfo::setKernelWriting(bool enable, bool sync) {
 	return res;
 }
 
+/**
+ *  FNV-1a hash of a symbol name
+ *
+ *  @param symbol null-terminated symbol name
+ *
+ *  @return symbol hash
+ */
+static uint32_t symbolHash(const char *symbol) {
+	uint32_t hash = 2166136261U;
+	while (*symbol) {
+		hash ^= static_cast<uint8_t>(*symbol++);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
 mach_vm_address_t MachInfo::solveSymbol(const char *symbol) {
+	mach_vm_address_t address {0};
+	solveSymbols(&symbol, &address, 1);
+	return address;
+}
+
+bool MachInfo::canUseSymbolCache() {
+	if (!symbol_cache || !file_uuid_set || !kaslr_slide_set)
+		return false;
+	
+	auto running = getRunningUUID();
+	return running && !memcmp(running, file_uuid, sizeof(file_uuid));
+}
+
+bool MachInfo::isRunningAddress(mach_vm_address_t address) {
+	if (!running_mh)
+		return false;
+	
+	auto addr = reinterpret_cast<uint8_t *>(running_mh) + sizeof(mach_header_64);
+	auto end = addr + running_mh->sizeofcmds;
+	for (uint32_t i = 0; i < running_mh->ncmds && addr + sizeof(load_command) <= end; i++) {
+		auto loadCmd = reinterpret_cast<load_command *>(addr);
+		if (loadCmd->cmdsize < sizeof(load_command) || addr + loadCmd->cmdsize > end)
+			break;
+		if (loadCmd->cmd == LC_SEGMENT_64 && loadCmd->cmdsize >= sizeof(segment_command_64)) {
+			auto segCmd = reinterpret_cast<segment_command_64 *>(loadCmd);
+			// __LINKEDIT and __PAGEZERO never hold symbols worth patching
+			if (segCmd->initprot != VM_PROT_NONE && strncmp(segCmd->segname, "__LINKEDIT", sizeof(segCmd->segname)) &&
+				address >= segCmd->vmaddr && address - segCmd->vmaddr < segCmd->vmsize)
+				return true;
+		}
+		addr += loadCmd->cmdsize;
+	}
+	
+	return false;
+}
+
+bool MachInfo::solveCachedSymbols(const char * const symbols[], mach_vm_address_t addresses[], size_t num, size_t &solved) {
+	solved = 0;
+	if (!canUseSymbolCache())
+		return false;
+	
+	for (size_t i = 0; i < num; i++) {
+		uint64_t value {0};
+		bool found {false};
+		if (!symbol_cache->lookup(file_uuid, symbols[i], value, found))
+			return false;
+		if (found) {
+			addresses[i] = value + kaslr_slide;
+			if (!isRunningAddress(addresses[i])) {
+				SYSLOG("mach @ ignoring cached symbol %s at 0x%llx outside the running binary", symbols[i], addresses[i]);
+				return false;
+			}
+			solved++;
+		}
+	}
+	
+	return true;
+}
+
+size_t MachInfo::solveSymbols(const char * const symbols[], mach_vm_address_t addresses[], size_t num) {
+	for (size_t i = 0; i < num; i++)
+		addresses[i] = 0;
+	
+	// a warm symbol cache saves reading __LINKEDIT at all
+	size_t solved {0};
+	if (solveCachedSymbols(symbols, addresses, num, solved)) {
+		DBGLOG("mach @ solved %zu of %zu symbols from the symbol cache", solved, num);
+		return solved;
+	}
+	
+	for (size_t i = 0; i < num; i++)
+		addresses[i] = 0;
+	solved = 0;
+	
+	const nlist_64 *nlists;
+	const char *strings;
+	if (!getSymbolTables(nlists, strings))
+		return 0;
+	
+	if (!symbol_index && symbol_sorted) {
+		// prefer the already built sorted index to allocating another one
+		for (size_t i = 0; i < num; i++) {
+			uint32_t pos = findSortedSymbol(nlists, strings, symbols[i]);
+			if (pos < symboltable_nr_symbols) {
+				auto curr = &nlists[symbol_sorted[pos]];
+				if (strcmp(symbols[i], strings + curr->n_un.n_strx) == 0) {
+					addresses[i] = curr->n_value + kaslr_slide;
+					solved++;
+				}
+			}
+		}
+	} else if (symbol_index || buildSymbolIndex(nlists, strings)) {
+		for (size_t i = 0; i < num; i++) {
+			for (uint32_t slot = symbolHash(symbols[i]) & symbol_index_mask; symbol_index[slot]; slot = (slot + 1) & symbol_index_mask) {
+				auto curr = &nlists[symbol_index[slot] - 1];
+				if (strcmp(symbols[i], strings + curr->n_un.n_strx) == 0) {
+					// the symbol values are without kernel ASLR so we need to add it
+					addresses[i] = curr->n_value + kaslr_slide;
+					solved++;
+					break;
+				}
+			}
+		}
+	} else {
+		// search for all the symbols in a single pass over the symbol table
+		for (uint32_t s = 0; s < symboltable_nr_symbols && solved < num; s++) {
+			auto symbolStr = strings + nlists[s].n_un.n_strx;
+			for (size_t i = 0; i < num; i++) {
+				if (!addresses[i] && symbols[i][0] == symbolStr[0] && strcmp(symbols[i], symbolStr) == 0) {
+					addresses[i] = nlists[s].n_value + kaslr_slide;
+					solved++;
+				}
+			}
+		}
+	}
+	
+	bool cache = canUseSymbolCache();
+	for (size_t i = 0; i < num; i++) {
+		if (addresses[i])
+			DBGLOG("mach @ Found symbol %s at 0x%llx (non-aslr 0x%llx)", symbols[i], addresses[i], addresses[i] - kaslr_slide);
+		if (cache && (addresses[i] || !symbols_compacted))
+			symbol_cache->store(file_uuid, symbols[i], addresses[i] ? addresses[i] - kaslr_slide : 0, addresses[i] != 0);
+	}
+	
+	return solved;
+}
+
+size_t MachInfo::solveSymbolsWithPrefix(const char *prefix, t_symbolHandler handler, void *user) {
+	const nlist_64 *nlists;
+	const char *strings;
+	if (!getSymbolTables(nlists, strings))
+		return 0;
+	
+	if (!symbol_sorted && !buildSortedSymbolIndex(nlists, strings))
+		return 0;
+	
+	size_t len = strlen(prefix);
+	size_t found {0};
+	for (uint32_t pos = findSortedSymbol(nlists, strings, prefix); pos < symboltable_nr_symbols; pos++) {
+		auto curr = &nlists[symbol_sorted[pos]];
+		auto symbol = strings + curr->n_un.n_strx;
+		if (strncmp(prefix, symbol, len) != 0)
+			break;
+		
+		found++;
+		if (!handler(user, symbol, curr->n_value + kaslr_slide))
+			break;
+	}
+	
+	return found;
+}
+
+size_t MachInfo::compactSymbols(const char * const keep[], size_t num, bool external) {
+	// Nothing to compact if linkedit was never needed or is already compact
+	if (!linkedit_buf || symbols_compacted)
+		return 0;
+	
+	const nlist_64 *nlists;
+	const char *strings;
+	if (!getSymbolTables(nlists, strings))
+		return 0;
+	
+	// Use the external symbol range when it is available to skip the locals right away
+	uint32_t start = 0, end = symboltable_nr_symbols;
+	if (!keep && external && extdefsym_num > 0 && extdefsym_index <= end && end - extdefsym_index >= extdefsym_num) {
+		start = extdefsym_index;
+		end = extdefsym_index + extdefsym_num;
+	}
+	
+	auto wanted = [&](const nlist_64 &sym) {
+		if ((sym.n_type & N_STAB) || (sym.n_type & N_TYPE) == N_UNDF)
+			return false;
+		if (keep) {
+			auto name = strings + sym.n_un.n_strx;
+			for (size_t i = 0; i < num; i++) {
+				if (!strcmp(keep[i], name))
+					return true;
+			}
+			return false;
+		}
+		return !external || (sym.n_type & N_EXT);
+	};
+	
+	// Calculate the compact table size first, strings are kept null-terminated
+	uint32_t symbolNum {0};
+	size_t stringSize {1};
+	for (uint32_t i = start; i < end; i++) {
+		if (wanted(nlists[i])) {
+			symbolNum++;
+			stringSize += strlen(strings + nlists[i].n_un.n_strx) + 1;
+		}
+	}
+	
+	size_t compactSize = symbolNum * sizeof(nlist_64) + stringSize;
+	auto compact = Buffer::create<uint8_t>(compactSize);
+	if (!compact) {
+		SYSLOG("mach @ failed to allocate %zu bytes for compact symbols", compactSize);
+		return 0;
+	}
+	
+	auto compactNlists = reinterpret_cast<nlist_64 *>(compact);
+	auto compactStrings = reinterpret_cast<char *>(compact + symbolNum * sizeof(nlist_64));
+	uint32_t symbol {0};
+	uint32_t string {1};
+	compactStrings[0] = '\0';
+	for (uint32_t i = start; i < end; i++) {
+		if (wanted(nlists[i])) {
+			auto name = strings + nlists[i].n_un.n_strx;
+			size_t len = strlen(name) + 1;
+			compactNlists[symbol] = nlists[i];
+			compactNlists[symbol].n_un.n_strx = string;
+			memcpy(compactStrings + string, name, len);
+			string += len;
+			symbol++;
+		}
+	}
+	
+	size_t reclaimed = linkedit_size;
+	Buffer::deleter(linkedit_buf);
+	
+	if (symbol_index) {
+		reclaimed += (symbol_index_mask + 1ULL) * sizeof(uint32_t);
+		Buffer::deleter(symbol_index);
+		symbol_index = nullptr;
+		symbol_index_mask = 0;
+	}
+	
+	if (symbol_sorted) {
+		reclaimed += symboltable_nr_symbols * sizeof(uint32_t);
+		Buffer::deleter(symbol_sorted);
+		symbol_sorted = nullptr;
+	}
+	
+	// Pretend the compact table is the whole __LINKEDIT starting right at the symbols
+	linkedit_buf = compact;
+	linkedit_size = compactSize;
+	linkedit_fileoff = symboltable_fileoff;
+	stringtable_fileoff = symboltable_fileoff + symbolNum * sizeof(nlist_64);
+	symboltable_nr_symbols = symbolNum;
+	symbols_compacted = true;
+	extdefsym_index = 0;
+	extdefsym_num = 0;
+	
+	return reclaimed > compactSize ? reclaimed - compactSize : 0;
+}
+
+bool MachInfo::getSymbolTables(const nlist_64 *&symbols, const char *&strings) {
+	if (!linkedit_buf && linkedit_path) {
+		// prefer the tables of a loaded kext while they are still mapped
+		mach_vm_address_t textAddr {0};
+		if (!isKernel && running_mh && memory_size > HeaderSize &&
+			readRunningLinkedit(running_mh, memory_size, textAddr) == KERN_SUCCESS) {
+			DBGLOG("mach @ using %u symbols of the running %s", symboltable_nr_symbols, objectId ? objectId : "kext");
+			Buffer::deleter(linkedit_path);
+			linkedit_path = nullptr;
+		} else {
+			loadLinkedit();
+		}
+	}
+	
 	if (!linkedit_buf) {
 		SYSLOG("mach @ no loaded linkedit buffer found");
-		return 0;
+		return false;
 	}
 	
 	if (!symboltable_fileoff) {
 		SYSLOG("mach @ no symtable offsets found");
-		return 0;
+		return false;
 	}
 	
 	if (!kaslr_slide_set) {
 		SYSLOG("mach @ no slide is present");
-		return 0;
+		return false;
 	}
 	
 	// symbols and strings offsets into LINKEDIT
 	// we just read the __LINKEDIT but fileoff values are relative to the full /mach_kernel
 	// subtract the base of LINKEDIT to fix the value into our buffer
 	uint64_t symbolOff = symboltable_fileoff - (linkedit_fileoff);
-	if (symbolOff > symboltable_fileoff) return 0;
+	if (symbolOff > symboltable_fileoff) return false;
 	uint64_t stringOff = stringtable_fileoff - (linkedit_fileoff);
-	if (stringOff > stringtable_fileoff) return 0;
+	if (stringOff > stringtable_fileoff) return false;
 	
-	nlist_64 *nlist64 = nullptr;
-	// search for the symbol and get its location if found
-	for (uint32_t i = 0; i < symboltable_nr_symbols; i++) {
-		// get the pointer to the symbol entry and extract its symbol string
-		nlist64 = reinterpret_cast<nlist_64 *>(linkedit_buf + symbolOff + i * sizeof(nlist_64));
-		char *symbolStr = reinterpret_cast<char *>(linkedit_buf + stringOff + nlist64->n_un.n_strx);
-		// find if symbol matches
-		if (strncmp(symbol, symbolStr, strlen(symbol)+1) == 0) {
-			DBGLOG("mach @ Found symbol %s at 0x%llx (non-aslr 0x%llx)", symbol, nlist64->n_value + kaslr_slide, nlist64->n_value);
-			// the symbol values are without kernel ASLR so we need to add it
-			return nlist64->n_value + kaslr_slide;
+	symbols = reinterpret_cast<const nlist_64 *>(linkedit_buf + symbolOff);
+	strings = reinterpret_cast<const char *>(linkedit_buf + stringOff);
+	return true;
+}
+
+bool MachInfo::buildSortedSymbolIndex(const nlist_64 *symbols, const char *strings) {
+	symbol_sorted = Buffer::create<uint32_t>(symboltable_nr_symbols);
+	if (!symbol_sorted) {
+		DBGLOG("mach @ failed to allocate sorted symbol index of %u entries", symboltable_nr_symbols);
+		return false;
+	}
+	
+	// Equal names are ordered by their position to preserve the first match semantics
+	auto less = [symbols, strings](uint32_t a, uint32_t b) {
+		int r = strcmp(strings + symbols[a].n_un.n_strx, strings + symbols[b].n_un.n_strx);
+		return r < 0 || (r == 0 && a < b);
+	};
+	
+	uint32_t num = symboltable_nr_symbols;
+	auto tmp = Buffer::create<uint32_t>(num);
+	if (!tmp) {
+		DBGLOG("mach @ failed to allocate symbol sorting buffer of %u entries", num);
+		Buffer::deleter(symbol_sorted);
+		symbol_sorted = nullptr;
+		return false;
+	}
+	
+	// Bottom-up merge sort makes about half the name comparisons of in-place sorts
+	uint32_t *src = symbol_sorted, *dst = tmp;
+	for (uint32_t i = 0; i < num; i++)
+		src[i] = i;
+	
+	for (uint32_t width = 1; width < num; width *= 2) {
+		for (uint32_t lo = 0; lo < num; lo += 2 * width) {
+			uint32_t mid = num - lo > width ? lo + width : num;
+			uint32_t hi = num - mid > width ? mid + width : num;
+			uint32_t i = lo, j = mid, k = lo;
+			while (i < mid && j < hi)
+				dst[k++] = less(src[j], src[i]) ? src[j++] : src[i++];
+			while (i < mid)
+				dst[k++] = src[i++];
+			while (j < hi)
+				dst[k++] = src[j++];
 		}
+		
+		auto swap = src;
+		src = dst;
+		dst = swap;
 	}
-	// failure
-	return 0;
+	
+	if (src != symbol_sorted)
+		memcpy(symbol_sorted, src, num * sizeof(uint32_t));
+	Buffer::deleter(tmp);
+	
+	DBGLOG("mach @ built sorted symbol index for %u symbols", num);
+	return true;
+}
+
+uint32_t MachInfo::findSortedSymbol(const nlist_64 *symbols, const char *strings, const char *symbol) {
+	uint32_t first = 0, count = symboltable_nr_symbols;
+	while (count > 0) {
+		uint32_t step = count / 2;
+		if (strcmp(strings + symbols[symbol_sorted[first + step]].n_un.n_strx, symbol) < 0) {
+			first += step + 1;
+			count -= step + 1;
+		} else {
+			count = step;
+		}
+	}
+	return first;
+}
+
+bool MachInfo::buildSymbolIndex(const nlist_64 *symbols, const char *strings) {
+	// Keep the load factor under 1/2 to have short probe sequences
+	uint32_t size = 1;
+	while (size < symboltable_nr_symbols * 2ULL && size < 0x80000000)
+		size <<= 1;
+	
+	symbol_index = Buffer::create<uint32_t>(size);
+	if (!symbol_index) {
+		DBGLOG("mach @ failed to allocate symbol index of %u entries", size);
+		return false;
+	}
+	
+	symbol_index_mask = size - 1;
+	for (uint32_t i = 0; i < size; i++)
+		symbol_index[i] = 0;
+	
+	// Inserting in table order preserves the first match semantics of a linear lookup
+	for (uint32_t i = 0; i < symboltable_nr_symbols && i < symbol_index_mask; i++) {
+		uint32_t slot = symbolHash(strings + symbols[i].n_un.n_strx) & symbol_index_mask;
+		while (symbol_index[slot])
+			slot = (slot + 1) & symbol_index_mask;
+		symbol_index[slot] = i + 1;
+	}
+	
+	DBGLOG("mach @ built symbol index of %u entries for %u symbols", size, symboltable_nr_symbols);
+	return true;
 }
 
 kern_return_t MachInfo::readMachHeader(uint8_t *buffer, vnode_t vnode, vfs_context_t ctxt, off_t off) {
@@ -237,6 +685,36 @@ kern_return_t MachInfo::readMachHeader(uint8_t *buffer, vnode_t vnode, vfs_conte
 #ifdef COMPRESSION_SUPPORT
 			case CompressedMagic: { // comp
 				auto header = reinterpret_cast<CompressedHeader *>(buffer);
+				
+				// Low memory flag disables any decompression, streaming included
+				// Verification needs the whole decompressed data, which streaming never produces
+				compression_type = header->compression;
+				compression_hash = _OSSwapInt32(header->hash);
+				compressed_size = _OSSwapInt32(header->compressed);
+				decompressed_size = _OSSwapInt32(header->decompressed);
+				compressed_offset = off + sizeof(CompressedHeader);
+				if (!allow_decompress) {
+					SYSLOG("compression @ disabled due to low memory flag");
+					compressed_size = 0;
+					return KERN_FAILURE;
+				}
+				
+				if (decompressed_size >= HeaderSize && !verify_decompress) {
+					DecompressWindow window {buffer, 0, HeaderSize};
+					if (readCompressedWindows(vnode, ctxt, &window, 1)) {
+						DBGLOG("mach @ streaming %u bytes (estimated %u bytes) with %X compression mode",
+							   compressed_size, decompressed_size, compression_type);
+						continue;
+					}
+					// Reread the header overwritten by the failed attempt
+					if (FileIO::readFileData(buffer, off, HeaderSize, vnode, ctxt)) {
+						SYSLOG("mach @ compressed header reread failed");
+						compressed_size = 0;
+						return KERN_FAILURE;
+					}
+				}
+				compressed_size = 0;
+				
 				auto compressedBuf = Buffer::create<uint8_t>(_OSSwapInt32(header->compressed));
 				if (!compressedBuf) {
 					SYSLOG("mach @ failed to allocate memory for reading mach binary");
@@ -244,21 +722,31 @@ kern_return_t MachInfo::readMachHeader(uint8_t *buffer, vnode_t vnode, vfs_conte
 										vnode, ctxt) != KERN_SUCCESS) {
 					SYSLOG("mach @ failed to read compressed binary");
 				} else {
+					// Decompress the header alone first, the rest is only needed if it is accepted
+					auto headerBuf = decompressed_size >= HeaderSize ?
+						decompressData(compression_type, HeaderSize, compressedBuf, _OSSwapInt32(header->compressed)) : nullptr;
+					if (headerBuf) {
+						compressed_buf = compressedBuf;
+						compressed_size = _OSSwapInt32(header->compressed);
+						memcpy(buffer, headerBuf, HeaderSize);
+						Buffer::deleter(headerBuf);
+						continue;
+					}
+					
 					DBGLOG("mach @ decompressing %d bytes (estimated %d bytes) with %X compression mode",
 						   _OSSwapInt32(header->compressed), _OSSwapInt32(header->decompressed), header->compression);
 					
-					if (allow_decompress) {
-						file_buf = decompressData(header->compression, _OSSwapInt32(header->decompressed),
-												  compressedBuf, _OSSwapInt32(header->compressed));
-						
-						// Try again
-						if (file_buf) {
-							memcpy(buffer, file_buf, HeaderSize);
-							Buffer::deleter(compressedBuf);
-							continue;
-						}
-					} else {
-						SYSLOG("compression @ disabled due to low memory flag");
+					file_buf = verify_decompress ?
+						decompressData(header->compression, _OSSwapInt32(header->decompressed),
+									   compressedBuf, _OSSwapInt32(header->compressed), compression_hash) :
+						decompressData(header->compression, _OSSwapInt32(header->decompressed),
+									   compressedBuf, _OSSwapInt32(header->compressed));
+					
+					// Try again
+					if (file_buf) {
+						memcpy(buffer, file_buf, HeaderSize);
+						Buffer::deleter(compressedBuf);
+						continue;
 					}
 				}
 				
@@ -275,31 +763,374 @@ kern_return_t MachInfo::readMachHeader(uint8_t *buffer, vnode_t vnode, vfs_conte
 	return KERN_FAILURE;
 }
 
+#ifdef COMPRESSION_SUPPORT
+bool MachInfo::readCompressedWindows(vnode_t vnode, vfs_context_t ctxt, const DecompressWindow *windows, size_t num) {
+	struct ReadContext {
+		vnode_t vnode;
+		vfs_context_t ctxt;
+		off_t offset;
+	} context {vnode, ctxt, compressed_offset};
+	
+	return decompressWindows(compression_type, decompressed_size, [](void *user, uint8_t *buffer, uint32_t offset, uint32_t size) {
+		auto context = static_cast<ReadContext *>(user);
+		return FileIO::readFileData(buffer, context->offset + offset, size, context->vnode, context->ctxt) ? 0 : size;
+	}, &context, compressed_size, windows, num);
+}
+#endif /* COMPRESSION_SUPPORT */
+
+kern_return_t MachInfo::finishDecompression() {
+	if (!compressed_buf)
+		return KERN_SUCCESS;
+	
+	DBGLOG("mach @ decompressing %u bytes (estimated %u bytes) with %X compression mode",
+		   compressed_size, decompressed_size, compression_type);
+	
+	file_buf = verify_decompress ?
+		decompressData(compression_type, decompressed_size, compressed_buf, compressed_size, compression_hash) :
+		decompressData(compression_type, decompressed_size, compressed_buf, compressed_size);
+	Buffer::deleter(compressed_buf);
+	compressed_buf = nullptr;
+	compressed_size = 0;
+	
+	return file_buf ? KERN_SUCCESS : KERN_FAILURE;
+}
+
+void MachInfo::releaseDecompression() {
+	if (compressed_buf) {
+		Buffer::deleter(compressed_buf);
+		compressed_buf = nullptr;
+	}
+	
+	if (file_buf) {
+		Buffer::deleter(file_buf);
+		file_buf = nullptr;
+	}
+	
+	compressed_size = 0;
+}
+
 kern_return_t MachInfo::readLinkedit(vnode_t vnode, vfs_context_t ctxt) {
-	// we know the location of linkedit and offsets into symbols and their strings
-	// now we need to read linkedit into a buffer so we can process it later
-	// __LINKEDIT total size is around 1MB
-	// we should free this buffer later when we don't need anymore to solve symbols
-	linkedit_buf = Buffer::create<uint8_t>(linkedit_size);
+#ifdef COMPRESSION_SUPPORT
+	if (file_buf) {
+		// we know the location of linkedit and offsets into symbols and their strings
+		// now we need to read linkedit into a buffer so we can process it later
+		// __LINKEDIT total size is around 1MB
+		// we should free this buffer later when we don't need anymore to solve symbols
+		linkedit_buf = Buffer::create<uint8_t>(linkedit_size);
+		if (!linkedit_buf) {
+			SYSLOG("mach @ Could not allocate enough memory (%lld) for __LINKEDIT segment", linkedit_size);
+			return KERN_FAILURE;
+		}
+		
+		memcpy(linkedit_buf, file_buf+linkedit_fileoff, linkedit_size);
+		return KERN_SUCCESS;
+	}
+#endif /* COMPRESSION_SUPPORT */
+
+	// only symbol and string tables are needed to solve symbols, the rest of linkedit is skipped
+	uint64_t symbolSize = static_cast<uint64_t>(symboltable_nr_symbols) * sizeof(nlist_64);
+	uint64_t size = symbolSize + stringtable_size;
+	linkedit_buf = Buffer::create<uint8_t>(size);
 	if (!linkedit_buf) {
-		SYSLOG("mach @ Could not allocate enough memory (%lld) for __LINKEDIT segment", linkedit_size);
+		SYSLOG("mach @ Could not allocate enough memory (%lld) for symbol tables", size);
+		return KERN_FAILURE;
+	}
+	
+	int error {0};
+#ifdef COMPRESSION_SUPPORT
+	if (compressed_size) {
+		DecompressWindow windows[] {
+			{linkedit_buf, symboltable_fileoff, static_cast<uint32_t>(symbolSize)},
+			{linkedit_buf+symbolSize, stringtable_fileoff, stringtable_size}
+		};
+		if (!readCompressedWindows(vnode, ctxt, windows, arrsize(windows)))
+			error = EIO;
+	} else
+#endif /* COMPRESSION_SUPPORT */
+	{
+		FileIO::Range ranges[] {
+			{linkedit_buf, static_cast<off_t>(fat_offset+symboltable_fileoff), static_cast<size_t>(symbolSize)},
+			{linkedit_buf+symbolSize, static_cast<off_t>(fat_offset+stringtable_fileoff), stringtable_size}
+		};
+		error = FileIO::readFileRanges(vnode, ctxt, ranges, arrsize(ranges));
+	}
+	
+	if (error) {
+		SYSLOG("mach @ symbol tables read failed with %d error", error);
+		Buffer::deleter(linkedit_buf);
+		linkedit_buf = nullptr;
+		return KERN_FAILURE;
+	}
+	
+	// linkedit buffer now starts right at the symbols followed by the strings
+	DBGLOG("mach @ read %lld bytes of symbol tables instead of %lld bytes of linkedit", size, linkedit_size);
+	linkedit_fileoff = symboltable_fileoff;
+	linkedit_size = size;
+	stringtable_fileoff = static_cast<uint32_t>(symboltable_fileoff + symbolSize);
+
+	return KERN_SUCCESS;
+}
+
+kern_return_t MachInfo::loadLinkedit() {
+	// Only one attempt is made, the path is not needed afterwards
+	auto path = linkedit_path;
+	linkedit_path = nullptr;
+	
+	if (!kernproc || !current_thread() || !vfs_context_current() || !vfs_context_ucred(vfs_context_current())) {
+		SYSLOG("mach @ current context has no credential to read linkedit");
+		Buffer::deleter(path);
 		return KERN_FAILURE;
 	}
+	
+	vnode_t vnode = NULLVP;
+	vfs_context_t ctxt = vfs_context_create(nullptr);
+	kern_return_t error = KERN_FAILURE;
+	
+	errno_t err = vnode_lookup(path, 0, &vnode, ctxt);
+	if (!err) {
+		DBGLOG("mach @ reading postponed linkedit of %s", path);
+		// The file could have been replaced since init, its symbols would not match the running binary
+		if (!isReadBinary(vnode, ctxt))
+			SYSLOG("mach @ %s no longer holds the binary read at init", path);
+		else if ((error = readLinkedit(vnode, ctxt)) != KERN_SUCCESS)
+			SYSLOG("mach @ could not read the linkedit segment of %s", path);
+		vnode_put(vnode);
+	} else {
+		SYSLOG("mach @ failed to lookup %s for linkedit with %d error", path, err);
+	}
+	
+	vfs_context_rele(ctxt);
+	Buffer::deleter(path);
+	return error;
+}
 
+bool MachInfo::isReadBinary(vnode_t vnode, vfs_context_t ctxt) {
+	auto header = Buffer::create<uint8_t>(HeaderSize);
+	if (!header) {
+		SYSLOG("mach @ can't allocate header memory");
+		return false;
+	}
+	
+	bool read {false};
 #ifdef COMPRESSION_SUPPORT
-	if (!file_buf) {
+	if (compressed_size) {
+		DecompressWindow window {header, 0, HeaderSize};
+		read = readCompressedWindows(vnode, ctxt, &window, 1);
+	} else
 #endif /* COMPRESSION_SUPPORT */
-		int error = FileIO::readFileData(linkedit_buf, fat_offset+linkedit_fileoff, linkedit_size, vnode, ctxt);
-		if (error) {
-			SYSLOG("mach @ linkedit read failed with %d error", error);
+	{
+		read = FileIO::readFileData(header, fat_offset, HeaderSize, vnode, ctxt) == 0;
+	}
+	
+	auto mh = reinterpret_cast<mach_header_64 *>(header);
+	bool linkedit {false}, symtab {false}, uuid {false};
+	if (read && mh->magic == MH_MAGIC_64 && mh->sizeofcmds <= HeaderSize - sizeof(mach_header_64)) {
+		auto cmds = header + sizeof(mach_header_64);
+		for (uint32_t i = 0, off = 0; i < mh->ncmds; i++) {
+			auto loadCmd = reinterpret_cast<load_command *>(cmds + off);
+			if (mh->sizeofcmds - off < sizeof(load_command) || loadCmd->cmdsize < sizeof(load_command) ||
+				loadCmd->cmdsize > mh->sizeofcmds - off) {
+				linkedit = false;
+				break;
+			}
+			
+			if (loadCmd->cmd == LC_SEGMENT_64 && loadCmd->cmdsize >= sizeof(segment_command_64)) {
+				auto segCmd = reinterpret_cast<segment_command_64 *>(loadCmd);
+				if (!strncmp(segCmd->segname, "__LINKEDIT", sizeof(segCmd->segname)))
+					linkedit = segCmd->fileoff == linkedit_fileoff && segCmd->filesize == linkedit_size;
+			} else if (loadCmd->cmd == LC_SYMTAB && loadCmd->cmdsize >= sizeof(symtab_command)) {
+				auto symtabCmd = reinterpret_cast<symtab_command *>(loadCmd);
+				symtab = symtabCmd->symoff == symboltable_fileoff && symtabCmd->nsyms == symboltable_nr_symbols &&
+					symtabCmd->stroff == stringtable_fileoff && symtabCmd->strsize == stringtable_size;
+			} else if (loadCmd->cmd == LC_UUID && loadCmd->cmdsize >= sizeof(uuid_command)) {
+				uuid = !memcmp(reinterpret_cast<uuid_command *>(loadCmd)->uuid, file_uuid, sizeof(file_uuid));
+			}
+			
+			off += loadCmd->cmdsize;
+		}
+	}
+	
+	Buffer::deleter(header);
+	// Binaries without LC_UUID are only compared by their tables
+	return linkedit && symtab && uuid == file_uuid_set;
+}
+
+kern_return_t MachInfo::readRunningLinkedit(mach_header_64 *header, size_t size, mach_vm_address_t &textAddr) {
+	if (header->magic != MH_MAGIC_64 || header->sizeofcmds > HeaderSize - sizeof(mach_header_64)) {
+		DBGLOG("mach @ running header has unsupported magic %X or commands size %u", header->magic, header->sizeofcmds);
+		return KERN_FAILURE;
+	}
+	
+	segment_command_64 *text {nullptr}, *linkedit {nullptr};
+	symtab_command *symtab {nullptr};
+	dysymtab_command *dysymtab {nullptr};
+	uuid_command *uuid {nullptr};
+	
+	auto cmds = reinterpret_cast<uint8_t *>(header) + sizeof(mach_header_64);
+	for (uint32_t i = 0, off = 0; i < header->ncmds; i++) {
+		auto loadCmd = reinterpret_cast<load_command *>(cmds + off);
+		if (header->sizeofcmds - off < sizeof(load_command) || loadCmd->cmdsize < sizeof(load_command) ||
+			loadCmd->cmdsize > header->sizeofcmds - off) {
+			DBGLOG("mach @ running header has invalid command %u", i);
 			return KERN_FAILURE;
 		}
-#ifdef COMPRESSION_SUPPORT
-	} else {
-		memcpy(linkedit_buf, file_buf+linkedit_fileoff, linkedit_size);
+		
+		if (loadCmd->cmd == LC_SEGMENT_64 && loadCmd->cmdsize >= sizeof(segment_command_64)) {
+			auto segCmd = reinterpret_cast<segment_command_64 *>(loadCmd);
+			if (!strncmp(segCmd->segname, "__TEXT", sizeof(segCmd->segname)))
+				text = segCmd;
+			else if (!strncmp(segCmd->segname, "__LINKEDIT", sizeof(segCmd->segname)))
+				linkedit = segCmd;
+		} else if (loadCmd->cmd == LC_SYMTAB && loadCmd->cmdsize >= sizeof(symtab_command)) {
+			symtab = reinterpret_cast<symtab_command *>(loadCmd);
+		} else if (loadCmd->cmd == LC_DYSYMTAB && loadCmd->cmdsize >= sizeof(dysymtab_command)) {
+			dysymtab = reinterpret_cast<dysymtab_command *>(loadCmd);
+		} else if (loadCmd->cmd == LC_UUID && loadCmd->cmdsize >= sizeof(uuid_command)) {
+			uuid = reinterpret_cast<uuid_command *>(loadCmd);
+		}
+		
+		off += loadCmd->cmdsize;
 	}
-#endif /* COMPRESSION_SUPPORT */
+	
+	if (!text || !linkedit || !symtab || symtab->nsyms == 0 || symtab->strsize == 0) {
+		DBGLOG("mach @ running binary has no symbol tables");
+		return KERN_FAILURE;
+	}
+	
+	// symbol table offsets are file offsets, which map to memory through __LINKEDIT
+	auto base = reinterpret_cast<mach_vm_address_t>(header);
+	uint64_t symbolSize = static_cast<uint64_t>(symtab->nsyms) * sizeof(nlist_64);
+	uint64_t linkeditSize = linkedit->filesize < linkedit->vmsize ? linkedit->filesize : linkedit->vmsize;
+	if (symtab->symoff < linkedit->fileoff || symtab->stroff < linkedit->fileoff ||
+		symtab->symoff - linkedit->fileoff > linkeditSize || symbolSize > linkeditSize - (symtab->symoff - linkedit->fileoff) ||
+		symtab->stroff - linkedit->fileoff > linkeditSize || symtab->strsize > linkeditSize - (symtab->stroff - linkedit->fileoff)) {
+		DBGLOG("mach @ running symbol tables are out of __LINKEDIT bounds");
+		return KERN_FAILURE;
+	}
+	
+	// a jettisoned kext __LINKEDIT is no longer part of the kext image
+	if (linkedit->vmaddr < base || (size > 0 && (linkedit->vmaddr - base > size || linkeditSize > size - (linkedit->vmaddr - base)))) {
+		DBGLOG("mach @ running __LINKEDIT is out of image bounds");
+		return KERN_FAILURE;
+	}
+	
+	auto symbols = linkedit->vmaddr + (symtab->symoff - linkedit->fileoff);
+	auto strings = linkedit->vmaddr + (symtab->stroff - linkedit->fileoff);
+	if (!isMemoryMapped(symbols, symbolSize) || !isMemoryMapped(strings, symtab->strsize)) {
+		DBGLOG("mach @ running symbol tables are not mapped");
+		return KERN_FAILURE;
+	}
+	
+	if (reinterpret_cast<const char *>(strings)[symtab->strsize - 1] != '\0') {
+		DBGLOG("mach @ running string table is not terminated");
+		return KERN_FAILURE;
+	}
+	
+	auto buf = Buffer::create<uint8_t>(symbolSize + symtab->strsize);
+	if (!buf) {
+		SYSLOG("mach @ Could not allocate enough memory (%lld) for running symbol tables", symbolSize + symtab->strsize);
+		return KERN_FAILURE;
+	}
+	
+	memcpy(buf, reinterpret_cast<const void *>(symbols), symbolSize);
+	memcpy(buf + symbolSize, reinterpret_cast<const void *>(strings), symtab->strsize);
+	
+	auto nlists = reinterpret_cast<nlist_64 *>(buf);
+	auto defined = [](const nlist_64 &sym) {
+		return !(sym.n_type & N_STAB) && (sym.n_type & N_TYPE) == N_SECT;
+	};
+	
+	bool valid {true};
+	for (uint32_t i = 0; i < symtab->nsyms && valid; i++)
+		valid = nlists[i].n_un.n_strx < symtab->strsize;
+	
+	if (valid && size > 0) {
+		// linked kexts may have their symbols slid, which is told by a few defined symbols
+		uint32_t slid {0}, unslid {0}, checked {0};
+		for (uint32_t i = 0; i < symtab->nsyms && checked < 16; i++) {
+			if (!defined(nlists[i]))
+				continue;
+			checked++;
+			auto value = nlists[i].n_value;
+			if (value >= base && value - base < size)
+				slid++;
+			else if (value < size)
+				unslid++;
+		}
+		
+		valid = checked > 0 && (slid == checked || unslid == checked);
+		if (valid && slid > 0) {
+			for (uint32_t i = 0; i < symtab->nsyms; i++) {
+				if (defined(nlists[i]))
+					nlists[i].n_value -= base;
+			}
+		}
+	}
+	
+	if (!valid) {
+		DBGLOG("mach @ running symbol tables look invalid");
+		Buffer::deleter(buf);
+		return KERN_FAILURE;
+	}
+	
+	// same layout as readLinkedit produces, symbols followed by strings
+	linkedit_buf = buf;
+	linkedit_size = symbolSize + symtab->strsize;
+	linkedit_fileoff = symtab->symoff;
+	symboltable_fileoff = symtab->symoff;
+	symboltable_nr_symbols = symtab->nsyms;
+	stringtable_fileoff = static_cast<uint32_t>(symtab->symoff + symbolSize);
+	stringtable_size = symtab->strsize;
+	extdefsym_index = dysymtab ? dysymtab->iextdefsym : 0;
+	extdefsym_num = dysymtab ? dysymtab->nextdefsym : 0;
+	if (uuid) {
+		memcpy(file_uuid, uuid->uuid, sizeof(file_uuid));
+		file_uuid_set = true;
+	}
+	textAddr = text->vmaddr;
+	
+	return KERN_SUCCESS;
+}
 
+kern_return_t MachInfo::initFromMemory() {
+	auto base = findKernelBase();
+	if (!base) {
+		DBGLOG("mach @ failed to find kernel base for memory symbols");
+		return KERN_FAILURE;
+	}
+	
+	mach_vm_address_t textAddr {0};
+	if (readRunningLinkedit(reinterpret_cast<mach_header_64 *>(base), 0, textAddr) != KERN_SUCCESS)
+		return KERN_FAILURE;
+	
+	// the header symbol tells the slide, a variable we link against confirms it
+	static const char * const symbols[] {"__mh_execute_header", "_kernproc"};
+	mach_vm_address_t values[arrsize(symbols)] {};
+	auto nlists = reinterpret_cast<const nlist_64 *>(linkedit_buf);
+	auto strings = reinterpret_cast<const char *>(linkedit_buf + (stringtable_fileoff - linkedit_fileoff));
+	for (uint32_t i = 0; i < symboltable_nr_symbols; i++) {
+		if ((nlists[i].n_type & N_STAB) || (nlists[i].n_type & N_TYPE) != N_SECT)
+			continue;
+		for (size_t j = 0; j < arrsize(symbols); j++) {
+			if (!values[j] && !strcmp(strings + nlists[i].n_un.n_strx, symbols[j]))
+				values[j] = nlists[i].n_value;
+		}
+	}
+	
+	// slid tables cannot be told apart from a disabled kaslr, the disk tables are used then
+	mach_vm_address_t slide = base - values[0];
+	if (!values[0] || !values[1] || !slide || (slide & PAGE_MASK_64) ||
+		values[1] + slide != reinterpret_cast<mach_vm_address_t>(&kernproc)) {
+		DBGLOG("mach @ running kernel symbols do not match the running kernel");
+		Buffer::deleter(linkedit_buf);
+		linkedit_buf = nullptr;
+		file_uuid_set = false;
+		return KERN_FAILURE;
+	}
+	
+	disk_text_addr = textAddr - slide;
+	DBGLOG("mach @ using %u symbols of the running kernel with 0x%llx slide", symboltable_nr_symbols, slide);
+	
 	return KERN_SUCCESS;
 }
 
@@ -403,6 +1234,14 @@ void MachInfo::processMachHeader(void *header) {
 			symboltable_fileoff = symtab_cmd->symoff;
 			symboltable_nr_symbols = symtab_cmd->nsyms;
 			stringtable_fileoff = symtab_cmd->stroff;
+			stringtable_size = symtab_cmd->strsize;
+		}
+		// external symbol range is available at LC_DYSYMTAB command
+		else if (loadCmd->cmd == LC_DYSYMTAB) {
+			DBGLOG("mach @ header processing found DYSYMTAB");
+			dysymtab_command *dysymtab_cmd = reinterpret_cast<dysymtab_command *>(loadCmd);
+			extdefsym_index = dysymtab_cmd->iextdefsym;
+			extdefsym_num = dysymtab_cmd->nextdefsym;
 		}
 		addr += loadCmd->cmdsize;
 	}
@@ -476,6 +1315,10 @@ void MachInfo::getRunningPosition(uint8_t * &header, size_t &size) {
 	DBGLOG("mach @ getRunningPosition %p of memory %zu size", header, size);
 }
 
+const uint8_t *MachInfo::getRunningUUID() {
+	return reinterpret_cast<const uint8_t *>(getUUID(running_mh));
+}
+
 //FIXME: Guard pointer access by HeaderSize
 uint64_t *MachInfo::getUUID(void *header) {
 	if (!header) return nullptr;
@@ -7,6 +7,8 @@
 
 #include <Headers/kern_config.hpp>
 #include <PrivateHeaders/kern_patcher.hpp>
+#include <PrivateHeaders/kern_lookup.hpp>
+#include <PrivateHeaders/kern_workqueue.hpp>
 #include <Headers/kern_patcher.hpp>
 
 #include <mach/mach_types.h>
@@ -57,6 +59,7 @@ void KernelPatcher::deinit() {
 	kpatches.deinit();
 	
 	// Deallocate kinfos
+	preparedKinfos.deinit();
 	kinfos.deinit();
 	
 	// Deallocate pages
@@ -72,11 +75,18 @@ size_t KernelPatcher::loadKinfo(const char *id, const char * const paths[], size
 		}
 	}
 	
-	auto info = MachInfo::create(isKernel, id);
+	MachInfo *info {nullptr};
+	kern_return_t result {KERN_FAILURE};
+	if (!takePreparedKinfo(id, info, result)) {
+		info = MachInfo::create(isKernel, id);
+		if (info)
+			result = info->init(paths, num);
+	}
+	
 	if (!info) {
 		SYSLOG("patcher @ failed to allocate MachInfo for %s", id);
 		code = Error::MemoryIssue;
-	} else if (info->init(paths, num) != KERN_SUCCESS) {
+	} else if (result != KERN_SUCCESS) {
 		if (ADDPR(debugEnabled))
 			SYSLOG("patcher @ failed to init MachInfo for %s", id);
 		code = Error::NoKinfoFound;
@@ -84,6 +94,7 @@ size_t KernelPatcher::loadKinfo(const char *id, const char * const paths[], size
 		SYSLOG("patcher @ unable to store loaded MachInfo for %s", id);
 		code = Error::MemoryIssue;
 	} else {
+		info->setSymbolCache(symbolCache);
 		return kinfos.last();
 	}
 	
@@ -116,8 +127,72 @@ size_t KernelPatcher::loadKinfo(KernelPatcher::KextInfo *info) {
 	
 	return idx;
 }
+
+void KernelPatcher::prepareKinfo(KernelPatcher::KextInfo *info, WorkQueue &queue) {
+	if (!info || info->pathNum == 0 || info->loadIndex != KernelPatcher::KextInfo::Unloaded)
+		return;
+	
+	for (size_t i = 0; i < kinfos.size(); i++) {
+		if (kinfos[i]->objectId && !strcmp(kinfos[i]->objectId, info->id))
+			return;
+	}
+	
+	for (size_t i = 0; i < preparedKinfos.size(); i++) {
+		if (!strcmp(preparedKinfos[i]->info->objectId, info->id))
+			return;
+	}
+	
+	auto kinfo = PreparedKinfo::create(info->id, info->paths, info->pathNum);
+	if (!kinfo || !preparedKinfos.push_back(kinfo)) {
+		// loadKinfo will read the files itself
+		SYSLOG("patcher @ failed to prepare MachInfo for %s", info->id);
+		if (kinfo)
+			PreparedKinfo::deleter(kinfo);
+		return;
+	}
+	
+	queue.submit([](void *param) {
+		auto kinfo = static_cast<PreparedKinfo *>(param);
+		kinfo->result = kinfo->info->init(kinfo->paths, kinfo->num);
+	}, kinfo);
+}
 #endif /* KEXTPATH_SUPPORT */
 
+KernelPatcher::PreparedKinfo *KernelPatcher::PreparedKinfo::create(const char *id, const char * const paths[], size_t num) {
+	auto info = MachInfo::create(false, id);
+	if (!info)
+		return nullptr;
+	
+	auto kinfo = new PreparedKinfo {paths, num, info, KERN_FAILURE};
+	if (!kinfo)
+		MachInfo::deleter(info);
+	
+	return kinfo;
+}
+
+void KernelPatcher::PreparedKinfo::deleter(PreparedKinfo *kinfo) {
+	if (kinfo->info) {
+		kinfo->info->deinit();
+		MachInfo::deleter(kinfo->info);
+	}
+	delete kinfo;
+}
+
+bool KernelPatcher::takePreparedKinfo(const char *id, MachInfo *&info, kern_return_t &result) {
+	for (size_t i = 0; i < preparedKinfos.size(); i++) {
+		auto kinfo = preparedKinfos[i];
+		if (!strcmp(kinfo->info->objectId, id)) {
+			info = kinfo->info;
+			result = kinfo->result;
+			kinfo->info = nullptr;
+			preparedKinfos.erase(i);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
 void KernelPatcher::updateRunningInfo(size_t id, mach_vm_address_t slide, size_t size, bool force) {
 	if (id >= kinfos.size()) {
 		SYSLOG("patcher @ invalid kinfo id %zu for running info update", id);
@@ -138,6 +213,7 @@ bool KernelPatcher::compatibleKernel(uint32_t min, uint32_t max) {
 mach_vm_address_t KernelPatcher::solveSymbol(size_t id, const char *symbol) {
 	if (id < kinfos.size()) {
 		auto addr = kinfos[id]->solveSymbol(symbol);
+		compactLateSymbols(id);
 		if (addr) {
 			return addr;
 		}
@@ -149,6 +225,79 @@ mach_vm_address_t KernelPatcher::solveSymbol(size_t id, const char *symbol) {
 	return 0;
 }
 
+size_t KernelPatcher::solveSymbols(size_t id, const char * const symbols[], mach_vm_address_t out[], size_t num) {
+	size_t solved {0};
+	
+	if (id < kinfos.size()) {
+		solved = kinfos[id]->solveSymbols(symbols, out, num);
+		compactLateSymbols(id);
+	} else {
+		SYSLOG("patcher @ invalid kinfo id %zu for %zu symbols lookup", id, num);
+		for (size_t i = 0; i < num; i++)
+			out[i] = 0;
+	}
+	
+	if (solved != num) {
+		for (size_t i = 0; i < num; i++) {
+			if (!out[i])
+				DBGLOG("patcher @ failed to solve %s symbol", symbols[i]);
+		}
+		code = Error::NoSymbolFound;
+	}
+	
+	return solved;
+}
+
+size_t KernelPatcher::solveSymbolsWithPrefix(size_t id, const char *prefix, MachInfo::t_symbolHandler handler, void *user) {
+	if (id < kinfos.size()) {
+		auto found = kinfos[id]->solveSymbolsWithPrefix(prefix, handler, user);
+		compactLateSymbols(id);
+		if (found > 0)
+			return found;
+	} else {
+		SYSLOG("patcher @ invalid kinfo id %zu for %s symbol prefix lookup", id, prefix);
+	}
+	
+	code = Error::NoSymbolFound;
+	return 0;
+}
+
+size_t KernelPatcher::compactSymbols(size_t id, const char * const keep[], size_t num, bool external) {
+	if (id >= kinfos.size()) {
+		SYSLOG("patcher @ invalid kinfo id %zu for symbol compaction", id);
+		code = Error::NoKinfoFound;
+		return 0;
+	}
+	
+	auto reclaimed = kinfos[id]->compactSymbols(keep, num, external);
+	DBGLOG("patcher @ compacted %s symbols reclaiming %zu bytes", kinfos[id]->objectId ? kinfos[id]->objectId : "kernel", reclaimed);
+	return reclaimed;
+}
+
+void KernelPatcher::compactSymbols(const char * const keep[], size_t num) {
+	keptSymbols = keep;
+	keptSymbolNum = num;
+	symbolsCompacted = true;
+	
+	size_t total {0};
+	for (size_t i = 0; i < kinfos.size(); i++)
+		total += compactSymbols(i, keep, num);
+	DBGLOG("patcher @ symbol compaction kept %s reclaiming %zu bytes in total", keep ? "declared symbols" : "defined symbols", total);
+	
+	// Nobody is going to load the kinfos left prepared
+	preparedKinfos.deinit();
+}
+
+void KernelPatcher::compactLateSymbols(size_t id) {
+	// Lazily read __LINKEDIT is only known to be there after a lookup
+	if (!symbolsCompacted)
+		return;
+	
+	auto reclaimed = kinfos[id]->compactSymbols(keptSymbols, keptSymbolNum);
+	if (reclaimed > 0)
+		DBGLOG("patcher @ compacted %s symbols after lookup reclaiming %zu bytes", kinfos[id]->objectId ? kinfos[id]->objectId : "kernel", reclaimed);
+}
+
 #ifdef KEXTPATCH_SUPPORT
 void KernelPatcher::setupKextListening() {
 	// We have already done this
@@ -223,13 +372,12 @@ void KernelPatcher::applyLookupPatch(const LookupPatch *patch) {
 		return;
 	}
 	
-	uint8_t *off, *curr;
+	uint8_t *off;
 	size_t size;
 	auto kinfo = kinfos[patch->kext->loadIndex];
 	kinfo->getRunningPosition(off, size);
 	
-	curr = off;
-	off += size - patch->size;
+	size_t curr {0};
 	size_t changes {0};
 	
 	if (kinfo->setKernelWriting(true) != KERN_SUCCESS) {
@@ -238,15 +386,11 @@ void KernelPatcher::applyLookupPatch(const LookupPatch *patch) {
 		return;
 	}
 	
-	for (size_t i = 0; curr < off && (i < patch->count || patch->count == 0); i++) {
-		while (curr < off && memcmp(curr, patch->find, patch->size))
-			curr++;
-		
-		if (curr != off) {
-			for (size_t j = 0; j < patch->size; j++)
-				curr[j] = patch->replace[j];
-			changes++;
-		}
+	while ((changes < patch->count || patch->count == 0) && findPattern(patch->find, patch->size, off, size, curr)) {
+		for (size_t j = 0; j < patch->size; j++)
+			off[curr + j] = patch->replace[j];
+		curr += patch->size;
+		changes++;
 	}
 	
 	if (kinfo->setKernelWriting(false) != KERN_SUCCESS) {
@@ -261,6 +405,165 @@ void KernelPatcher::applyLookupPatch(const LookupPatch *patch) {
 		code = Error::MemoryIssue;
 	}
 }
+
+void KernelPatcher::applyLookupPatch(const HintedLookupPatch *patch) {
+	if (!patch || !patch->patch.kext || patch->patch.kext->loadIndex == KextInfo::Unloaded) {
+		SYSLOG("patcher @ an invalid hinted lookup patch provided");
+		code = Error::MemoryIssue;
+		return;
+	}
+	
+	uint8_t *off;
+	size_t size;
+	auto kinfo = kinfos[patch->patch.kext->loadIndex];
+	kinfo->getRunningPosition(off, size);
+	
+	// Unknown builds and stale offsets take the regular lookup
+	auto hint = findLookupHint(*patch, kinfo->getRunningUUID(), off, size);
+	if (!hint) {
+		applyLookupPatch(&patch->patch);
+		return;
+	}
+	
+	if (kinfo->setKernelWriting(true) != KERN_SUCCESS) {
+		SYSLOG("patcher @ lookup patching failed to write to kernel");
+		code = Error::MemoryProtection;
+		return;
+	}
+	
+	for (size_t i = 0; i < hint->offsetNum; i++) {
+		for (size_t j = 0; j < patch->patch.size; j++)
+			off[hint->offsets[i] + j] = patch->patch.replace[j];
+	}
+	
+	if (kinfo->setKernelWriting(false) != KERN_SUCCESS) {
+		SYSLOG("patcher @ lookup patching failed to disable kernel writing");
+		code = Error::MemoryProtection;
+	}
+}
+
+void KernelPatcher::applyLookupPatches(const LookupPatch *patches, size_t num) {
+	if (!patches || num == 0) {
+		SYSLOG("patcher @ an invalid lookup patch list provided");
+		code = Error::MemoryIssue;
+		return;
+	}
+	
+	for (size_t p = 0; p < num; p++) {
+		if (!patches[p].kext || patches[p].kext->loadIndex == KextInfo::Unloaded ||
+			patches[p].kext->loadIndex != patches[0].kext->loadIndex || !patches[p].find || !patches[p].replace) {
+			SYSLOG("patcher @ an invalid lookup patch %zu provided", p);
+			code = Error::MemoryIssue;
+			return;
+		}
+	}
+	
+	// A single pass only sees the original contents, so patches affecting each other are applied in order
+	auto conflicts = Buffer::create<bool>(num);
+	size_t conflictNum = conflicts ? LookupAutomaton::findConflicts(patches, num, conflicts) : num;
+	bool batched {false};
+	
+	if (conflictNum == 0) {
+		batched = applyLookupPatchesInPass(patches, num);
+	} else if (conflictNum < num) {
+		auto independent = Buffer::create<LookupPatch>(num - conflictNum);
+		if (independent) {
+			for (size_t p = 0, i = 0; p < num; p++) {
+				if (!conflicts[p])
+					independent[i++] = patches[p];
+			}
+			batched = applyLookupPatchesInPass(independent, num - conflictNum);
+			Buffer::deleter(independent);
+		}
+	}
+	
+	if (conflictNum > 0)
+		DBGLOG("patcher @ applying %zu of %zu lookup patches sequentially", batched ? conflictNum : num, num);
+	
+	for (size_t p = 0; p < num; p++) {
+		if (!batched || conflicts[p])
+			applyLookupPatch(&patches[p]);
+	}
+	
+	if (conflicts)
+		Buffer::deleter(conflicts);
+}
+
+bool KernelPatcher::applyLookupPatchesInPass(const LookupPatch *patches, size_t num) {
+	uint8_t *off;
+	size_t size;
+	auto kinfo = kinfos[patches[0].kext->loadIndex];
+	kinfo->getRunningPosition(off, size);
+	
+	auto storage = Buffer::create<uint8_t>(LookupAutomaton::storageSize(patches, num));
+	auto changes = Buffer::create<size_t>(num);
+	LookupAutomaton automaton;
+	
+	if (!storage || !changes || !automaton.init(patches, num, storage)) {
+		DBGLOG("patcher @ failed to prepare lookup automaton for %zu patches", num);
+		if (storage) Buffer::deleter(storage);
+		if (changes) Buffer::deleter(changes);
+		return false;
+	}
+	
+	if (kinfo->setKernelWriting(true) != KERN_SUCCESS) {
+		SYSLOG("patcher @ lookup patching failed to write to kernel");
+		code = Error::MemoryProtection;
+		Buffer::deleter(storage);
+		Buffer::deleter(changes);
+		return true;
+	}
+	
+	automaton.replaceAll(patches, num, off, size, changes, [&](size_t p, size_t start) {
+		for (size_t j = 0; j < patches[p].size; j++)
+			off[start + j] = patches[p].replace[j];
+	});
+	
+	if (kinfo->setKernelWriting(false) != KERN_SUCCESS) {
+		SYSLOG("patcher @ lookup patching failed to disable kernel writing");
+		code = Error::MemoryProtection;
+	} else {
+		for (size_t p = 0; p < num; p++) {
+			if (patches[p].count > 0 && changes[p] != patches[p].count) {
+				if (ADDPR(debugEnabled))
+					SYSLOG("patcher @ lookup patching applied only %zu patches out of %zu for %zu", changes[p], patches[p].count, p);
+				code = Error::MemoryIssue;
+			}
+		}
+	}
+	
+	Buffer::deleter(storage);
+	Buffer::deleter(changes);
+	return true;
+}
+
+const KernelPatcher::LookupHint *KernelPatcher::findLookupHint(const HintedLookupPatch &patch, const uint8_t *uuid, const uint8_t *off, size_t size) {
+	if (!uuid || !patch.hints)
+		return nullptr;
+	
+	auto &lookup = patch.patch;
+	for (size_t h = 0; h < patch.hintNum; h++) {
+		auto &hint = patch.hints[h];
+		if (memcmp(hint.uuid, uuid, sizeof(hint.uuid)))
+			continue;
+		
+		// A hint must describe exactly the expected amount of changes
+		if (hint.offsetNum == 0 || (lookup.count > 0 && hint.offsetNum != lookup.count))
+			return nullptr;
+		
+		for (size_t i = 0; i < hint.offsetNum; i++) {
+			if (hint.offsets[i] > size || size - hint.offsets[i] < lookup.size ||
+				memcmp(off + hint.offsets[i], lookup.find, lookup.size)) {
+				DBGLOG("patcher @ lookup hint offset %zu mismatch, falling back to lookup", hint.offsets[i]);
+				return nullptr;
+			}
+		}
+		
+		return &hint;
+	}
+	
+	return nullptr;
+}
 #endif /* KEXTPATCH_SUPPORT */
 
 void KernelPatcher::activate() {
@@ -8,6 +8,7 @@
 #include <Headers/kern_config.hpp>
 #include <PrivateHeaders/kern_config.hpp>
 #include <PrivateHeaders/kern_start.hpp>
+#include <Headers/kern_file.hpp>
 #include <Headers/kern_user.hpp>
 #include <Headers/kern_util.hpp>
 #include <Headers/kern_api.hpp>
@@ -43,10 +44,20 @@ void PRODUCT_NAME::stop(IOService *provider) {
 Configuration config;
 
 bool Configuration::performInit() {
+	// Kernel candidates and plugin kexts may have the same files read more than once
+	FileIO::enableReadCache();
+	
+	// Symbols solved at the previous boots do not need __LINKEDIT
+	if (useSymbolCache && symbolCache.init()) {
+		symbolCache.load(symbolCachePath);
+		kernelPatcher.setSymbolCache(&symbolCache);
+	}
+	
 	kernelPatcher.init();
 		
 	if (kernelPatcher.getError() != KernelPatcher::Error::NoError) {
 		DBGLOG("config @ failed to initialise kernel patcher");
+		FileIO::disableReadCache();
 		kernelPatcher.deinit();
 		kernelPatcher.clearError();
 		return false;
@@ -57,6 +68,7 @@ bool Configuration::performInit() {
 	initialised = userPatcher.init(kernelPatcher, preferSlowMode);
 	if (!initialised) {
 		DBGLOG("config @ initialisation failed");
+		FileIO::disableReadCache();
 		userPatcher.deinit();
 		kernelPatcher.deinit();
 		kernelPatcher.clearError();
@@ -65,6 +77,14 @@ bool Configuration::performInit() {
 	
 	lilu.processUserLoadCallbacks(userPatcher);
 	
+	// Plugin registration is over, the rest of __LINKEDIT is no longer needed
+	lilu.compactSymbols(kernelPatcher);
+	
+	FileIO::disableReadCache();
+	
+	// Usually fails as the root volume is not yet writable, the policy hooks retry later
+	symbolCache.flush(symbolCachePath);
+	
 	lilu.activate(kernelPatcher, userPatcher);
 
 	return true;
@@ -74,6 +94,8 @@ int Configuration::policyCheckRemount(kauth_cred_t cred, mount *mp, label *mlabe
 	if (!config.initialised) {
 		DBGLOG("config @ init via mac_mount_check_remount");
 		config.performInit();
+	} else {
+		config.symbolCache.flush(symbolCachePath);
 	}
 	
 	return 0;
@@ -83,6 +105,8 @@ int Configuration::policyCredCheckLabelUpdateExecve(kauth_cred_t auth, vnode_t v
 	if (!config.initialised) {
 		DBGLOG("config @ init via mac_cred_check_label_update_execve");
 		config.performInit();
+	} else {
+		config.symbolCache.flush(symbolCachePath);
 	}
 	
 	return 0;
@@ -115,6 +139,7 @@ bool Configuration::getBootArguments() {
 	ADDPR(debugEnabled) = PE_parse_boot_argn(bootargDebug, tmp, sizeof(tmp));
 	
 	allowDecompress = !PE_parse_boot_argn(bootargLowMem, tmp, sizeof(tmp));
+	verifyDecompress = PE_parse_boot_argn(bootargVerify, tmp, sizeof(tmp));
 	
 	installOrRecovery |= PE_parse_boot_argn("rp0", tmp, sizeof(tmp));
 	installOrRecovery |= PE_parse_boot_argn("rp", tmp, sizeof(tmp));
@@ -122,6 +147,9 @@ bool Configuration::getBootArguments() {
 	installOrRecovery |= PE_parse_boot_argn("root-dmg", tmp, sizeof(tmp));
 	installOrRecovery |= PE_parse_boot_argn("auth-root-dmg", tmp, sizeof(tmp));
 	
+	// Installer and recovery have different binaries and no writable volume
+	useSymbolCache = !PE_parse_boot_argn(bootargNoCache, tmp, sizeof(tmp)) && !installOrRecovery;
+	
 	preferSlowMode = getKernelVersion() <= KernelVersion::Mavericks || installOrRecovery;
 
 	if (PE_parse_boot_argn(bootargSlow, tmp, sizeof(tmp))) {
@@ -144,7 +172,7 @@ bool Configuration::getBootArguments() {
 	
 	readArguments = true;
 	
-	DBGLOG("config @ boot arguments disabled %d, debug %d, slow %d, decompress %d", isDisabled, ADDPR(debugEnabled), preferSlowMode, allowDecompress);
+	DBGLOG("config @ boot arguments disabled %d, debug %d, slow %d, decompress %d, verify %d, symbol cache %d", isDisabled, ADDPR(debugEnabled), preferSlowMode, allowDecompress, verifyDecompress, useSymbolCache);
 	
 	if (isDisabled) {
 		SYSLOG("init @ found a disabling argument or no arguments, exiting");
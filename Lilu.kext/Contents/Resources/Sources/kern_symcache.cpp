@@ -0,0 +1,283 @@
+//
+//  kern_symcache.cpp
+//  Lilu
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_config.hpp>
+#include <Headers/kern_file.hpp>
+#include <Headers/kern_util.hpp>
+#include <PrivateHeaders/kern_symcache.hpp>
+
+#include <sys/fcntl.h>
+
+/**
+ *  FNV-1a hash of the serialised data
+ *
+ *  @param data data to hash
+ *  @param size data size
+ *
+ *  @return data hash
+ */
+static uint32_t cacheChecksum(const uint8_t *data, size_t size) {
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+SymbolCache::Entry *SymbolCache::Entry::create(const uint8_t *uuid, const char *symbol, uint64_t value, bool found, uint32_t age, bool used) {
+	size_t len = strlen(symbol) + 1;
+	auto name = Buffer::create<char>(len);
+	if (!name)
+		return nullptr;
+	
+	auto entry = new Entry;
+	if (!entry) {
+		Buffer::deleter(name);
+		return nullptr;
+	}
+	
+	memcpy(entry->uuid, uuid, UUIDSize);
+	memcpy(name, symbol, len);
+	entry->value = value;
+	entry->age = age;
+	entry->found = found;
+	entry->used = used;
+	entry->name = name;
+	return entry;
+}
+
+void SymbolCache::Entry::deleter(Entry *entry) {
+	Buffer::deleter(entry->name);
+	delete entry;
+}
+
+bool SymbolCache::init() {
+	if (!lock) {
+		lock = IOLockAlloc();
+		if (!lock) {
+			SYSLOG("symcache @ failed to allocate lock");
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+void SymbolCache::deinit() {
+	entries.deinit();
+	dirty = false;
+	
+	if (lock) {
+		IOLockFree(lock);
+		lock = nullptr;
+	}
+}
+
+bool SymbolCache::load(const char *path) {
+	size_t size {0};
+	auto data = FileIO::readFileToBuffer(path, size);
+	if (!data) {
+		DBGLOG("symcache @ no symbol cache at %s", path);
+		return false;
+	}
+	
+	bool loaded = deserialize(data, size);
+	Buffer::deleter(data);
+	
+	if (loaded)
+		DBGLOG("symcache @ loaded %zu symbols from %s", entries.size(), path);
+	else
+		SYSLOG("symcache @ ignoring invalid symbol cache at %s", path);
+	
+	return loaded;
+}
+
+bool SymbolCache::flush(const char *path) {
+	if (!lock || !dirty)
+		return false;
+	
+	// The cache is usually created before the root volume becomes writable
+	if (!FileIO::isWritablePath(path))
+		return false;
+	
+	IOLockLock(lock);
+	size_t size {0};
+	auto data = dirty ? serialize(size) : nullptr;
+	if (data)
+		dirty = false;
+	IOLockUnlock(lock);
+	
+	if (!data)
+		return false;
+	
+	// Only the kernel may read or write the file, it decides what gets patched
+	int error = FileIO::writeBufferToFile(path, data, size, O_TRUNC | O_CREAT | FWRITE | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+	Buffer::deleter(data);
+	
+	if (error) {
+		SYSLOG("symcache @ failed to write symbol cache to %s with %d error", path, error);
+		IOLockLock(lock);
+		dirty = true;
+		IOLockUnlock(lock);
+		return false;
+	}
+	
+	DBGLOG("symcache @ wrote %zu bytes of symbol cache to %s", size, path);
+	return true;
+}
+
+bool SymbolCache::deserialize(const uint8_t *data, size_t size) {
+	entries.deinit();
+	
+	if (size < sizeof(FileHeader) || size > MaxFileSize)
+		return false;
+	
+	auto header = reinterpret_cast<const FileHeader *>(data);
+	if (header->magic != Magic || header->version != Version || header->reserved != 0)
+		return false;
+	
+	size_t entrySize = static_cast<size_t>(header->entryNum) * sizeof(FileEntry);
+	if (entrySize > size - sizeof(FileHeader) || header->stringSize != size - sizeof(FileHeader) - entrySize)
+		return false;
+	
+	if (cacheChecksum(data + sizeof(FileHeader), size - sizeof(FileHeader)) != header->checksum)
+		return false;
+	
+	// Every name must end within the string table
+	auto fileEntries = reinterpret_cast<const FileEntry *>(data + sizeof(FileHeader));
+	auto strings = reinterpret_cast<const char *>(data + sizeof(FileHeader) + entrySize);
+	if (header->stringSize > 0 && strings[header->stringSize - 1] != '\0')
+		return false;
+	
+	for (uint32_t i = 0; i < header->entryNum; i++) {
+		auto &fileEntry = fileEntries[i];
+		if (fileEntry.name >= header->stringSize) {
+			entries.deinit();
+			return false;
+		}
+		
+		auto entry = Entry::create(fileEntry.uuid, strings + fileEntry.name, fileEntry.value,
+								   fileEntry.flags & FlagFound, fileEntry.age, false);
+		if (!entry || !entries.push_back(entry)) {
+			SYSLOG("symcache @ failed to allocate symbol cache entry");
+			if (entry)
+				Entry::deleter(entry);
+			entries.deinit();
+			return false;
+		}
+	}
+	
+	dirty = false;
+	return true;
+}
+
+uint8_t *SymbolCache::serialize(size_t &size) {
+	auto expired = [](const Entry *entry) {
+		return !entry->used && entry->age >= MaxAge;
+	};
+	
+	uint32_t entryNum {0};
+	size_t stringSize {0};
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (!expired(entries[i])) {
+			entryNum++;
+			stringSize += strlen(entries[i]->name) + 1;
+		}
+	}
+	
+	size_t entrySize = entryNum * sizeof(FileEntry);
+	size = sizeof(FileHeader) + entrySize + stringSize;
+	if (size > MaxFileSize) {
+		SYSLOG("symcache @ symbol cache of %zu bytes is too large", size);
+		return nullptr;
+	}
+	
+	auto data = Buffer::create<uint8_t>(size);
+	if (!data) {
+		SYSLOG("symcache @ failed to allocate %zu bytes for symbol cache", size);
+		return nullptr;
+	}
+	
+	auto fileEntries = reinterpret_cast<FileEntry *>(data + sizeof(FileHeader));
+	auto strings = reinterpret_cast<char *>(data + sizeof(FileHeader) + entrySize);
+	uint32_t entry {0};
+	uint32_t string {0};
+	for (size_t i = 0; i < entries.size(); i++) {
+		auto curr = entries[i];
+		if (expired(curr))
+			continue;
+		
+		size_t len = strlen(curr->name) + 1;
+		auto &fileEntry = fileEntries[entry++];
+		memcpy(fileEntry.uuid, curr->uuid, UUIDSize);
+		fileEntry.value = curr->value;
+		fileEntry.name = string;
+		fileEntry.age = curr->used ? 0 : curr->age + 1;
+		fileEntry.flags = curr->found ? FlagFound : 0;
+		memcpy(strings + string, curr->name, len);
+		string += len;
+	}
+	
+	auto header = reinterpret_cast<FileHeader *>(data);
+	header->magic = Magic;
+	header->version = Version;
+	header->entryNum = entryNum;
+	header->stringSize = static_cast<uint32_t>(stringSize);
+	header->checksum = cacheChecksum(data + sizeof(FileHeader), size - sizeof(FileHeader));
+	header->reserved = 0;
+	
+	return data;
+}
+
+SymbolCache::Entry *SymbolCache::find(const uint8_t *uuid, const char *symbol) {
+	for (size_t i = 0; i < entries.size(); i++) {
+		auto entry = entries[i];
+		if (!memcmp(entry->uuid, uuid, UUIDSize) && !strcmp(entry->name, symbol))
+			return entry;
+	}
+	return nullptr;
+}
+
+bool SymbolCache::lookup(const uint8_t *uuid, const char *symbol, uint64_t &value, bool &found) {
+	if (!lock)
+		return false;
+	
+	IOLockLock(lock);
+	auto entry = find(uuid, symbol);
+	if (entry) {
+		entry->used = true;
+		value = entry->value;
+		found = entry->found;
+	}
+	IOLockUnlock(lock);
+	
+	return entry != nullptr;
+}
+
+void SymbolCache::store(const uint8_t *uuid, const char *symbol, uint64_t value, bool found) {
+	if (!lock)
+		return;
+	
+	IOLockLock(lock);
+	auto entry = find(uuid, symbol);
+	if (entry) {
+		entry->used = true;
+		if (entry->value != value || entry->found != found) {
+			entry->value = value;
+			entry->found = found;
+			dirty = true;
+		}
+	} else {
+		entry = Entry::create(uuid, symbol, value, found, 0, true);
+		if (entry && entries.push_back(entry))
+			dirty = true;
+		else if (entry)
+			Entry::deleter(entry);
+	}
+	IOLockUnlock(lock);
+}
@@ -9,6 +9,7 @@
 #include <Headers/kern_user.hpp>
 #include <Headers/kern_file.hpp>
 #include <PrivateHeaders/kern_config.hpp>
+#include <PrivateHeaders/kern_workqueue.hpp>
 
 #include <mach/vm_map.h>
 #include <mach-o/fat.h>
@@ -512,14 +513,47 @@ bool UserPatcher::loadDyldSharedCacheMapping() {
 	return res;
 }
 
+/**
+ *  Binary file read ahead of patch lookup
+ */
+struct PendingFile {
+	const char *path;
+	uint8_t *buffer;
+	size_t size;
+	
+	static void read(void *param) {
+		auto file = static_cast<PendingFile *>(param);
+		file->buffer = FileIO::readFileToBuffer(file->path, file->size);
+	}
+};
+
 bool UserPatcher::loadFilesForPatching() {
 	DBGLOG("user @ loading files %zu", binaryModSize);
+	
+	// Binaries may be as large as whole dyld shared caches, so only a few of them are read ahead
+	// while the current one is processed, and they are still processed in order below
+	static constexpr size_t ReadAhead {2};
+	WorkQueue queue;
+	auto files = binaryModSize > 1 && queue.init() ? Buffer::create<PendingFile>(binaryModSize) : nullptr;
+	size_t submitted {0};
 
 	for (size_t i = 0; i < binaryModSize; i++) {
 		DBGLOG("user @ requesting file %s at %zu", binaryMod[i]->path, i);
 		
-		size_t fileSize;
-		auto buf = FileIO::readFileToBuffer(binaryMod[i]->path, fileSize);
+		size_t fileSize {0};
+		uint8_t *buf {nullptr};
+		if (files) {
+			for (; submitted < binaryModSize && submitted <= i + ReadAhead; submitted++) {
+				files[submitted] = {binaryMod[submitted]->path, nullptr, 0};
+				queue.submit(PendingFile::read, &files[submitted]);
+			}
+			queue.wait(&files[i]);
+			buf = files[i].buffer;
+			fileSize = files[i].size;
+		} else {
+			buf = FileIO::readFileToBuffer(binaryMod[i]->path, fileSize);
+		}
+		
 		if (buf) {
 			vm_address_t vmsegment {0};
 			vm_address_t vmsection {0};
@@ -547,96 +581,93 @@ bool UserPatcher::loadFilesForPatching() {
 				DBGLOG("user @ findSectionBounds returned vmsegment %lX vmsection %lX sectionptr %p size %zu", vmsegment, vmsection, sectionptr, size);
 				
 				if (size) {
-					uint8_t *start = reinterpret_cast<uint8_t *>(sectionptr);
-					uint8_t *end = start + size - patch.size;
+					size_t found {0};
 					size_t skip = patch.skip;
 					size_t count = patch.count;
 					
 					DBGLOG("user @ this patch will start from %zu entry and will replace %zu findings", skip, count);
 					
-					while (start < end && count) {
-						if (!memcmp(start, patch.find, patch.size)) {
-							DBGLOG("user @ found entry of %X %X patch", patch.find[0], patch.find[1]);
+					for (; count && findPattern(patch.find, patch.size, sectionptr, size, found); found++) {
+						uint8_t *start = reinterpret_cast<uint8_t *>(sectionptr) + found;
+						DBGLOG("user @ found entry of %X %X patch", patch.find[0], patch.find[1]);
+						
+						if (skip == 0) {
+							off_t sectOff = start - reinterpret_cast<uint8_t *>(sectionptr);
+							vm_address_t vmpage = (vmsection + sectOff) & -PAGE_SIZE;
+							off_t pageOff = vmpage - vmsection;
+							off_t valueOff = reinterpret_cast<uintptr_t>(start - pageOff - reinterpret_cast<uintptr_t>(sectionptr));
+							off_t segOff = vmsection-vmsegment+sectOff;
 							
-							if (skip == 0) {
-								off_t sectOff = start - reinterpret_cast<uint8_t *>(sectionptr);
-								vm_address_t vmpage = (vmsection + sectOff) & -PAGE_SIZE;
-								off_t pageOff = vmpage - vmsection;
-								off_t valueOff = reinterpret_cast<uintptr_t>(start - pageOff - reinterpret_cast<uintptr_t>(sectionptr));
-								off_t segOff = vmsection-vmsegment+sectOff;
-								
-								DBGLOG("user @ using it off %llX pageOff %llX new %lX segOff %llX", sectOff, pageOff, vmpage, segOff);
-								
-								// We need binary entry, i.e. the page our patch belong to
-								LookupStorage *entry = nullptr;
-								for (size_t e = 0, esz = lookupStorage.size(); e < esz && !entry; e++) {
-									if (lookupStorage[e]->pageOff == pageOff)
-										entry = lookupStorage[e];
+							DBGLOG("user @ using it off %llX pageOff %llX new %lX segOff %llX", sectOff, pageOff, vmpage, segOff);
+							
+							// We need binary entry, i.e. the page our patch belong to
+							LookupStorage *entry = nullptr;
+							for (size_t e = 0, esz = lookupStorage.size(); e < esz && !entry; e++) {
+								if (lookupStorage[e]->pageOff == pageOff)
+									entry = lookupStorage[e];
+							}
+							
+							
+							if (!entry) {
+								entry = LookupStorage::create();
+								if (entry) {
+									entry->mod = binaryMod[i];
+									if (!entry->page->alloc()) {
+										LookupStorage::deleter(entry);
+										entry = nullptr;
+									} else {
+										// One could find entries by flooring first ref address but that's unreasonably complicated
+										entry->pageOff = pageOff;
+										// Now copy page data
+										memcpy(entry->page->p, reinterpret_cast<uint8_t *>(sectionptr) + pageOff, PAGE_SIZE);
+										DBGLOG("user @ first page bytes are %X %X %X %X %X %X %X %X",
+											   entry->page->p[0], entry->page->p[1], entry->page->p[2], entry->page->p[3],
+											   entry->page->p[4], entry->page->p[5], entry->page->p[6], entry->page->p[7]);
+										// Save entry in lookupStorage
+										lookupStorage.push_back(entry);
+									}
 								}
 								
-								
 								if (!entry) {
-									entry = LookupStorage::create();
-									if (entry) {
-										entry->mod = binaryMod[i];
-										if (!entry->page->alloc()) {
-											LookupStorage::deleter(entry);
-											entry = nullptr;
-										} else {
-											// One could find entries by flooring first ref address but that's unreasonably complicated
-											entry->pageOff = pageOff;
-											// Now copy page data
-											memcpy(entry->page->p, reinterpret_cast<uint8_t *>(sectionptr) + pageOff, PAGE_SIZE);
-											DBGLOG("user @ first page bytes are %X %X %X %X %X %X %X %X",
-												   entry->page->p[0], entry->page->p[1], entry->page->p[2], entry->page->p[3],
-												   entry->page->p[4], entry->page->p[5], entry->page->p[6], entry->page->p[7]);
-											// Save entry in lookupStorage
-											lookupStorage.push_back(entry);
-										}
-									}
-									
-									if (!entry) {
-										SYSLOG("user @ failed to allocate memory for LookupStorage");
-										continue;
-									}
+									SYSLOG("user @ failed to allocate memory for LookupStorage");
+									continue;
 								}
-								
-								// Use an existent reference to the same patch in the same page if any.
-								// Happens when a patch has 2+ replacements and they are close to each other.
-								LookupStorage::PatchRef *ref = nullptr;
-								for (size_t r = 0, rsz = entry->refs.size(); r < rsz && !ref; r++) {
-									if (entry->refs[r]->i == p) {
-										ref = entry->refs[r];
-									}
+							}
+							
+							// Use an existent reference to the same patch in the same page if any.
+							// Happens when a patch has 2+ replacements and they are close to each other.
+							LookupStorage::PatchRef *ref = nullptr;
+							for (size_t r = 0, rsz = entry->refs.size(); r < rsz && !ref; r++) {
+								if (entry->refs[r]->i == p) {
+									ref = entry->refs[r];
 								}
-								
-								DBGLOG("user @ ref find %d\n", ref != nullptr);
-								
-								// Or add a new patch reference
+							}
+							
+							DBGLOG("user @ ref find %d\n", ref != nullptr);
+							
+							// Or add a new patch reference
+							if (!ref) {
+								ref = LookupStorage::PatchRef::create();
 								if (!ref) {
-									ref = LookupStorage::PatchRef::create();
-									if (!ref) {
-										SYSLOG("user @ failed to allocate memory for PatchRef");
-										continue;
-									}
-									ref->i = p; // Set the reference patch
-									entry->refs.push_back(ref);
-								}
-								
-								DBGLOG("user @ ref pre %d\n", ref != nullptr);
-								
-								if (ref) {
-									DBGLOG("user @ pushing off %llX to patch", valueOff);
-									// These values belong to the current ref
-									ref->pageOffs.push_back(valueOff);
-									ref->segOffs.push_back(segOff);
+									SYSLOG("user @ failed to allocate memory for PatchRef");
+									continue;
 								}
-								count--;
-							} else {
-								skip--;
+								ref->i = p; // Set the reference patch
+								entry->refs.push_back(ref);
+							}
+							
+							DBGLOG("user @ ref pre %d\n", ref != nullptr);
+							
+							if (ref) {
+								DBGLOG("user @ pushing off %llX to patch", valueOff);
+								// These values belong to the current ref
+								ref->pageOffs.push_back(valueOff);
+								ref->segOffs.push_back(segOff);
 							}
+							count--;
+						} else {
+							skip--;
 						}
-						start++;
 					}
 				} else {
 					SYSLOG("user @ failed to obtain a corresponding section");
@@ -646,6 +677,9 @@ bool UserPatcher::loadFilesForPatching() {
 			Buffer::deleter(buf);
 		}
 	}
+	
+	queue.deinit();
+	Buffer::deleter(files);
 	return true;
 }
 
@@ -732,12 +766,44 @@ vm_prot_t UserPatcher::getPageProtection(vm_map_t map, vm_map_address_t addr) {
 }
 
 bool UserPatcher::hookMemoryAccess() {
-	// 10.12 and newer
-	mach_vm_address_t kern = patcher->solveSymbol(KernelPatcher::KernelID, "_cs_validate_range");
+	enum : size_t {
+		CodeSignValidateRange,
+		CodeSignValidatePage,
+		CurrentMap,
+		GetMapMin,
+		GetTaskMap,
+		VmMapCheckProtection,
+		VmMapReadUser,
+		VmMapWriteUser,
+		ProcExecSwitchTask,
+		VmSharedRegionMapFile,
+		VmSharedRegionSlide,
+		SymbolNum
+	};
+	
+	static const char * const symbols[SymbolNum] {
+		"_cs_validate_range",
+		"_cs_validate_page",
+		"_current_map",
+		"_get_map_min",
+		"_get_task_map",
+		"_vm_map_check_protection",
+		"_vm_map_read_user",
+		"_vm_map_write_user",
+		"_proc_exec_switch_task",
+		"_vm_shared_region_map_file",
+		"_vm_shared_region_slide"
+	};
+	
+	mach_vm_address_t addrs[SymbolNum] {};
+	patcher->solveSymbols(KernelPatcher::KernelID, symbols, addrs, SymbolNum);
+	// Some of the symbols are version-specific, each missing one is handled below
+	patcher->clearError();
 	
-	if (patcher->getError() == KernelPatcher::Error::NoError) {
+	// 10.12 and newer
+	if (addrs[CodeSignValidateRange]) {
 		orgCodeSignValidateRangeWrapper = reinterpret_cast<t_codeSignValidateRangeWrapper>(
-			patcher->routeFunction(kern, reinterpret_cast<mach_vm_address_t>(codeSignValidateRangeWrapper), true, true)
+			patcher->routeFunction(addrs[CodeSignValidateRange], reinterpret_cast<mach_vm_address_t>(codeSignValidateRangeWrapper), true, true)
 		);
 		
 		if (patcher->getError() != KernelPatcher::Error::NoError) {
@@ -745,11 +811,9 @@ bool UserPatcher::hookMemoryAccess() {
 			patcher->clearError();
 			return false;
 		}
-	} else if (static_cast<void>(patcher->clearError()),
-			   static_cast<void>(kern = patcher->solveSymbol(KernelPatcher::KernelID, "_cs_validate_page")),
-			   patcher->getError() == KernelPatcher::Error::NoError) {
+	} else if (addrs[CodeSignValidatePage]) {
 		orgCodeSignValidatePageWrapper = reinterpret_cast<t_codeSignValidatePageWrapper>(
-			patcher->routeFunction(kern, reinterpret_cast<mach_vm_address_t>(codeSignValidatePageWrapper), true, true)
+			patcher->routeFunction(addrs[CodeSignValidatePage], reinterpret_cast<mach_vm_address_t>(codeSignValidatePageWrapper), true, true)
 		);
 
 		if (patcher->getError() != KernelPatcher::Error::NoError) {
@@ -759,60 +823,29 @@ bool UserPatcher::hookMemoryAccess() {
 		}
 	} else {
 		SYSLOG("user @ failed to resolve _cs_validate function");
-		patcher->clearError();
 		return false;
 	}
 	
-	orgCurrentMap = reinterpret_cast<t_currentMap>(patcher->solveSymbol(KernelPatcher::KernelID, "_current_map"));
-	if (patcher->getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("user @ failed to resolve _current_map");
-		patcher->clearError();
-		return false;
-	}
-	
-	orgGetMapMin = reinterpret_cast<t_getMapMin>(patcher->solveSymbol(KernelPatcher::KernelID, "_get_map_min"));
-	if (patcher->getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("user @ failed to resolve _get_map_min");
-		patcher->clearError();
-		return false;
-	}
-	
-	orgGetTaskMap = reinterpret_cast<t_getTaskMap>(patcher->solveSymbol(KernelPatcher::KernelID, "_get_task_map"));
-	if (patcher->getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("user @ failed to resolve _get_task_map");
-		patcher->clearError();
-		return false;
-	}
-	
-	orgVmMapCheckProtection = reinterpret_cast<t_vmMapCheckProtection>(patcher->solveSymbol(KernelPatcher::KernelID, "_vm_map_check_protection"));
-	if (patcher->getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("user @ failed to resolve _vm_map_check_protection");
-		patcher->clearError();
-		return false;
+	for (size_t i = CurrentMap; i <= VmMapWriteUser; i++) {
+		if (!addrs[i]) {
+			SYSLOG("user @ failed to resolve %s", symbols[i]);
+			return false;
+		}
 	}
 	
-	orgVmMapReadUser = reinterpret_cast<t_vmMapReadUser>(patcher->solveSymbol(KernelPatcher::KernelID, "_vm_map_read_user"));
-	if (patcher->getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("user @ failed to resolve _vm_map_read_user");
-		patcher->clearError();
-		return false;
-	}
-	
-	orgVmMapWriteUser = reinterpret_cast<t_vmMapWriteUser>(patcher->solveSymbol(KernelPatcher::KernelID, "_vm_map_write_user"));
-	if (patcher->getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("user @ failed to resolve _vm_map_write_user");
-		patcher->clearError();
-		return false;
-	}
+	orgCurrentMap = reinterpret_cast<t_currentMap>(addrs[CurrentMap]);
+	orgGetMapMin = reinterpret_cast<t_getMapMin>(addrs[GetMapMin]);
+	orgGetTaskMap = reinterpret_cast<t_getTaskMap>(addrs[GetTaskMap]);
+	orgVmMapCheckProtection = reinterpret_cast<t_vmMapCheckProtection>(addrs[VmMapCheckProtection]);
+	orgVmMapReadUser = reinterpret_cast<t_vmMapReadUser>(addrs[VmMapReadUser]);
+	orgVmMapWriteUser = reinterpret_cast<t_vmMapWriteUser>(addrs[VmMapWriteUser]);
 	
 	// On 10.12.1 b4 Apple decided not to let current_map point to the current process
 	// For this reason we have to obtain the map with the other methods
 	if (getKernelVersion() >= KernelVersion::Sierra) {
-		kern = patcher->solveSymbol(KernelPatcher::KernelID, "_proc_exec_switch_task");
-		
-		if (patcher->getError() == KernelPatcher::Error::NoError) {
+		if (addrs[ProcExecSwitchTask]) {
 			orgProcExecSwitchTask = reinterpret_cast<t_procExecSwitchTask>(
-				patcher->routeFunction(kern, reinterpret_cast<mach_vm_address_t>(procExecSwitchTask), true, true)
+				patcher->routeFunction(addrs[ProcExecSwitchTask], reinterpret_cast<mach_vm_address_t>(procExecSwitchTask), true, true)
 			);
 			
 			if (patcher->getError() != KernelPatcher::Error::NoError) {
@@ -823,17 +856,14 @@ bool UserPatcher::hookMemoryAccess() {
 			
 		} else {
 			DBGLOG("user @ failed to resolve _proc_exec_switch_task");
-			patcher->clearError();
 			// This is not an error, early 10.12 versions have no such function
 		}
 	}
 	
 	if (patchDyldSharedCache) {
-		kern = patcher->solveSymbol(KernelPatcher::KernelID, "_vm_shared_region_map_file");
-		
-		if (patcher->getError() == KernelPatcher::Error::NoError) {
+		if (addrs[VmSharedRegionMapFile]) {
 			orgVmSharedRegionMapFile = reinterpret_cast<t_vmSharedRegionMapFile>(
-				patcher->routeFunction(kern, reinterpret_cast<mach_vm_address_t>(vmSharedRegionMapFile), true, true)
+				patcher->routeFunction(addrs[VmSharedRegionMapFile], reinterpret_cast<mach_vm_address_t>(vmSharedRegionMapFile), true, true)
 			);
 			
 			if (patcher->getError() != KernelPatcher::Error::NoError) {
@@ -844,15 +874,12 @@ bool UserPatcher::hookMemoryAccess() {
 			
 		} else {
 			SYSLOG("user @ failed to resolve _vm_shared_region_map_file");
-			patcher->clearError();
 			return false;
 		}
 		
-		kern = patcher->solveSymbol(KernelPatcher::KernelID, "_vm_shared_region_slide");
-		
-		if (patcher->getError() == KernelPatcher::Error::NoError) {
+		if (addrs[VmSharedRegionSlide]) {
 			orgVmSharedRegionSlide = reinterpret_cast<t_vmSharedRegionSlide>(
-				patcher->routeFunction(kern, reinterpret_cast<mach_vm_address_t>(vmSharedRegionSlide), true, true)
+				patcher->routeFunction(addrs[VmSharedRegionSlide], reinterpret_cast<mach_vm_address_t>(vmSharedRegionSlide), true, true)
 			);
 			
 			if (patcher->getError() != KernelPatcher::Error::NoError) {
@@ -863,7 +890,6 @@ bool UserPatcher::hookMemoryAccess() {
 			
 		} else {
 			SYSLOG("user @ failed to resolve _vm_shared_region_slide");
-			patcher->clearError();
 			return false;
 		}
 	}
@@ -48,6 +48,60 @@ char *strrchr(const char *stack, int ch) {
 	return rtnval;
 }
 
+/**
+ *  Mark zero bytes of a word with their highest bit, exact unlike the borrowing variant
+ *
+ *  @param v word to check
+ *
+ *  @return 0x80 in every zero byte position
+ */
+static inline uint64_t zeroBytes(uint64_t v) {
+	constexpr uint64_t low7 {0x7F7F7F7F7F7F7F7FULL};
+	return ~(((v & low7) + low7) | v | low7);
+}
+
+bool findPattern(const void *pattern, size_t patternSize, const void *data, size_t dataSize, size_t &dataOffset) {
+	if (patternSize == 0 || dataOffset > dataSize || patternSize > dataSize - dataOffset)
+		return false;
+	
+	auto pat = static_cast<const uint8_t *>(pattern);
+	auto buf = static_cast<const uint8_t *>(data);
+	size_t last = patternSize - 1;
+	// Last offset the pattern could be found at
+	size_t end = dataSize - patternSize;
+	size_t i = dataOffset;
+	
+	constexpr uint64_t ones {0x0101010101010101ULL};
+	uint64_t first = pat[0] * ones;
+	uint64_t final = pat[last] * ones;
+	
+	// Check 8 candidate offsets at once while both words fit
+	while (end - i >= sizeof(uint64_t)) {
+		uint64_t head, tail;
+		memcpy(&head, buf + i, sizeof(uint64_t));
+		memcpy(&tail, buf + i + last, sizeof(uint64_t));
+		uint64_t mask = zeroBytes(head ^ first) & zeroBytes(tail ^ final);
+		while (mask) {
+			size_t off = i + __builtin_ctzll(mask) / 8;
+			if (patternSize <= 2 || !memcmp(buf + off + 1, pat + 1, patternSize - 2)) {
+				dataOffset = off;
+				return true;
+			}
+			mask &= mask - 1;
+		}
+		i += sizeof(uint64_t);
+	}
+	
+	for (; i <= end; i++) {
+		if (buf[i] == pat[0] && buf[i + last] == pat[last] && !memcmp(buf + i, pat, patternSize)) {
+			dataOffset = i;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
 extern "C" void *kern_os_calloc(size_t num, size_t size) {
 	return kern_os_malloc(num * size); // malloc bzeroes the buffer
 }
@@ -0,0 +1,109 @@
+//
+//  kern_workqueue.cpp
+//  Lilu
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#include <Headers/kern_config.hpp>
+#include <Headers/kern_util.hpp>
+#include <PrivateHeaders/kern_workqueue.hpp>
+
+WorkQueue::Job *WorkQueue::Job::create(WorkQueue *queue, t_job func, void *param) {
+	auto job = new Job {func, param, queue, nullptr, false};
+	if (!job)
+		return nullptr;
+	
+	job->call = thread_call_allocate(perform, job);
+	if (!job->call) {
+		delete job;
+		return nullptr;
+	}
+	
+	return job;
+}
+
+void WorkQueue::Job::deleter(Job *job) {
+	// Allocated thread calls are released once they return
+	thread_call_free(job->call);
+	delete job;
+}
+
+bool WorkQueue::init() {
+	if (!lock) {
+		lock = IOLockAlloc();
+		if (!lock) {
+			SYSLOG("queue @ failed to allocate lock");
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+void WorkQueue::deinit() {
+	join();
+	
+	if (lock) {
+		IOLockFree(lock);
+		lock = nullptr;
+	}
+}
+
+void WorkQueue::submit(t_job job, void *param) {
+	auto queued = lock ? Job::create(this, job, param) : nullptr;
+	if (!queued || !jobs.push_back(queued)) {
+		if (queued)
+			Job::deleter(queued);
+		DBGLOG("queue @ performing a job synchronously");
+		job(param);
+		return;
+	}
+	
+	IOLockLock(lock);
+	pending++;
+	IOLockUnlock(lock);
+	
+	thread_call_enter(queued->call);
+}
+
+void WorkQueue::wait(void *param) {
+	if (!lock)
+		return;
+	
+	// Jobs are only added by the submitting thread, which is the one waiting
+	IOLockLock(lock);
+	for (size_t i = 0, num = jobs.size(); i < num; i++) {
+		if (jobs[i]->param == param) {
+			while (!jobs[i]->done)
+				IOLockSleep(lock, jobs[i], THREAD_UNINT);
+			break;
+		}
+	}
+	IOLockUnlock(lock);
+}
+
+void WorkQueue::join() {
+	if (!lock)
+		return;
+	
+	IOLockLock(lock);
+	while (pending > 0)
+		IOLockSleep(lock, &pending, THREAD_UNINT);
+	IOLockUnlock(lock);
+	
+	jobs.deinit();
+}
+
+void WorkQueue::perform(thread_call_param_t job, thread_call_param_t) {
+	auto curr = static_cast<Job *>(job);
+	curr->func(curr->param);
+	
+	auto queue = curr->queue;
+	IOLockLock(queue->lock);
+	curr->done = true;
+	IOLockWakeup(queue->lock, curr, false);
+	if (--queue->pending == 0)
+		IOLockWakeup(queue->lock, &queue->pending, false);
+	IOLockUnlock(queue->lock);
+}
@@ -9,9 +9,16 @@ ret=0
 
 rm -f "${PROJECT_DIR}/AppleALC/kern_resources.cpp"
 
+# Set RESOURCE_PROFILE to a Resources/Profiles plist name to only embed its hardware
+profile=()
+if [ "${RESOURCE_PROFILE}" != "" ]; then
+	profile=("${PROJECT_DIR}/Resources/Profiles/${RESOURCE_PROFILE}.plist")
+fi
+
 "${TARGET_BUILD_DIR}/ResourceConverter" \
 	"${PROJECT_DIR}/Resources" \
-	"${PROJECT_DIR}/AppleALC/kern_resources.cpp" || ret=1
+	"${PROJECT_DIR}/AppleALC/kern_resources.cpp" \
+	"${profile[@]}" || ret=1
 
 if (( $ret )); then
 	echo "Failed to build kern_resources.cpp"
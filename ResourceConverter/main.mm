@@ -54,6 +54,203 @@ static NSString *makeStringList(NSString *name, size_t index, NSArray *array, NS
 	return str;
 }
 
+/**
+ *  Hardware profile limiting the generated resources, nil for a full build
+ *  Codecs: array of { Vendor, CodecID, optional Revisions and Layouts }
+ *  Controllers: array of { Vendor, Device }
+ */
+static NSDictionary *hwProfile {nil};
+
+static NSArray *filterList(NSArray *items, NSArray *allowed, NSString *key=nil) {
+	if (!items || !allowed)
+		return items;
+	
+	auto list = [[[NSMutableArray alloc] init] autorelease];
+	for (id item in items) {
+		if ([allowed containsObject:key ? [item objectForKey:key] : item])
+			[list addObject:item];
+	}
+	
+	return list;
+}
+
+static NSArray *loadCodecs(NSString *path) {
+	auto fm = [NSFileManager defaultManager];
+	auto codecs = [[[NSMutableArray alloc] init] autorelease];
+	
+	for (NSString *entry in [fm contentsOfDirectoryAtPath:path error:nil]) {
+		NSString *baseDirStr = [[[NSString alloc] initWithFormat:@"%@/%@", path, entry] autorelease];
+		NSString *infoCfgStr = [[[NSString alloc] initWithFormat:@"%@/Info.plist", baseDirStr] autorelease];
+		if ([fm fileExistsAtPath:infoCfgStr])
+			[codecs addObject:@[baseDirStr, [NSDictionary dictionaryWithContentsOfFile:infoCfgStr]]];
+	}
+	
+	return codecs;
+}
+
+static NSDictionary *selectCodec(NSDictionary *profile, NSString *vendor, NSDictionary *codecDict) {
+	if (!profile)
+		return codecDict;
+	
+	for (NSDictionary *entry in [profile objectForKey:@"Codecs"]) {
+		if (![[entry objectForKey:@"Vendor"] isEqualToString:vendor] ||
+			![[entry objectForKey:@"CodecID"] isEqual:[codecDict objectForKey:@"CodecID"]])
+			continue;
+		
+		auto codec = [[codecDict mutableCopy] autorelease];
+		
+		// An empty revision list matches any revision, so a codec without matching revisions is dropped
+		NSArray *revs = [codecDict objectForKey:@"Revisions"];
+		if (revs && [entry objectForKey:@"Revisions"]) {
+			revs = filterList(revs, [entry objectForKey:@"Revisions"]);
+			if (![revs count])
+				return nil;
+			[codec setObject:revs forKey:@"Revisions"];
+		}
+		
+		NSArray *ids = [entry objectForKey:@"Layouts"];
+		NSDictionary *codecFiles = [codecDict objectForKey:@"Files"];
+		if (codecFiles && ids) {
+			auto files = [[codecFiles mutableCopy] autorelease];
+			for (NSString *type in @[@"Layouts", @"Platforms"]) {
+				NSArray *list = filterList([codecFiles objectForKey:type], ids, @"Id");
+				if ([list count])
+					[files setObject:list forKey:type];
+				else
+					[files removeObjectForKey:type];
+			}
+			[codec setObject:files forKey:@"Files"];
+		}
+		
+		return codec;
+	}
+	
+	return nil;
+}
+
+static NSArray *selectControllers(NSDictionary *profile, NSArray *ctrls) {
+	if (!profile)
+		return ctrls;
+	
+	auto list = [[[NSMutableArray alloc] init] autorelease];
+	for (NSDictionary *ctrl in ctrls) {
+		for (NSDictionary *entry in [profile objectForKey:@"Controllers"]) {
+			if ([[entry objectForKey:@"Vendor"] isEqualToString:[ctrl objectForKey:@"Vendor"]] &&
+				[[entry objectForKey:@"Device"] isEqual:[ctrl objectForKey:@"Device"]]) {
+				[list addObject:ctrl];
+				break;
+			}
+		}
+	}
+	
+	return list;
+}
+
+static NSDictionary *selectKexts(NSDictionary *profile, NSDictionary *kexts, NSArray *codecs, NSArray *ctrls) {
+	if (!profile)
+		return kexts;
+	
+	auto names = [[[NSMutableSet alloc] init] autorelease];
+	bool haveCodecs {false};
+	
+	for (NSArray *codec in codecs) {
+		NSDictionary *codecDict = selectCodec(profile, [codec[1] objectForKey:@"Vendor"], codec[1]);
+		if (codecDict) {
+			haveCodecs = true;
+			for (NSDictionary *p in [codecDict objectForKey:@"Patches"])
+				[names addObject:[p objectForKey:@"Name"]];
+		}
+	}
+	
+	for (NSDictionary *ctrl in selectControllers(profile, ctrls)) {
+		for (NSDictionary *p in [ctrl objectForKey:@"Patches"])
+			[names addObject:[p objectForKey:@"Name"]];
+	}
+	
+	auto list = [[[NSMutableDictionary alloc] init] autorelease];
+	for (NSString *kextName in kexts) {
+		NSDictionary *kextInfo = [kexts objectForKey:kextName];
+		// Codec detection needs its kexts even without patches
+		if ([names containsObject:kextName] || (haveCodecs && [kextInfo objectForKey:@"Detect"]))
+			[list setObject:kextInfo forKey:kextName];
+	}
+	
+	return list;
+}
+
+struct ResourceSize {
+	size_t codecs {0};
+	size_t files {0};
+	size_t fileBytes {0};
+	size_t controllers {0};
+	size_t patches {0};
+	size_t patchBytes {0};
+	size_t kexts {0};
+	
+	void addPatches(NSArray *list) {
+		for (NSDictionary *p in list) {
+			patches++;
+			patchBytes += [[p objectForKey:@"Find"] length] + [[p objectForKey:@"Replace"] length];
+		}
+	}
+	
+	size_t total() const {
+		return fileBytes + patchBytes;
+	}
+};
+
+static ResourceSize measureResources(NSDictionary *profile, NSArray *codecs, NSArray *ctrls, NSDictionary *kexts) {
+	ResourceSize size;
+	auto contents = [[[NSMutableSet alloc] init] autorelease];
+	
+	for (NSArray *codec in codecs) {
+		NSDictionary *codecDict = selectCodec(profile, [codec[1] objectForKey:@"Vendor"], codec[1]);
+		if (!codecDict)
+			continue;
+		
+		size.codecs++;
+		size.addPatches([codecDict objectForKey:@"Patches"]);
+		for (NSString *type in @[@"Layouts", @"Platforms"]) {
+			for (NSDictionary *f in [[codecDict objectForKey:@"Files"] objectForKey:type]) {
+				auto fullInPath = [[[NSString alloc] initWithFormat:@"%@/%@", codec[0], [f objectForKey:@"Path"]] autorelease];
+				// Files are embedded once per distinct content
+				auto data = [[NSFileManager defaultManager] contentsAtPath:fullInPath];
+				if (data && ![contents containsObject:data]) {
+					[contents addObject:data];
+					size.files++;
+					size.fileBytes += [data length];
+				}
+			}
+		}
+	}
+	
+	for (NSDictionary *ctrl in selectControllers(profile, ctrls)) {
+		size.controllers++;
+		size.addPatches([ctrl objectForKey:@"Patches"]);
+	}
+	
+	size.kexts = [selectKexts(profile, kexts, codecs, ctrls) count];
+	
+	return size;
+}
+
+static void reportSize(NSString *path, NSArray *ctrls, NSDictionary *kexts) {
+	auto codecs = loadCodecs(path);
+	auto full = measureResources(nil, codecs, ctrls, kexts);
+	auto prof = measureResources(hwProfile, codecs, ctrls, kexts);
+	
+	SYSLOG("%-12s %10s %10s", "resource", "full", "profile");
+	SYSLOG("%-12s %10zu %10zu", "codecs", full.codecs, prof.codecs);
+	SYSLOG("%-12s %10zu %10zu", "files", full.files, prof.files);
+	SYSLOG("%-12s %10zu %10zu", "file bytes", full.fileBytes, prof.fileBytes);
+	SYSLOG("%-12s %10zu %10zu", "controllers", full.controllers, prof.controllers);
+	SYSLOG("%-12s %10zu %10zu", "patches", full.patches, prof.patches);
+	SYSLOG("%-12s %10zu %10zu", "patch bytes", full.patchBytes, prof.patchBytes);
+	SYSLOG("%-12s %10zu %10zu", "kexts", full.kexts, prof.kexts);
+	SYSLOG("profile embeds %zu of %zu data bytes (%.1f%%)", prof.total(), full.total(),
+		   full.total() ? 100.0 * prof.total() / full.total() : 100.0);
+}
+
 static NSDictionary * generateKexts(NSString *file, NSDictionary *kexts) {
 	auto kextPathsSection = [[[NSMutableString alloc] initWithUTF8String:"\n// Kext section\n\n"] autorelease];
 	auto kextSection = [[[NSMutableString alloc] init] autorelease];
@@ -87,6 +284,40 @@ static NSDictionary * generateKexts(NSString *file, NSDictionary *kexts) {
 	return kextNums;
 }
 
+/**
+ *  Embedded file indexes by content hash, the data is compared on a hash match
+ */
+static std::unordered_multimap<uint64_t, size_t> fileHashMap;
+static NSMutableArray *fileDataList = [[NSMutableArray alloc] init];
+static size_t fileSharedNum {0};
+static size_t fileSharedBytes {0};
+
+static uint64_t contentHash(NSData *data) {
+	auto bytes = static_cast<const uint8_t *>([data bytes]);
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < [data length]; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool lookupFileIndex(NSData *data, size_t &index) {
+	auto range = fileHashMap.equal_range(contentHash(data));
+	for (auto it = range.first; it != range.second; ++it) {
+		if ([data isEqualToData:[fileDataList objectAtIndex:it->second]]) {
+			index = it->second;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void storeFileIndex(NSData *data, size_t index) {
+	fileHashMap.emplace(contentHash(data), index);
+	[fileDataList addObject:data];
+}
+
 static NSString *generateFile(NSString *file, NSString *path, NSString *inFile) {
 	static size_t fileIndex {0};
 	static NSMutableDictionary *fileList = [[[NSMutableDictionary alloc] init] autorelease];
@@ -99,6 +330,15 @@ static NSString *generateFile(NSString *file, NSString *path, NSString *inFile)
 		return [[[NSString alloc] initWithFormat:@"file%@, %zu", [fileList objectForKey:fullInPath], [data length]] autorelease];
 	}
 	
+	// Identical files under other names or codecs share one array
+	size_t sharedIndex {0};
+	if (data && lookupFileIndex(data, sharedIndex)) {
+		[fileList setValue:[NSNumber numberWithUnsignedLongLong:sharedIndex] forKey:fullInPath];
+		fileSharedNum++;
+		fileSharedBytes += [data length];
+		return [[[NSString alloc] initWithFormat:@"file%zu, %zu", sharedIndex, [data length]] autorelease];
+	}
+	
 	if (data) {
 		appendFile(file, [[[NSString alloc] initWithFormat:@"static const uint8_t file%zu[] {\n", fileIndex] autorelease]);
 		
@@ -114,6 +354,7 @@ static NSString *generateFile(NSString *file, NSString *path, NSString *inFile)
 		
 		appendFile(file, [[[NSString alloc] initWithFormat:@"};\n"] autorelease]);
 		[fileList setValue:[NSNumber numberWithUnsignedLongLong:fileIndex] forKey:fullInPath];
+		storeFileIndex(data, fileIndex);
 		fileIndex++;
 		return [[[NSString alloc] initWithFormat:@"file%zu, %zu", fileIndex-1, [data length]] autorelease];
 	}
@@ -289,7 +530,8 @@ static size_t generateCodecs(NSString *file, NSString *vendor, NSString *path, N
 		if ([fm fileExistsAtPath:infoCfgStr]) {
 			auto codecDict = [NSDictionary dictionaryWithContentsOfFile:infoCfgStr];
 			// Vendor match
-			if ([[codecDict objectForKey:@"Vendor"] isEqualToString:vendor]) {
+			if ([[codecDict objectForKey:@"Vendor"] isEqualToString:vendor] &&
+				(codecDict = selectCodec(hwProfile, vendor, codecDict))) {
 				auto revs = generateRevisions(file, codecDict);
 				auto platforms = generatePlatforms(file, codecDict, baseDirStr);
 				auto layouts = generateLayouts(file, codecDict, baseDirStr);
@@ -356,15 +598,20 @@ static void generateVendors(NSString *file, NSDictionary *vendors, NSString *pat
 	
 	[vendorSection appendString:@"VendorModInfo ADDPR(vendorMod)[] {\n"];
 	
+	size_t vendorNum {0};
 	for (NSString *dictKey in vendors) {
 		NSNumber *vendorID = [vendors objectForKey:dictKey];
 		size_t num = generateCodecs(file, dictKey, path, kextIndexes);
+		// Profile builds only keep the vendors they have codecs of
+		if (hwProfile && num == 0)
+			continue;
 		[vendorSection appendFormat:@"\t{ \"%@\", 0x%X, codecMod%@, %zu },\n",
 			dictKey, [vendorID unsignedShortValue], dictKey, num];
+		vendorNum++;
 	}
 	
 	[vendorSection appendString:@"};\n"];
-	[vendorSection appendFormat:@"\nconst size_t ADDPR(vendorModSize) {%lu};\n", [vendors count]];
+	[vendorSection appendFormat:@"\nconst size_t ADDPR(vendorModSize) {%zu};\n", vendorNum];
 	appendFile(file, vendorSection);
 }
 
@@ -397,8 +644,8 @@ static void generateLookup(NSString *file, NSArray *lookup) {
 
 int main(int argc, const char * argv[]) {
 	@autoreleasepool {
-		if (argc != 3)
-			ERROR("Invalid usage");
+		if (argc != 3 && argc != 4)
+			ERROR("Invalid usage, expected resources, output and optional profile paths");
 		
 		auto basePath = [[[NSString alloc] initWithUTF8String:argv[1]] autorelease];
 		auto lookupCfg = [[[NSString alloc] initWithFormat:@"%@/CodecLookup.plist", basePath] autorelease];
@@ -417,6 +664,17 @@ int main(int argc, const char * argv[]) {
 		if (!lookup || !vendors || !kexts || !ctrls)
 			ERROR("Missing resource data (lookup:%p, vendors:%p, kexts:%p, ctrls:%p)", lookup, vendors, kexts, ctrls);
 		
+		if (argc == 4) {
+			auto profileCfg = [[[NSString alloc] initWithUTF8String:argv[3]] autorelease];
+			hwProfile = [NSDictionary dictionaryWithContentsOfFile:profileCfg];
+			if (!hwProfile)
+				ERROR("Invalid profile %s", argv[3]);
+			
+			reportSize(basePath, ctrls, kexts);
+			kexts = selectKexts(hwProfile, kexts, loadCodecs(basePath), ctrls);
+			ctrls = selectControllers(hwProfile, ctrls);
+		}
+		
 		// Create a file
 		[[NSFileManager defaultManager] createFileAtPath:outputCpp contents:nil attributes:nil];
 		
@@ -425,6 +683,8 @@ int main(int argc, const char * argv[]) {
 		auto kextIndexes = generateKexts(outputCpp, kexts);
 		generateVendors(outputCpp, vendors, basePath, kextIndexes);
 		generateControllers(outputCpp, ctrls, vendors, kextIndexes);
+		
+		SYSLOG("shared %zu identical files saving %zu bytes", fileSharedNum, fileSharedBytes);
 		//generateUserPatches(outputCpp, userp, kextIndexes);
 	}
 }
@@ -0,0 +1,17 @@
+//
+//  IODeviceTreeSupport.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef IODeviceTreeSupport_h
+#define IODeviceTreeSupport_h
+
+#include <IOKit/IORegistryEntry.h>
+
+extern const IORegistryPlane *gIODTPlane;
+
+#endif /* IODeviceTreeSupport_h */
@@ -0,0 +1,137 @@
+//
+//  IORegistryEntry.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//  A single plane registry built by the checks, objects are reference counted like
+//  the libkern ones and the root entry owns the whole tree.
+//
+
+#ifndef IORegistryEntry_h
+#define IORegistryEntry_h
+
+#include <mach/mach_types.h>
+#include <libkern/OSReturn.h>
+
+#include <cstring>
+#include <vector>
+
+#define OSDynamicCast(type, inst) dynamic_cast<type *>(inst)
+
+class OSSerialize;
+
+class OSObject {
+	int refs {1};
+
+public:
+	virtual ~OSObject() {}
+
+	void retain() {
+		refs++;
+	}
+
+	void release() {
+		if (--refs == 0)
+			delete this;
+	}
+
+	virtual bool serialize(OSSerialize *) const {
+		return false;
+	}
+};
+
+class OSBoolean : public OSObject {};
+
+extern OSBoolean * const kOSBooleanTrue;
+
+class OSData : public OSObject {
+	std::vector<uint8_t> bytes;
+
+public:
+	static OSData *withBytes(const void *data, unsigned length) {
+		auto obj = new OSData;
+		obj->bytes.assign(static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + length);
+		return obj;
+	}
+
+	unsigned getLength() const {
+		return static_cast<unsigned>(bytes.size());
+	}
+
+	const void *getBytesNoCopy() const {
+		return bytes.data();
+	}
+};
+
+class OSNumber : public OSObject {
+	uint64_t value {0};
+
+public:
+	static OSNumber *withNumber(unsigned long long number, unsigned) {
+		auto obj = new OSNumber;
+		obj->value = number;
+		return obj;
+	}
+
+	unsigned long long unsigned64BitValue() const {
+		return value;
+	}
+
+	unsigned unsigned32BitValue() const {
+		return static_cast<unsigned>(value);
+	}
+};
+
+class OSIterator : public OSObject {
+	std::vector<OSObject *> objects;
+	size_t next {0};
+
+public:
+	explicit OSIterator(const std::vector<OSObject *> &objects) : objects(objects) {}
+
+	OSObject *getNextObject() {
+		return next < objects.size() ? objects[next++] : nullptr;
+	}
+};
+
+struct IORegistryPlane;
+
+extern const IORegistryPlane *gIOServicePlane;
+
+class IORegistryEntry : public OSObject {
+	const char *name;
+	std::vector<IORegistryEntry *> children;
+	std::vector<std::pair<const char *, OSObject *>> properties;
+
+public:
+	explicit IORegistryEntry(const char *name) : name(name) {}
+	~IORegistryEntry();
+
+	/**
+	 *  Registry root, the checks replace it with their own trees
+	 */
+	static IORegistryEntry *root;
+
+	/**
+	 *  Look up an entry by a path of entry names from the root
+	 *
+	 *  @return retained entry or nullptr
+	 */
+	static IORegistryEntry *fromPath(const char *path, const IORegistryPlane *plane=nullptr);
+
+	const char *getName(const IORegistryPlane *plane=nullptr) const {
+		return name;
+	}
+
+	OSObject *getProperty(const char *key) const;
+
+	bool setProperty(const char *key, OSObject *value);
+
+	bool attachToParent(IORegistryEntry *parent, const IORegistryPlane *plane);
+
+	OSIterator *getChildIterator(const IORegistryPlane *plane) const;
+};
+
+#endif /* IORegistryEntry_h */
@@ -0,0 +1,15 @@
+//
+//  LegacyIOService.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the Lilu header, only the registry part is used.
+//
+
+#ifndef LegacyIOService_h
+#define LegacyIOService_h
+
+#include <IOKit/IORegistryEntry.h>
+
+#endif /* LegacyIOService_h */
@@ -0,0 +1,240 @@
+//
+//  host.cpp
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host implementation of the kernel and Lilu services AppleALC uses.
+//  LiluAPI keeps the callback order of kern_api.cpp, KernelPatcher only does what
+//  the kext filtering needs and never loads anything.
+//
+
+#include "host.hpp"
+
+#include <Headers/kern_api.hpp>
+#include <IOKit/IODeviceTreeSupport.h>
+#include <mach/vm_map.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+bool Host::log {false};
+std::vector<const KernelPatcher::KextInfo *> Host::loaded;
+
+const int version_major {KernelVersion::Sierra};
+const int version_minor {0};
+
+vm_map_t kernel_map {nullptr};
+
+void IOLog(const char *format, ...) {
+	if (Host::log) {
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+	}
+}
+
+extern "C" void *kern_os_malloc(size_t size) {
+	return calloc(1, size);
+}
+
+extern "C" void kern_os_free(void *addr) {
+	free(addr);
+}
+
+extern "C" void *kern_os_realloc(void *addr, size_t nsize) {
+	return realloc(addr, nsize);
+}
+
+// Pages are only used by the Lilu patchers
+
+kern_return_t vm_allocate(vm_map_t, vm_address_t *, size_t, int) {
+	return KERN_FAILURE;
+}
+
+kern_return_t vm_deallocate(vm_map_t, vm_address_t, size_t) {
+	return KERN_FAILURE;
+}
+
+kern_return_t vm_protect(vm_map_t, vm_address_t, size_t, boolean_t, vm_prot_t) {
+	return KERN_FAILURE;
+}
+
+boolean_t PE_parse_boot_argn(const char *, void *, int) {
+	return false;
+}
+
+static OSBoolean booleanTrue;
+OSBoolean * const kOSBooleanTrue {&booleanTrue};
+
+struct IORegistryPlane {};
+static const IORegistryPlane servicePlane {};
+static const IORegistryPlane deviceTreePlane {};
+const IORegistryPlane *gIOServicePlane {&servicePlane};
+const IORegistryPlane *gIODTPlane {&deviceTreePlane};
+
+IORegistryEntry *IORegistryEntry::root {nullptr};
+
+IORegistryEntry::~IORegistryEntry() {
+	for (auto child : children)
+		child->release();
+	for (auto &prop : properties)
+		prop.second->release();
+}
+
+IORegistryEntry *IORegistryEntry::fromPath(const char *path, const IORegistryPlane *) {
+	auto entry = root;
+	while (entry && *path) {
+		while (*path == '/')
+			path++;
+		size_t len = strcspn(path, "/");
+		if (len == 0)
+			break;
+
+		IORegistryEntry *next {nullptr};
+		for (auto child : entry->children) {
+			if (strlen(child->name) == len && !strncmp(child->name, path, len)) {
+				next = child;
+				break;
+			}
+		}
+		entry = next;
+		path += len;
+	}
+
+	if (entry)
+		entry->retain();
+	return entry;
+}
+
+OSObject *IORegistryEntry::getProperty(const char *key) const {
+	for (auto &prop : properties) {
+		if (!strcmp(prop.first, key))
+			return prop.second;
+	}
+	return nullptr;
+}
+
+bool IORegistryEntry::setProperty(const char *key, OSObject *value) {
+	value->retain();
+	for (auto &prop : properties) {
+		if (!strcmp(prop.first, key)) {
+			prop.second->release();
+			prop.second = value;
+			return true;
+		}
+	}
+	properties.emplace_back(key, value);
+	return true;
+}
+
+bool IORegistryEntry::attachToParent(IORegistryEntry *parent, const IORegistryPlane *) {
+	retain();
+	parent->children.push_back(this);
+	return true;
+}
+
+OSIterator *IORegistryEntry::getChildIterator(const IORegistryPlane *) const {
+	return new OSIterator({children.begin(), children.end()});
+}
+
+LiluAPI lilu;
+
+void LiluAPI::deinit() {
+	// Every check starts with no registered plugins
+	patcherLoadedCallbacks.deinit();
+	kextLoadedCallbacks.deinit();
+	storedKexts.deinit();
+	apiRequestsOver = false;
+}
+
+LiluAPI::Error LiluAPI::onPatcherLoad(t_patcherLoaded callback, void *user) {
+	if (apiRequestsOver)
+		return Error::TooLate;
+
+	auto *pcall = stored_pair<t_patcherLoaded>::create();
+	if (!pcall)
+		return Error::MemoryError;
+
+	pcall->first = callback;
+	pcall->second = user;
+	if (!patcherLoadedCallbacks.push_back(pcall)) {
+		pcall->deleter(pcall);
+		return Error::MemoryError;
+	}
+
+	return Error::NoError;
+}
+
+LiluAPI::Error LiluAPI::onKextLoad(KernelPatcher::KextInfo *infos, size_t num, t_kextLoaded callback, void *user) {
+	if (apiRequestsOver)
+		return Error::TooLate;
+
+	auto *pcall = stored_pair<t_kextLoaded>::create();
+	if (!pcall)
+		return Error::MemoryError;
+
+	pcall->first = callback;
+	pcall->second = user;
+	if (!kextLoadedCallbacks.push_back(pcall)) {
+		pcall->deleter(pcall);
+		return Error::MemoryError;
+	}
+
+	auto *pkext = stored_pair<KernelPatcher::KextInfo *, size_t>::create();
+	if (!pkext)
+		return Error::MemoryError;
+
+	pkext->first = infos;
+	pkext->second = num;
+	if (!storedKexts.push_back(pkext)) {
+		pkext->deleter(pkext);
+		return Error::MemoryError;
+	}
+
+	return Error::NoError;
+}
+
+void LiluAPI::processPatcherLoadCallbacks(KernelPatcher &patcher) {
+	apiRequestsOver = true;
+
+	for (size_t i = 0; i < patcherLoadedCallbacks.size(); i++) {
+		auto p = patcherLoadedCallbacks[i];
+		p->first(p->second, patcher);
+	}
+
+	// Same condition kern_api.cpp uses before reading a kext
+	Host::loaded.clear();
+	for (size_t i = 0; i < storedKexts.size(); i++) {
+		auto stored = storedKexts[i];
+		for (size_t j = 0; j < stored->second; j++) {
+			if (stored->first[j].pathNum > 0)
+				Host::loaded.push_back(&stored->first[j]);
+		}
+	}
+}
+
+bool KernelPatcher::compatibleKernel(uint32_t min, uint32_t max) {
+	return (min == KernelAny || min <= getKernelVersion()) &&
+			(max == KernelAny || max >= getKernelVersion());
+}
+
+KernelPatcher::Error KernelPatcher::getError() {
+	return Error::NoError;
+}
+
+void KernelPatcher::clearError() {}
+
+// Kext patching is not reached by the checks
+
+mach_vm_address_t KernelPatcher::solveSymbol(size_t, const char *) {
+	return 0;
+}
+
+mach_vm_address_t KernelPatcher::routeFunction(mach_vm_address_t, mach_vm_address_t, bool, bool) {
+	return 0;
+}
+
+void KernelPatcher::applyLookupPatch(const LookupPatch *) {}
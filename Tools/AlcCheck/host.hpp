@@ -0,0 +1,32 @@
+//
+//  host.hpp
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host implementation of the kernel and Lilu services AppleALC uses.
+//
+
+#ifndef host_hpp
+#define host_hpp
+
+#include <Headers/kern_patcher.hpp>
+
+#include <vector>
+
+/**
+ *  Host environment state
+ */
+struct Host {
+	/**
+	 *  Print IOLog messages
+	 */
+	static bool log;
+
+	/**
+	 *  Kexts Lilu would read and load after the patcher load callbacks
+	 */
+	static std::vector<const KernelPatcher::KextInfo *> loaded;
+};
+
+#endif /* host_hpp */
@@ -0,0 +1,13 @@
+//
+//  OSAtomic.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef OSAtomic_h
+#define OSAtomic_h
+
+#endif /* OSAtomic_h */
@@ -0,0 +1,20 @@
+//
+//  OSReturn.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef OSReturn_h
+#define OSReturn_h
+
+#include <mach/mach_types.h>
+
+typedef kern_return_t OSReturn;
+
+#define kOSReturnSuccess KERN_SUCCESS
+#define kOSReturnError   0xdc000001
+
+#endif /* OSReturn_h */
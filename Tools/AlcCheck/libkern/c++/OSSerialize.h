@@ -0,0 +1,22 @@
+//
+//  OSSerialize.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef OSSerialize_h
+#define OSSerialize_h
+
+#include <IOKit/IORegistryEntry.h>
+
+class OSSerialize : public OSObject {
+public:
+	static OSSerialize *withCapacity(unsigned) {
+		return new OSSerialize;
+	}
+};
+
+#endif /* OSSerialize_h */
@@ -0,0 +1,16 @@
+//
+//  shared_region.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef shared_region_h
+#define shared_region_h
+
+#define SHARED_REGION_BASE_I386    0x90000000ULL
+#define SHARED_REGION_BASE_X86_64  0x00007FFF70000000ULL
+
+#endif /* shared_region_h */
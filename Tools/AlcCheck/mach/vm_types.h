@@ -0,0 +1,27 @@
+//
+//  vm_types.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef vm_types_h
+#define vm_types_h
+
+#include <mach/mach_types.h>
+
+typedef uintptr_t vm_offset_t;
+typedef uintptr_t vm_size_t;
+typedef uint64_t vm_map_offset_t;
+typedef uint64_t vm_map_address_t;
+typedef uint64_t mach_vm_offset_t;
+typedef uint64_t mach_vm_size_t;
+typedef uint64_t memory_object_offset_t;
+typedef uint64_t memory_object_size_t;
+typedef struct memory_object *memory_object_t;
+typedef struct memory_object_control *memory_object_control_t;
+typedef struct task *task_t;
+
+#endif /* vm_types_h */
@@ -0,0 +1,198 @@
+//
+//  main.cpp
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host checks of the kexts AppleALC lets Lilu load for the detected hardware.
+//  Every case builds an IORegistry, registers AppleALC and runs the patcher load
+//  callbacks with the real resources, then compares the kexts Lilu would read.
+//
+
+#include "host.hpp"
+
+#include <Headers/kern_api.hpp>
+#include <IOKit/IODeviceTreeSupport.h>
+
+#include "../../AppleALC/kern_alc.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ *  Report a failed expectation and return false from the enclosing function
+ */
+#define CHECK(x) do { if (!(x)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); return false; } } while (0)
+
+/**
+ *  PCI device below AppleACPIPCI, zero platform and layout leave the properties out
+ */
+struct Device {
+	const char *name;
+	uint32_t vendor;
+	uint32_t device;
+	uint32_t revision;
+	uint32_t platform;
+	uint32_t layout;
+};
+
+/**
+ *  Registry contents and the kexts expected to be loaded
+ */
+struct Case {
+	const char *name;
+	const char *compatible;
+	bool pci;
+	std::vector<Device> devices;
+	std::vector<const char *> kexts;
+};
+
+static const char *HDAController {"com.apple.driver.AppleHDAController"};
+static const char *AppleHDA {"com.apple.driver.AppleHDA"};
+static const char *Azul {"com.apple.driver.AppleIntelFramebufferAzul"};
+static const char *KBL {"com.apple.driver.AppleIntelKBLGraphicsFramebuffer"};
+static const char *SKL {"com.apple.driver.AppleIntelSKLGraphicsFramebuffer"};
+
+static const std::vector<const char *> AllKexts {
+	HDAController, Azul, AppleHDA, KBL,
+	"com.apple.driver.AppleIntelBDWGraphicsFramebuffer",
+	"com.apple.driver.AppleIntelFramebufferCapri",
+	SKL
+};
+
+static const Case cases[] {
+	{"haswell desktop", "iMac14,2", true, {
+		{"IGPU", 0x8086, 0x0412, 0x06, 0x0d220003, 0},
+		{"HDAU", 0x8086, 0x0C0C, 0x00, 0, 0},
+		{"HDEF", 0x8086, 0x8C20, 0x05, 0, 1}
+	}, {HDAController, Azul, AppleHDA}},
+	// HD4600 HDMI is only patched for desktops
+	{"haswell laptop", "MacBookPro11,1", true, {
+		{"IGPU", 0x8086, 0x0412, 0x06, 0x0d220003, 0}
+	}, {}},
+	{"unmatched platform", "MacBookPro13,1", true, {
+		{"IGPU", 0x8086, 0x191B, 0x06, 0x19120000, 0}
+	}, {}},
+	{"skylake laptop", "MacBookPro13,1", true, {
+		{"IGPU", 0x8086, 0x191B, 0x06, 0x191b0000, 0},
+		{"HDEF", 0x8086, 0xA170, 0x31, 0, 3}
+	}, {AppleHDA, SKL}},
+	{"kaby lake desktop", "iMac18,3", true, {
+		{"IGPU", 0x8086, 0x5912, 0x04, 0x59120000, 0},
+		{"HDEF", 0x8086, 0xA2F0, 0x00, 0, 1}
+	}, {HDAController, AppleHDA, KBL}},
+	// Z97 controller patches are for 10.9 only, codecs still need AppleHDA
+	{"incompatible kernel", "iMac15,1", true, {
+		{"HDEF", 0x8086, 0x0024, 0x00, 0, 1}
+	}, {AppleHDA}},
+	// Unusable controllers leave the detection to the first kext load
+	{"missing layout-id", "iMac14,2", true, {
+		{"HDEF", 0x8086, 0x8C20, 0x05, 0, 0}
+	}, AllKexts},
+	{"missing registry", "iMac14,2", false, {}, AllKexts},
+};
+
+/**
+ *  Create a registry entry attached to its parent, which owns it
+ */
+static IORegistryEntry *attach(IORegistryEntry *parent, const char *name) {
+	auto entry = new IORegistryEntry(name);
+	entry->attachToParent(parent, gIOServicePlane);
+	entry->release();
+	return entry;
+}
+
+static void setData(IORegistryEntry *entry, const char *key, const void *value, unsigned size) {
+	auto data = OSData::withBytes(value, size);
+	entry->setProperty(key, data);
+	data->release();
+}
+
+static void setData(IORegistryEntry *entry, const char *key, uint32_t value) {
+	setData(entry, key, &value, sizeof(value));
+}
+
+/**
+ *  Replace the registry with the one of a case
+ */
+static void buildRegistry(const Case &c) {
+	IORegistryEntry::root = new IORegistryEntry("Root");
+	setData(IORegistryEntry::root, "compatible", c.compatible, static_cast<unsigned>(strlen(c.compatible) + 1));
+
+	auto expert = attach(IORegistryEntry::root, "AppleACPIPlatformExpert");
+	if (!c.pci)
+		return;
+
+	auto pci = attach(attach(expert, "PCI0@0"), "AppleACPIPCI");
+	for (auto &d : c.devices) {
+		auto entry = attach(pci, d.name);
+		setData(entry, "vendor-id", d.vendor);
+		setData(entry, "device-id", d.device);
+		setData(entry, "revision-id", d.revision);
+		if (d.platform)
+			setData(entry, "AAPL,ig-platform-id", d.platform);
+		if (d.layout)
+			setData(entry, "layout-id", d.layout);
+	}
+}
+
+/**
+ *  Run the patcher load callbacks of AppleALC on the registry of a case
+ */
+static bool runCase(const Case &c, const std::vector<size_t> &pathNums) {
+	for (size_t k = 0; k < ADDPR(kextListSize); k++)
+		ADDPR(kextList)[k].pathNum = pathNums[k];
+	buildRegistry(c);
+
+	AlcEnabler alc;
+	KernelPatcher patcher;
+	bool registered = alc.init();
+	if (registered)
+		lilu.processPatcherLoadCallbacks(patcher);
+
+	alc.deinit();
+	lilu.deinit();
+	IORegistryEntry::root->release();
+	IORegistryEntry::root = nullptr;
+	CHECK(registered);
+
+	bool same = Host::loaded.size() == c.kexts.size();
+	for (size_t k = 0; same && k < c.kexts.size(); k++)
+		same = !strcmp(Host::loaded[k]->id, c.kexts[k]);
+	if (!same) {
+		fprintf(stderr, "%s: loaded", c.name);
+		for (auto kext : Host::loaded)
+			fprintf(stderr, " %s", kext->id);
+		fprintf(stderr, "\n");
+	}
+	CHECK(same);
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-v")) {
+			Host::log = true;
+			ADDPR(debugEnabled) = true;
+		} else {
+			fprintf(stderr, "Usage: %s [-v]\n  -v  print kernel log messages\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<size_t> pathNums;
+	for (size_t k = 0; k < ADDPR(kextListSize); k++)
+		pathNums.push_back(ADDPR(kextList)[k].pathNum);
+
+	bool ok {true};
+	for (auto &c : cases) {
+		bool passed = runCase(c, pathNums);
+		printf("%s: %s\n", c.name, passed ? "ok" : "FAILED");
+		ok &= passed;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
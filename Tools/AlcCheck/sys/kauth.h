@@ -0,0 +1,19 @@
+//
+//  kauth.h
+//  AlcCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef kauth_h
+#define kauth_h
+
+#include <sys/kernel_types.h>
+#include <sys/param.h>
+
+typedef struct kauth_listener *kauth_listener_t;
+typedef int kauth_action_t;
+
+#endif /* kauth_h */
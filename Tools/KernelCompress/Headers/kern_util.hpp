@@ -0,0 +1,69 @@
+//
+//  kern_util.hpp
+//  KernelCompress
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for Lilu kern_util.hpp providing just enough
+//  to compile kern_compression.cpp without the kernel SDK.
+//
+
+#ifndef kern_util_hpp
+#define kern_util_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define xStringify(a) Stringify(a)
+#define Stringify(a) #a
+
+#define PRODUCT_NAME Lilu
+
+/**
+ *  Kernel log output, disabled by tests expecting failures
+ */
+extern bool syslogEnabled;
+
+#define SYSLOG(str, ...) do { if (syslogEnabled) fprintf(stderr, xStringify(PRODUCT_NAME) ": " str "\n", ## __VA_ARGS__); } while (0)
+#define DBGLOG(str, ...) do { } while(0)
+
+#define EXPORT
+
+/**
+ *  Allocation statistics of Buffer functions, lets one measure peak memory use
+ */
+struct BufferStats {
+	size_t current;
+	size_t peak;
+};
+
+BufferStats &bufferStats();
+
+namespace Buffer {
+	template <typename T>
+	T *create(size_t size) {
+		auto buf = static_cast<size_t *>(malloc(sizeof(size_t) * 2 + size * sizeof(T)));
+		if (!buf)
+			return nullptr;
+		buf[0] = size * sizeof(T);
+		auto &stats = bufferStats();
+		stats.current += buf[0];
+		if (stats.current > stats.peak)
+			stats.peak = stats.current;
+		return reinterpret_cast<T *>(buf + 2);
+	}
+	
+	template <typename T>
+	void deleter(T *buf) {
+		if (buf) {
+			auto base = reinterpret_cast<size_t *>(buf) - 2;
+			bufferStats().current -= base[0];
+			free(base);
+		}
+	}
+}
+
+#endif /* kern_util_hpp */
@@ -0,0 +1,26 @@
+//
+//  clock.h
+//  KernelCompress
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel uptime functions used by kern_compression.cpp.
+//
+
+#ifndef kern_clock_h
+#define kern_clock_h
+
+#include <stdint.h>
+#include <time.h>
+
+static inline void clock_get_uptime(uint64_t *result) {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*result = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result) {
+	*result = abstime;
+}
+
+#endif /* kern_clock_h */
@@ -0,0 +1,1019 @@
+//
+//  main.cpp
+//  KernelCompress
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host compressed kernel generator and decoder benchmark, builds on any host with a C++11 compiler.
+//  Writes CompressedHeader files understood by MachInfo, and measures every kern_compression.cpp
+//  decoding mode on a generated corpus.
+//
+
+#include <Headers/kern_compression.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+BufferStats &bufferStats() {
+	static BufferStats stats {};
+	return stats;
+}
+
+bool syslogEnabled {true};
+
+/**
+ *  Report a failed expectation and return false from the enclosing function
+ */
+#define CHECK(x) do { if (!(x)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); return false; } } while (0)
+
+/**
+ *  Output format limits
+ */
+namespace Lzss {
+	static constexpr size_t N {4096};      // ring buffer size
+	static constexpr size_t F {18};        // maximum match length
+	static constexpr size_t Threshold {2}; // longest match encoded as literals
+}
+
+namespace Lzvn {
+	static constexpr size_t MaxDistance {0xFFFF};
+	static constexpr size_t MaxLiterals {271};
+	static constexpr size_t MaxMatch {271};
+}
+
+/**
+ *  Hash chain match finder shared by both compressors
+ */
+class MatchFinder {
+	static constexpr size_t HashBits {16};
+	static constexpr size_t MaxAttempts {32};
+	const uint8_t *data;
+	size_t size;
+	size_t window;
+	std::vector<int64_t> head;
+	std::vector<int64_t> chain;
+
+	static uint32_t hash(const uint8_t *p) {
+		return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761U) >> (32 - HashBits);
+	}
+
+public:
+	MatchFinder(const uint8_t *data, size_t size, size_t window) :
+	data(data), size(size), window(window), head(1 << HashBits, -1), chain(window + 1, -1) {}
+
+	/**
+	 *  Register the position and find the longest match for it
+	 *
+	 *  @param pos      current position, positions must be inserted in order
+	 *  @param maxLen   maximum match length, 0 to only register the position
+	 *  @param distance found match distance
+	 *
+	 *  @return found match length, 0 if none
+	 */
+	size_t insert(size_t pos, size_t maxLen, size_t &distance) {
+		if (size - pos < 3)
+			return 0;
+
+		uint32_t h = hash(data + pos);
+		int64_t cand = head[h];
+		chain[pos % (window + 1)] = cand;
+		head[h] = pos;
+		if (maxLen == 0)
+			return 0;
+
+		size_t best {0};
+		size_t limit = size - pos < maxLen ? size - pos : maxLen;
+		for (size_t attempt = 0; cand >= 0 && pos - cand <= window && attempt < MaxAttempts; attempt++) {
+			size_t len {0};
+			while (len < limit && data[cand + len] == data[pos + len])
+				len++;
+			if (len > best) {
+				best = len;
+				distance = pos - cand;
+				if (len == limit)
+					break;
+			}
+			int64_t next = chain[cand % (window + 1)];
+			if (next >= cand)
+				break;
+			cand = next;
+		}
+
+		return best;
+	}
+};
+
+/**
+ *  Compress with the kext_tools LZSS flavour
+ */
+static std::vector<uint8_t> compressLzss(const uint8_t *data, size_t size) {
+	using namespace Lzss;
+	std::vector<uint8_t> out;
+	out.reserve(size / 2 + 16);
+	// Leave one byte so that the ring buffer slot about to be written is never referenced
+	MatchFinder finder(data, size, N - F - 1);
+
+	size_t pos {0};
+	while (pos < size) {
+		size_t flagPos = out.size();
+		uint8_t flags {0};
+		out.push_back(0);
+
+		for (size_t bit = 0; bit < 8 && pos < size; bit++) {
+			size_t distance {0};
+			size_t len = finder.insert(pos, F, distance);
+			if (len > Threshold) {
+				size_t ring = (N - F + pos - distance) & (N - 1);
+				out.push_back(ring & 0xFF);
+				out.push_back(((ring >> 4) & 0xF0) | (len - Threshold - 1));
+				for (size_t i = 1; i < len; i++)
+					finder.insert(pos + i, 0, distance);
+				pos += len;
+			} else {
+				flags |= 1 << bit;
+				out.push_back(data[pos++]);
+			}
+		}
+
+		out[flagPos] = flags;
+	}
+
+	return out;
+}
+
+/**
+ *  LZVN stream writer
+ */
+class LzvnWriter {
+	std::vector<uint8_t> &out;
+	size_t previous {0};
+
+public:
+	explicit LzvnWriter(std::vector<uint8_t> &out) : out(out) {}
+
+	void literals(const uint8_t *src, size_t num) {
+		while (num > 0) {
+			size_t n = num < Lzvn::MaxLiterals ? num : Lzvn::MaxLiterals;
+			if (n < 16) {
+				out.push_back(0xE0 | n);
+			} else {
+				out.push_back(0xE0);
+				out.push_back(n - 16);
+			}
+			out.insert(out.end(), src, src + n);
+			src += n;
+			num -= n;
+		}
+	}
+
+	void previousMatch(size_t len) {
+		while (len > 0) {
+			size_t n = len < Lzvn::MaxMatch ? len : Lzvn::MaxMatch;
+			if (n < 16) {
+				out.push_back(0xF0 | n);
+			} else {
+				out.push_back(0xF0);
+				out.push_back(n - 16);
+			}
+			len -= n;
+		}
+	}
+
+	void match(const uint8_t *src, size_t num, size_t len, size_t distance) {
+		// Distance opcodes carry up to 3 literals
+		if (num > 3) {
+			literals(src, num & ~static_cast<size_t>(3));
+			src += num & ~static_cast<size_t>(3);
+			num &= 3;
+		}
+
+		if (distance == previous && num == 0) {
+			previousMatch(len);
+			return;
+		}
+
+		// Longer matches collide with med_d, sml_l and sml_m opcodes
+		size_t maxSmall = 10 - 2 * num, n;
+		if (distance == previous) {
+			n = len < maxSmall ? len : maxSmall;
+			out.push_back(num << 6 | (n - 3) << 3 | 6);
+		} else if (distance < 0x600 && len <= maxSmall) {
+			n = len;
+			out.push_back(num << 6 | (n - 3) << 3 | distance >> 8);
+			out.push_back(distance & 0xFF);
+		} else if (distance < 0x4000) {
+			n = len < 34 ? len : 34;
+			out.push_back(0xA0 | num << 3 | (n - 3) >> 2);
+			out.push_back(((distance << 2) | ((n - 3) & 3)) & 0xFF);
+			out.push_back(distance >> 6);
+		} else {
+			n = len < maxSmall ? len : maxSmall;
+			out.push_back(num << 6 | (n - 3) << 3 | 7);
+			out.push_back(distance & 0xFF);
+			out.push_back(distance >> 8);
+		}
+
+		out.insert(out.end(), src, src + num);
+		previous = distance;
+		if (len > n)
+			previousMatch(len - n);
+	}
+
+	void end() {
+		static const uint8_t eos[8] {0x06};
+		out.insert(out.end(), eos, eos + sizeof(eos));
+	}
+};
+
+/**
+ *  Compress with LZVN
+ */
+static std::vector<uint8_t> compressLzvn(const uint8_t *data, size_t size) {
+	std::vector<uint8_t> out;
+	out.reserve(size / 2 + 16);
+	LzvnWriter writer(out);
+	MatchFinder finder(data, size, Lzvn::MaxDistance);
+
+	size_t pos {0}, literalStart {0};
+	while (pos < size) {
+		size_t distance {0};
+		size_t len = finder.insert(pos, 1024, distance);
+		if (len >= 4) {
+			writer.match(data + literalStart, pos - literalStart, len, distance);
+			for (size_t i = 1; i < len; i++)
+				finder.insert(pos + i, 0, distance);
+			pos += len;
+			literalStart = pos;
+		} else {
+			pos++;
+		}
+	}
+
+	writer.literals(data + literalStart, size - literalStart);
+	writer.end();
+	return out;
+}
+
+static uint32_t bigEndian(uint32_t value) {
+	return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+/**
+ *  Build a complete compressed file
+ */
+static std::vector<uint8_t> compressFile(uint32_t compression, const std::vector<uint8_t> &data) {
+	auto payload = compression == CompressionLZSS ? compressLzss(data.data(), data.size()) : compressLzvn(data.data(), data.size());
+
+	CompressedHeader header {};
+	header.magic = CompressedMagic;
+	header.compression = compression;
+	header.hash = bigEndian(computeAdler32(data.data(), data.size()));
+	header.decompressed = bigEndian(static_cast<uint32_t>(data.size()));
+	header.compressed = bigEndian(static_cast<uint32_t>(payload.size()));
+	header.version = bigEndian(1);
+
+	std::vector<uint8_t> file(sizeof(header) + payload.size());
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), payload.data(), payload.size());
+	return file;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+	FILE *fh = fopen(path, "rb");
+	if (!fh)
+		return false;
+	char buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fh)) > 0)
+		data.insert(data.end(), buf, buf + n);
+	bool ok = !ferror(fh);
+	fclose(fh);
+	return ok;
+}
+
+static bool writeFile(const char *path, const std::vector<uint8_t> &data) {
+	FILE *fh = fopen(path, "wb");
+	if (!fh)
+		return false;
+	bool ok = fwrite(data.data(), 1, data.size(), fh) == data.size();
+	return fclose(fh) == 0 && ok;
+}
+
+/**
+ *  Deterministic corpus generator
+ */
+class Corpus {
+	uint64_t state {0x9E3779B97F4A7C15ULL};
+
+public:
+	uint32_t next() {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return static_cast<uint32_t>(state >> 16);
+	}
+
+	std::vector<uint8_t> random(size_t size) {
+		std::vector<uint8_t> data(size);
+		for (auto &b : data)
+			b = next();
+		return data;
+	}
+
+	std::vector<uint8_t> repetitive(size_t size) {
+		std::vector<uint8_t> data(size);
+		const char pattern[] = "IOService::registerService 0000000000000000 ";
+		for (size_t i = 0; i < size; i++)
+			data[i] = pattern[i % (sizeof(pattern) - 1)];
+		for (size_t i = 0; i < size / 4096; i++)
+			data[next() % size] = next();
+		return data;
+	}
+
+	// Text, symbol table and string table sections with a mach header in front
+	std::vector<uint8_t> machLike(size_t size) {
+		static const uint8_t code[][8] {
+			{0x55, 0x48, 0x89, 0xE5, 0x41, 0x57, 0x41, 0x56}, {0x48, 0x8B, 0x05, 0x00, 0x00, 0x00, 0x00, 0x48},
+			{0xE8, 0x00, 0x00, 0x00, 0x00, 0x85, 0xC0, 0x74}, {0x48, 0x83, 0xC4, 0x08, 0x5B, 0x41, 0x5E, 0x5D},
+			{0xC3, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90}, {0x48, 0x89, 0xDF, 0x31, 0xF6, 0xE8, 0x00, 0x00}
+		};
+		static const char *words[] {
+			"__ZN9IOService", "__ZN8OSObject", "_kern_", "_vm_map_", "_mach_", "_thread_", "Dictionary",
+			"getProperty", "registerService", "allocate", "release", "16getMetaClassEv", "Ev", "EPK", "P8"
+		};
+
+		std::vector<uint8_t> data(size);
+		uint32_t header[] {0xFEEDFACF, 0x01000007, 3, 2, 8, 0x1000, 1, 0};
+		memcpy(data.data(), header, sizeof(header) < size ? sizeof(header) : size);
+
+		size_t textEnd = size / 2, symEnd = size * 3 / 4, pos = sizeof(header);
+		while (pos < textEnd) {
+			auto &insn = code[next() % (sizeof(code) / sizeof(code[0]))];
+			size_t n = next() % 8 + 1;
+			for (size_t i = 0; i < n && pos < textEnd; i++)
+				data[pos++] = i >= 3 && insn[0] == 0xE8 ? next() : insn[i];
+		}
+		for (size_t i = 0; pos < symEnd; i++) {
+			uint32_t nlist[4] {static_cast<uint32_t>(i * 23), 0x0F | (1 << 8), 0xFFFFFF80 - (next() & 0x0FFFFF00), 0xFFFFFF7F};
+			for (size_t k = 0; k < sizeof(nlist) && pos < symEnd; k++)
+				data[pos++] = reinterpret_cast<uint8_t *>(nlist)[k];
+		}
+		while (pos < size) {
+			size_t parts = next() % 3 + 2;
+			for (size_t p = 0; p < parts; p++)
+				for (const char *w = words[next() % (sizeof(words) / sizeof(words[0]))]; *w && pos < size; w++)
+					data[pos++] = *w;
+			if (pos < size)
+				data[pos++] = 0;
+		}
+
+		return data;
+	}
+};
+
+/**
+ *  decompress_lzss of kext_tools/compression.c Lilu used before decoding straight from the output buffer
+ *  The whole ring buffer starts with spaces to define back references to the slots not yet written,
+ *  kext_tools leaves the last F of them uninitialised.
+ */
+static size_t decompressLzssStock(uint8_t *dst, uint32_t dstlen, const uint8_t *src, uint32_t srclen) {
+	using namespace Lzss;
+	/* ring buffer of size N, with extra F-1 bytes to aid string comparison */
+	uint8_t text_buf[N + F - 1];
+	uint8_t *dststart = dst;
+	const uint8_t *dstend = dst + dstlen;
+	const uint8_t *srcend = src + srclen;
+	int  i, j, k, r, c;
+	unsigned int flags;
+
+	memset(text_buf, ' ', sizeof(text_buf));
+	r = N - F;
+	flags = 0;
+	for ( ; ; ) {
+		if (((flags >>= 1) & 0x100) == 0) {
+			if (src < srcend) c = *src++; else break;
+			flags = c | 0xFF00;  /* uses higher byte cleverly */
+		}   /* to count eight */
+		if (flags & 1) {
+			if (src < srcend) c = *src++; else break;
+			if (dst < dstend) *dst++ = c; else break;
+			text_buf[r++] = c;
+			r &= (N - 1);
+		} else {
+			if (src < srcend) i = *src++; else break;
+			if (src < srcend) j = *src++; else break;
+			i |= ((j & 0xF0) << 4);
+			j  =  (j & 0x0F) + Threshold;
+			for (k = 0; k <= j; k++) {
+				c = text_buf[(i + k) & (N - 1)];
+				if (dst < dstend) *dst++ = c; else break;
+				text_buf[r++] = c;
+				r &= (N - 1);
+			}
+		}
+	}
+
+	return dst - dststart;
+}
+
+/**
+ *  Byte by byte LZVN decoder written after lzvn_decode of FastCompression, with no code shared
+ *  with decompress_lzvn. Stops at the end of stream opcode or when the destination is full,
+ *  returns 0 on malformed input.
+ */
+static size_t decompressLzvnReference(uint8_t *dst, uint32_t dstlen, const uint8_t *src, uint32_t srclen) {
+	size_t s {0}, d {0}, dist {0};
+
+	while (s < srclen && d < dstlen) {
+		uint8_t op = src[s];
+		size_t lit {0}, len {0}, oplen {1};
+
+		if (op == 0x06) {
+			return d;
+		} else if (op == 0x0E || op == 0x16) {
+			s++;
+			continue;
+		} else if (op >= 0xF0) {
+			oplen = op == 0xF0 ? 2 : 1;
+		} else if (op >= 0xE0) {
+			oplen = op == 0xE0 ? 2 : 1;
+		} else if (op >= 0xD0 || (op >= 0x70 && op < 0x80) || (op < 0x40 && (op & 7) == 6)) {
+			return 0;
+		} else if (op >= 0xA0 && op < 0xC0) {
+			oplen = 3;
+		} else if ((op & 7) == 7) {
+			oplen = 3;
+		} else if ((op & 7) != 6) {
+			oplen = 2;
+		}
+
+		if (srclen - s < oplen)
+			return 0;
+		const uint8_t *b = src + s;
+		s += oplen;
+
+		if (op == 0xF0) {
+			len = b[1] + 16;
+		} else if (op > 0xF0) {
+			len = op & 0xF;
+		} else if (op == 0xE0) {
+			lit = b[1] + 16;
+		} else if (op > 0xE0) {
+			lit = op & 0xF;
+		} else if (op >= 0xA0 && op < 0xC0) {
+			lit = (op >> 3) & 3;
+			len = (((op & 7) << 2) | (b[1] & 3)) + 3;
+			dist = (b[1] >> 2) | (b[2] << 6);
+		} else {
+			lit = op >> 6;
+			len = ((op >> 3) & 7) + 3;
+			if ((op & 7) == 7)
+				dist = b[1] | (b[2] << 8);
+			else if ((op & 7) != 6)
+				dist = ((op & 7) << 8) | b[1];
+		}
+
+		if (srclen - s < lit)
+			return 0;
+		for (size_t i = 0; i < lit && d < dstlen; i++)
+			dst[d++] = src[s + i];
+		s += lit;
+		if (d == dstlen)
+			return d;
+
+		if (len > 0 && (dist == 0 || dist > d))
+			return 0;
+		for (size_t i = 0; i < len && d < dstlen; i++, d++)
+			dst[d] = dst[d - dist];
+	}
+
+	return d;
+}
+
+/**
+ *  In-memory file reader for streaming decompression
+ */
+static uint32_t memoryReader(void *user, uint8_t *buffer, uint32_t offset, uint32_t size) {
+	auto payload = static_cast<const uint8_t *>(user);
+	memcpy(buffer, payload + offset, size);
+	return size;
+}
+
+/**
+ *  Run one decoding mode and report its throughput and peak memory
+ *
+ *  @return true if the decoded data matched
+ */
+template <typename F>
+static bool measure(const char *name, size_t decoded, F decode) {
+	double best {1e9};
+	size_t peak {0};
+	bool ok {true};
+
+	for (int run = 0; run < 3 && ok; run++) {
+		bufferStats().peak = bufferStats().current;
+		size_t base = bufferStats().current;
+		auto start = std::chrono::steady_clock::now();
+		ok = decode();
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best = time < best ? time : best;
+		peak = bufferStats().peak - base;
+	}
+
+	printf("  %-24s %9.1f MB/s %9.2f MB peak  %s\n", name, decoded / best / 1e6, peak / 1e6, ok ? "ok" : "MISMATCH");
+	return ok;
+}
+
+static bool benchmark() {
+	static constexpr size_t HeaderSize {64 * 1024};
+	static constexpr size_t TailSize {1024 * 1024};
+	static constexpr size_t Sizes[] {1, 16, 64};
+
+	Corpus corpus;
+	bool ok {true};
+
+	for (size_t mb : Sizes) {
+		size_t size = mb * 1024 * 1024;
+		struct {
+			const char *name;
+			std::vector<uint8_t> data;
+		} samples[] {
+			{"random", corpus.random(size)},
+			{"repetitive", corpus.repetitive(size)},
+			{"mach", corpus.machLike(size)}
+		};
+
+		for (auto &sample : samples) {
+			auto &data = sample.data;
+			for (uint32_t compression : {CompressionLZSS, CompressionLZVN}) {
+				auto start = std::chrono::steady_clock::now();
+				auto file = compressFile(compression, data);
+				double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				auto header = reinterpret_cast<const CompressedHeader *>(file.data());
+				auto payload = file.data() + sizeof(CompressedHeader);
+				auto srclen = static_cast<uint32_t>(file.size() - sizeof(CompressedHeader));
+				auto dstlen = static_cast<uint32_t>(data.size());
+				uint32_t hash = bigEndian(header->hash);
+
+				printf("%s %zu MB %s: ratio %.3f, compressed in %.0f ms\n", sample.name, mb,
+					   compression == CompressionLZSS ? "lzss" : "lzvn", srclen / static_cast<double>(dstlen), time * 1000);
+
+				if (compression == CompressionLZSS) {
+					ok &= measure("kext_tools decoder", dstlen, [&]() {
+						auto buf = Buffer::create<uint8_t>(dstlen);
+						bool same = buf && decompressLzssStock(buf, dstlen, payload, srclen) == dstlen && !memcmp(buf, data.data(), dstlen);
+						Buffer::deleter(buf);
+						return same;
+					});
+				}
+
+				ok &= measure("decompressData", dstlen, [&]() {
+					auto buf = decompressData(compression, dstlen, const_cast<uint8_t *>(payload), srclen);
+					bool same = buf && !memcmp(buf, data.data(), dstlen);
+					Buffer::deleter(buf);
+					return same;
+				});
+
+				ok &= measure("decompressData+adler32", dstlen, [&]() {
+					auto buf = decompressData(compression, dstlen, const_cast<uint8_t *>(payload), srclen, hash);
+					bool same = buf && !memcmp(buf, data.data(), dstlen);
+					Buffer::deleter(buf);
+					return same;
+				});
+
+				std::vector<uint8_t> head(HeaderSize < dstlen ? HeaderSize : dstlen);
+				ok &= measure("decompressWindows head", head.size(), [&]() {
+					DecompressWindow window {head.data(), 0, static_cast<uint32_t>(head.size())};
+					return decompressWindows(compression, dstlen, memoryReader, const_cast<uint8_t *>(payload), srclen, &window, 1) &&
+						!memcmp(head.data(), data.data(), head.size());
+				});
+
+				std::vector<uint8_t> tail(TailSize < dstlen ? TailSize : dstlen);
+				ok &= measure("decompressWindows tail", dstlen, [&]() {
+					DecompressWindow window {tail.data(), static_cast<uint32_t>(dstlen - tail.size()), static_cast<uint32_t>(tail.size())};
+					return decompressWindows(compression, dstlen, memoryReader, const_cast<uint8_t *>(payload), srclen, &window, 1) &&
+						!memcmp(tail.data(), data.data() + dstlen - tail.size(), tail.size());
+				});
+			}
+		}
+	}
+
+	return ok;
+}
+
+/**
+ *  Reader returning at most limit bytes per call and failing at the given call
+ */
+struct ShortReader {
+	const uint8_t *payload;
+	uint32_t limit;
+	uint32_t failAt;
+	uint32_t calls;
+};
+
+static uint32_t shortReader(void *user, uint8_t *buffer, uint32_t offset, uint32_t size) {
+	auto reader = static_cast<ShortReader *>(user);
+	if (reader->calls++ == reader->failAt)
+		return 0;
+	uint32_t got = size < reader->limit ? size : reader->limit;
+	memcpy(buffer, reader->payload + offset, got);
+	return got;
+}
+
+/**
+ *  Decode random windows of a compressed sample and compare them with the original
+ */
+static bool testWindows(Corpus &corpus, uint32_t compression, const std::vector<uint8_t> &data) {
+	auto file = compressFile(compression, data);
+	auto payload = file.data() + sizeof(CompressedHeader);
+	auto srclen = static_cast<uint32_t>(file.size() - sizeof(CompressedHeader));
+	auto dstlen = static_cast<uint32_t>(data.size());
+
+	for (size_t round = 0; round < 100; round++) {
+		// Overlapping windows of any size anywhere, including empty ones and the very end
+		DecompressWindow windows[4];
+		std::vector<uint8_t> buffers[4];
+		size_t num = 1 + corpus.next() % 4;
+		for (size_t i = 0; i < num; i++) {
+			uint32_t offset = corpus.next() % (dstlen + 1);
+			uint32_t size = corpus.next() % 70000;
+			if (round % 10 == 0)
+				offset = dstlen - (size = size < dstlen ? size : dstlen);
+			else if (size > dstlen - offset)
+				size = dstlen - offset;
+			buffers[i].resize(size);
+			windows[i] = {buffers[i].data(), offset, size};
+		}
+
+		ShortReader reader {payload, 1 + corpus.next() % 100000, UINT32_MAX, 0};
+		CHECK(decompressWindows(compression, dstlen, shortReader, &reader, srclen, windows, num));
+		for (size_t i = 0; i < num; i++)
+			CHECK(windows[i].size == 0 || !memcmp(buffers[i].data(), data.data() + windows[i].offset, windows[i].size));
+	}
+
+	if (dstlen == 0)
+		return true;
+
+	// Windows out of bounds, unsupported compression, truncated input and read errors fail
+	uint8_t last;
+	DecompressWindow end {&last, dstlen - 1, 1};
+	DecompressWindow outside {&last, dstlen, 1};
+	ShortReader reader {payload, 4096, UINT32_MAX, 0};
+	// The last byte of an LZVN stream is decoded right before the end of stream opcode
+	uint32_t truncated = compression == CompressionLZVN ? srclen - 9 : srclen / 2;
+	syslogEnabled = false;
+	bool ok = !decompressWindows(compression, dstlen, shortReader, &reader, srclen, &outside, 1) &&
+		!decompressWindows(CompressedMagic, dstlen, shortReader, &reader, srclen, &end, 1) &&
+		!decompressWindows(compression, dstlen, shortReader, &reader, truncated, &end, 1);
+	reader = {payload, 4096, 1 + corpus.next() % (srclen / 4096 + 1), 0};
+	ok = ok && (reader.failAt > srclen / 4096 || !decompressWindows(compression, dstlen, shortReader, &reader, srclen, &end, 1));
+	syslogEnabled = true;
+	CHECK(ok);
+
+	reader = {payload, UINT32_MAX, UINT32_MAX, 0};
+	CHECK(decompressWindows(compression, dstlen, shortReader, &reader, srclen, &end, 1) && last == data.back());
+	return true;
+}
+
+/**
+ *  Verifying decompression accepts the stored checksum only
+ */
+static bool testVerify(const std::vector<uint8_t> &data) {
+	for (uint32_t compression : {CompressionLZSS, CompressionLZVN}) {
+		auto file = compressFile(compression, data);
+		auto header = reinterpret_cast<const CompressedHeader *>(file.data());
+		auto payload = file.data() + sizeof(CompressedHeader);
+		auto srclen = static_cast<uint32_t>(file.size() - sizeof(CompressedHeader));
+		auto dstlen = static_cast<uint32_t>(data.size());
+		uint32_t hash = bigEndian(header->hash);
+
+		auto buf = decompressData(compression, dstlen, payload, srclen, hash);
+		bool same = buf && !memcmp(buf, data.data(), dstlen);
+		Buffer::deleter(buf);
+		CHECK(same);
+
+		syslogEnabled = false;
+		buf = decompressData(compression, dstlen, payload, srclen, hash ^ 1);
+		syslogEnabled = true;
+		CHECK(!buf);
+	}
+
+	return true;
+}
+
+/**
+ *  Streaming and whole buffer decoding agree on arbitrary input
+ *  Random LZSS tokens reference ring buffer slots no byte was written to yet, random LZVN
+ *  opcodes start after a few literals to give the matches some history.
+ */
+static bool testWindowsArbitrary(Corpus &corpus, uint32_t compression) {
+	for (size_t round = 0; round < 20000; round++) {
+		auto src = corpus.random(1 + corpus.next() % 64);
+		if (compression == CompressionLZVN && round % 2)
+			src.insert(src.begin(), 0xE0 | (1 + corpus.next() % 15));
+		uint32_t dstlen = 1 + corpus.next() % 512;
+		std::vector<uint8_t> streamed(dstlen);
+		DecompressWindow window {streamed.data(), 0, dstlen};
+
+		syslogEnabled = false;
+		bool windowsOk = decompressWindows(compression, dstlen, memoryReader, src.data(), static_cast<uint32_t>(src.size()), &window, 1);
+		auto decoded = decompressData(compression, dstlen, src.data(), static_cast<uint32_t>(src.size()));
+		syslogEnabled = true;
+
+		bool same = windowsOk == (decoded != nullptr) && (!decoded || !memcmp(decoded, streamed.data(), dstlen));
+		Buffer::deleter(decoded);
+		if (!same) {
+			fprintf(stderr, "arbitrary input round %zu decodes differently\n", round);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ *  Decode with decompressData and the kext_tools decoder, which must agree
+ */
+static bool compareLzss(const std::vector<uint8_t> &src, uint32_t dstlen) {
+	std::vector<uint8_t> expected(dstlen);
+	bool expectedOk = decompressLzssStock(expected.data(), dstlen, src.data(), static_cast<uint32_t>(src.size())) == dstlen;
+
+	syslogEnabled = false;
+	auto decoded = decompressData(CompressionLZSS, dstlen, const_cast<uint8_t *>(src.data()), static_cast<uint32_t>(src.size()));
+	syslogEnabled = true;
+
+	bool same = expectedOk == (decoded != nullptr) && (!decoded || dstlen == 0 || !memcmp(decoded, expected.data(), dstlen));
+	Buffer::deleter(decoded);
+	return same;
+}
+
+/**
+ *  Fuzz decompress_lzss with mutated streams, wrong sizes and arbitrary input
+ */
+static bool testLzss(Corpus &corpus) {
+	std::vector<uint8_t> samples[] {corpus.random(64 * 1024), corpus.repetitive(64 * 1024), corpus.machLike(256 * 1024)};
+
+	for (auto &data : samples) {
+		auto payload = compressLzss(data.data(), data.size());
+		auto dstlen = static_cast<uint32_t>(data.size());
+		CHECK(compareLzss(payload, dstlen));
+
+		for (size_t round = 0; round < 300; round++) {
+			// Flip a few bytes, cut the stream and ask for a different size
+			auto src = payload;
+			for (size_t i = corpus.next() % 8; i > 0; i--)
+				src[corpus.next() % src.size()] = corpus.next();
+			if (round % 3 == 0)
+				src.resize(corpus.next() % src.size());
+			uint32_t size = round % 2 ? dstlen : corpus.next() % (dstlen + 64);
+			if (!compareLzss(src, size)) {
+				fprintf(stderr, "mutated stream round %zu decodes differently\n", round);
+				return false;
+			}
+		}
+	}
+
+	// Arbitrary input with literal or match heavy flag bytes
+	for (size_t round = 0; round < 100000; round++) {
+		auto src = corpus.random(corpus.next() % 256);
+		uint8_t bias = round % 3 == 0 ? 0x00 : round % 3 == 1 ? 0xFF : 0x5A;
+		for (size_t i = 0; i < src.size(); i += 1 + corpus.next() % 24)
+			src[i] = corpus.next() % 4 ? bias : src[i];
+		if (!compareLzss(src, corpus.next() % 2048)) {
+			fprintf(stderr, "arbitrary input round %zu decodes differently\n", round);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ *  Decode with decompressData and the reference decoder, which must agree
+ *  Buffers are sized exactly to let the address sanitizer catch any access out of them.
+ */
+static bool compareLzvn(const std::vector<uint8_t> &src, uint32_t dstlen) {
+	std::vector<uint8_t> expected(dstlen);
+	std::vector<uint8_t> input(src);
+	bool expectedOk = decompressLzvnReference(expected.data(), dstlen, src.data(), static_cast<uint32_t>(src.size())) == dstlen;
+
+	syslogEnabled = false;
+	auto decoded = decompressData(CompressionLZVN, dstlen, input.data(), static_cast<uint32_t>(input.size()));
+	syslogEnabled = true;
+
+	bool same = expectedOk == (decoded != nullptr) && (!decoded || dstlen == 0 || !memcmp(decoded, expected.data(), dstlen));
+	Buffer::deleter(decoded);
+	return same;
+}
+
+/**
+ *  Fixed LZVN stream with every opcode kind, assembled by hand after the format of lzvn_decode
+ */
+static const uint8_t LzvnVector[] {
+	0xE5, 'a', 'b', 'c', 'd', 'e', // sml_l 5 literals
+	0x88, 0x07, 'X', 'Y',          // sml_d 2 literals, match 4 at 7
+	0x46, 'Z',                     // pre_d 1 literal, match 3 at 7
+	0xF5,                          // sml_m match 5 at 7
+	0x0E,                          // nop
+	0xA4, 0x51, 0x00,              // med_d match 20 at 20
+	0xE0, 0x02, '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+	'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', // lrg_l 18 literals
+	0x3F, 0x3A, 0x00,              // lrg_d match 10 at 58
+	0xF0, 0x04,                    // lrg_m match 20 at 58
+	0xC0, 0x01, 'x', 'y', 'z',     // sml_d 3 literals, match 3 at 1
+	0xF0, 0xFF,                    // lrg_m match 271 at 1
+	0x0F, 0x23, 0x01,              // lrg_d match 4 at 0x123
+	0xA8, 0x42, 0x05, 'Q',         // med_d 1 literal, match 5 at 0x150
+	0x19, 0x65,                    // sml_d match 6 at 0x165
+	0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 // eos
+};
+
+// Literal parts of the decoded vector around its run of 275 'z' bytes
+static const std::string LzvnVectorDecoded {
+	std::string("abcdeXYabcdZXYabcdZXabcdeXYabcdZXYabcdZX0123456789ABCDEFGHabcdeXYabcdZXYabcdZXabcdeXYabcxy") +
+	std::string(275, 'z') + "cdZXQabcdZZXabcd"
+};
+
+/**
+ *  Decode the fixed vector, every truncation and corruption of LZVN streams and arbitrary input
+ *  Run under -fsanitize=address to catch reads and writes out of the buffers.
+ */
+static bool testLzvn(Corpus &corpus) {
+	std::vector<uint8_t> vector(LzvnVector, LzvnVector + sizeof(LzvnVector));
+	auto vectorSize = static_cast<uint32_t>(LzvnVectorDecoded.size());
+	auto decoded = decompressData(CompressionLZVN, vectorSize, vector.data(), static_cast<uint32_t>(vector.size()));
+	bool same = vectorSize == 381 && decoded && !memcmp(decoded, LzvnVectorDecoded.data(), vectorSize);
+	Buffer::deleter(decoded);
+	CHECK(same);
+	// A shorter destination takes the prefix, a longer one hits the end of stream
+	CHECK(compareLzvn(vector, vectorSize) && compareLzvn(vector, 100) && compareLzvn(vector, vectorSize + 1));
+
+	struct {
+		std::vector<uint8_t> data;
+		std::vector<uint8_t> payload;
+	} samples[] {
+		{std::vector<uint8_t>(LzvnVectorDecoded.begin(), LzvnVectorDecoded.end()), vector},
+		{corpus.random(4 * 1024), {}},
+		{corpus.repetitive(16 * 1024), {}},
+		{corpus.machLike(16 * 1024), {}}
+	};
+
+	for (auto &sample : samples) {
+		auto &data = sample.data;
+		auto &payload = sample.payload;
+		if (payload.empty())
+			payload = compressLzvn(data.data(), data.size());
+		auto dstlen = static_cast<uint32_t>(data.size());
+
+		// Only the end of stream opcode may be cut
+		for (size_t size = 0; size <= payload.size(); size++) {
+			std::vector<uint8_t> src(payload.begin(), payload.begin() + size);
+			syslogEnabled = false;
+			auto buf = decompressData(CompressionLZVN, dstlen, src.data(), static_cast<uint32_t>(size));
+			syslogEnabled = true;
+			bool ok = (buf != nullptr) == (size + 8 >= payload.size()) && (!buf || !memcmp(buf, data.data(), dstlen));
+			Buffer::deleter(buf);
+			if (!ok || (size % 61 == 0 && !compareLzvn(src, dstlen))) {
+				fprintf(stderr, "stream truncated to %zu bytes decodes wrongly\n", size);
+				return false;
+			}
+		}
+
+		for (size_t round = 0; round < 300; round++) {
+			// Flip a few bytes, cut the stream and ask for a different size
+			auto src = payload;
+			for (size_t i = 1 + corpus.next() % 8; i > 0; i--)
+				src[corpus.next() % src.size()] = corpus.next();
+			if (round % 3 == 0)
+				src.resize(corpus.next() % src.size());
+			uint32_t size = round % 2 ? dstlen : corpus.next() % (dstlen + 64);
+			if (!compareLzvn(src, size)) {
+				fprintf(stderr, "mutated stream round %zu decodes differently\n", round);
+				return false;
+			}
+		}
+	}
+
+	// Arbitrary input starting with literals, so that some matches are in range
+	for (size_t round = 0; round < 100000; round++) {
+		auto src = corpus.random(corpus.next() % 256);
+		if (round % 2 && !src.empty())
+			src[0] = 0xE0 | (corpus.next() % 16);
+		if (!compareLzvn(src, corpus.next() % 2048)) {
+			fprintf(stderr, "arbitrary input round %zu decodes differently\n", round);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool test() {
+	Corpus corpus;
+	bool ok {true};
+
+	struct {
+		const char *name;
+		std::vector<uint8_t> data;
+	} samples[] {
+		{"empty", {}},
+		{"byte", corpus.random(1)},
+		{"ring", corpus.repetitive(4096 + 18)},
+		{"random", corpus.random(200 * 1024)},
+		{"repetitive", corpus.repetitive(300 * 1024)},
+		{"mach", corpus.machLike(1024 * 1024)}
+	};
+
+	for (uint32_t compression : {CompressionLZSS, CompressionLZVN}) {
+		for (auto &sample : samples) {
+			bool passed = testWindows(corpus, compression, sample.data);
+			printf("decompressWindows %s %s: %s\n", compression == CompressionLZSS ? "lzss" : "lzvn", sample.name, passed ? "ok" : "FAILED");
+			ok &= passed;
+		}
+	}
+
+	bool passed = testVerify(samples[5].data);
+	printf("decompressData verification: %s\n", passed ? "ok" : "FAILED");
+	ok &= passed;
+
+	for (uint32_t compression : {CompressionLZSS, CompressionLZVN}) {
+		passed = testWindowsArbitrary(corpus, compression);
+		printf("decompressWindows %s arbitrary input: %s\n", compression == CompressionLZSS ? "lzss" : "lzvn", passed ? "ok" : "FAILED");
+		ok &= passed;
+	}
+
+	passed = testLzss(corpus);
+	printf("decompressData lzss fuzzing: %s\n", passed ? "ok" : "FAILED");
+	ok &= passed;
+
+	passed = testLzvn(corpus);
+	printf("decompressData lzvn vectors and fuzzing: %s\n", passed ? "ok" : "FAILED");
+	return ok && passed;
+}
+
+static void usage(const char *self) {
+	fprintf(stderr,
+		"Usage: %s [-lzss | -lzvn] input output\n"
+		"       %s -b | -t\n"
+		"  -lzss  compress with LZSS (default)\n"
+		"  -lzvn  compress with LZVN\n"
+		"  -b     generate a corpus and benchmark every decoding mode\n"
+		"  -t     test the decoders against the generated corpus\n",
+		self, self);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t compression {CompressionLZSS};
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-lzss")) {
+			compression = CompressionLZSS;
+		} else if (!strcmp(argv[i], "-lzvn")) {
+			compression = CompressionLZVN;
+		} else if (!strcmp(argv[i], "-b") && argc == 2) {
+			return benchmark() ? EXIT_SUCCESS : EXIT_FAILURE;
+		} else if (!strcmp(argv[i], "-t") && argc == 2) {
+			return test() ? EXIT_SUCCESS : EXIT_FAILURE;
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - i != 2) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<uint8_t> data;
+	if (!readFile(argv[i], data) || data.size() > 0xFFFFFFFF) {
+		fprintf(stderr, "%s: cannot read input\n", argv[i]);
+		return EXIT_FAILURE;
+	}
+
+	auto file = compressFile(compression, data);
+
+	// Never write what the kernel side would fail to read back
+	auto payload = file.data() + sizeof(CompressedHeader);
+	auto decoded = decompressData(compression, static_cast<uint32_t>(data.size()), payload,
+								  static_cast<uint32_t>(file.size() - sizeof(CompressedHeader)));
+	bool same = decoded && !memcmp(decoded, data.data(), data.size());
+	Buffer::deleter(decoded);
+	if (!same) {
+		fprintf(stderr, "%s: round trip verification failed\n", argv[i]);
+		return EXIT_FAILURE;
+	}
+
+	if (!writeFile(argv[i + 1], file)) {
+		fprintf(stderr, "%s: cannot write output\n", argv[i + 1]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: %zu -> %zu bytes\n", argv[i + 1], data.size(), file.size());
+	return EXIT_SUCCESS;
+}
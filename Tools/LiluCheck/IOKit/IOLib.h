@@ -0,0 +1,20 @@
+//
+//  IOLib.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef IOLib_h
+#define IOLib_h
+
+#include <libkern/libkern.h>
+#include <IOKit/IOLocks.h>
+#include <pexpert/pexpert.h>
+
+void IOLog(const char *format, ...);
+void IOSleep(unsigned milliseconds);
+
+#endif /* IOLib_h */
@@ -0,0 +1,29 @@
+//
+//  IOLocks.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef IOLocks_h
+#define IOLocks_h
+
+#include <mach/mach_types.h>
+
+typedef struct _IOLock IOLock;
+typedef struct _IOSimpleLock IOSimpleLock;
+
+#define THREAD_UNINT     0
+#define THREAD_AWAKENED  0
+#define THREAD_TIMED_OUT 1
+
+IOLock *IOLockAlloc();
+void IOLockFree(IOLock *lock);
+void IOLockLock(IOLock *lock);
+void IOLockUnlock(IOLock *lock);
+int IOLockSleep(IOLock *lock, void *event, int interType);
+void IOLockWakeup(IOLock *lock, void *event, bool oneThread);
+
+#endif /* IOLocks_h */
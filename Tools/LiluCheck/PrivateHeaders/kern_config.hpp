@@ -0,0 +1,36 @@
+//
+//  kern_config_private.hpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the private Lilu configuration, keep in sync.
+//  Only the settings the checked sources read are present, tests change them freely.
+//
+
+#ifndef kern_config_private_h
+#define kern_config_private_h
+
+#include <Headers/kern_util.hpp>
+
+class Configuration {
+public:
+	/**
+	 *  Allow decompressing compressed kernels
+	 */
+	bool allowDecompress {true};
+	
+	/**
+	 *  Verify decompressed data checksums
+	 */
+	bool verifyDecompress {false};
+	
+	/**
+	 *  Use the persistent symbol cache
+	 */
+	bool useSymbolCache {true};
+};
+
+extern Configuration config;
+
+#endif /* kern_config_private_h */
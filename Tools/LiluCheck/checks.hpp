@@ -0,0 +1,99 @@
+//
+//  checks.hpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#ifndef checks_hpp
+#define checks_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ *  Test and benchmark entry points of a Lilu area
+ */
+struct Check {
+	const char *name;
+	bool (*test)();
+	void (*bench)();
+};
+
+/**
+ *  FileIO range reading checks, fileio.cpp
+ */
+bool testFileIO();
+void benchFileIO();
+
+/**
+ *  MachInfo __LINKEDIT reading checks, linkedit.cpp
+ */
+bool testLinkedit();
+void benchLinkedit();
+
+/**
+ *  Lookup patch checks, lookup.cpp
+ */
+bool testLookup();
+void benchLookup();
+
+/**
+ *  Byte pattern search checks, pattern.cpp
+ */
+bool testPattern();
+void benchPattern();
+
+/**
+ *  Persistent symbol cache checks, symcache.cpp
+ */
+bool testSymcache();
+void benchSymcache();
+
+/**
+ *  MachInfo symbol solving checks, symbols.cpp
+ */
+bool testSymbols();
+void benchSymbols();
+
+/**
+ *  Initialisation work queue checks, workqueue.cpp
+ */
+bool testWorkQueue();
+void benchWorkQueue();
+
+/**
+ *  Report a failed expectation and return false from the enclosing function
+ */
+#define CHECK(x) do { if (!(x)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); return false; } } while (0)
+
+/**
+ *  Deterministic random generator, results must not depend on the host
+ */
+class Random {
+	uint64_t state;
+
+public:
+	explicit Random(uint64_t seed) : state(seed ? seed : 1) {}
+
+	uint64_t next() {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	uint32_t below(uint32_t max) {
+		return static_cast<uint32_t>(next() % max);
+	}
+};
+
+/**
+ *  Microseconds elapsed since start
+ */
+inline long long elapsedUs(std::chrono::steady_clock::time_point start) {
+	return static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+#endif /* checks_hpp */
@@ -0,0 +1,235 @@
+//
+//  fileio.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  FileIO::readFileRanges against reading every range with readFileData.
+//
+
+#include "checks.hpp"
+#include "host.hpp"
+
+#include <Headers/kern_file.hpp>
+#include <sys/vnode.h>
+
+#include <algorithm>
+#include <vector>
+
+static const char *RangesPath {"/LiluCheck/ranges"};
+
+/**
+ *  Bytes readFileRanges may skip between two ranges of a read
+ */
+static constexpr size_t MaxGap {64*1024};
+
+/**
+ *  Reads readFileRanges needs: ranges in offset order, a new read at an overlap or a long gap
+ */
+static size_t expectedReads(std::vector<FileIO::Range> ranges) {
+	ranges.erase(std::remove_if(ranges.begin(), ranges.end(), [](const FileIO::Range &r) { return r.size == 0; }), ranges.end());
+	std::stable_sort(ranges.begin(), ranges.end(), [](const FileIO::Range &a, const FileIO::Range &b) { return a.offset < b.offset; });
+
+	size_t reads {0};
+	off_t end {0};
+	for (size_t i = 0; i < ranges.size(); i++) {
+		if (i == 0 || ranges[i].offset < end || static_cast<size_t>(ranges[i].offset - end) > MaxGap)
+			reads++;
+		end = ranges[i].offset + ranges[i].size;
+	}
+	return reads;
+}
+
+/**
+ *  Random ranges within the file, mostly close to each other in random order
+ */
+static void generateRanges(Random &rnd, size_t fileSize, std::vector<std::vector<uint8_t>> &buffers, std::vector<FileIO::Range> &ranges) {
+	size_t num = 1 + rnd.below(8);
+	buffers.assign(num, {});
+	ranges.clear();
+
+	off_t pos = rnd.below(static_cast<uint32_t>(fileSize));
+	for (size_t i = 0; i < num; i++) {
+		switch (rnd.below(4)) {
+			case 0:
+				// Anywhere, usually far from the previous one
+				pos = rnd.below(static_cast<uint32_t>(fileSize));
+				break;
+			case 1:
+				// Overlapping the previous one
+				pos -= std::min<off_t>(pos, rnd.below(0x100));
+				break;
+			default:
+				// After the previous one with a gap around the limit
+				pos += rnd.below(4) ? rnd.below(0x200) : MaxGap - 0x10 + rnd.below(0x20);
+				break;
+		}
+
+		pos = std::min<off_t>(pos, fileSize);
+		size_t size = std::min<size_t>(rnd.below(8) ? rnd.below(0x400) : rnd.below(0x10000), fileSize - pos);
+		buffers[i].assign(size, 0);
+		ranges.push_back({buffers[i].data(), pos, size});
+		pos += size;
+	}
+
+	for (size_t i = num; i > 1; i--)
+		std::swap(ranges[i-1], ranges[rnd.below(static_cast<uint32_t>(i))]);
+}
+
+/**
+ *  Check range contents against the file
+ */
+static bool compareRanges(const std::vector<uint8_t> &file, const std::vector<FileIO::Range> &ranges) {
+	for (auto &r : ranges)
+		CHECK(r.size == 0 || !memcmp(r.buffer, file.data() + r.offset, r.size));
+	return true;
+}
+
+/**
+ *  Random range sets are read with as few reads as the gaps and overlaps allow
+ */
+static bool testRanges(vnode_t vnode, vfs_context_t ctxt, const std::vector<uint8_t> &file) {
+	Random rnd(0x52616E67);
+	std::vector<std::vector<uint8_t>> buffers;
+	std::vector<FileIO::Range> ranges;
+
+	for (size_t round = 0; round < 5000; round++) {
+		generateRanges(rnd, file.size(), buffers, ranges);
+
+		Host::resetReads();
+		CHECK(FileIO::readFileRanges(vnode, ctxt, ranges.data(), ranges.size()) == 0);
+		CHECK(compareRanges(file, ranges));
+		if (Host::reads != expectedReads(ranges)) {
+			fprintf(stderr, "fileio: range set %zu took %zu reads instead of %zu\n", round, Host::reads, expectedReads(ranges));
+			return false;
+		}
+	}
+
+	// Two ranges just within and just over the gap limit
+	uint8_t a[16], b[16];
+	FileIO::Range within[] {{b, 0x100 + 16 + MaxGap, 16}, {a, 0x100, 16}};
+	Host::resetReads();
+	CHECK(FileIO::readFileRanges(vnode, ctxt, within, 2) == 0);
+	CHECK(Host::reads == 1 && Host::readBytes == 32 + MaxGap);
+	CHECK(compareRanges(file, {within[0], within[1]}));
+
+	FileIO::Range over[] {{a, 0x100, 16}, {b, 0x100 + 16 + MaxGap + 1, 16}};
+	Host::resetReads();
+	CHECK(FileIO::readFileRanges(vnode, ctxt, over, 2) == 0);
+	CHECK(Host::reads == 2 && Host::readBytes == 32);
+	CHECK(compareRanges(file, {over[0], over[1]}));
+
+	// Nothing to read
+	FileIO::Range empty[] {{a, 0x100, 0}, {b, 0x200, 0}};
+	Host::resetReads();
+	CHECK(FileIO::readFileRanges(vnode, ctxt, empty, 2) == 0);
+	CHECK(Host::reads == 0);
+	size_t logged = Host::logged;
+	CHECK(FileIO::readFileRanges(vnode, ctxt, nullptr, 0) == 0);
+	CHECK(Host::reads == 0 && Host::logged == logged);
+
+	// Short reads fail
+	FileIO::Range past[] {{a, static_cast<off_t>(file.size() - 8), 16}};
+	CHECK(FileIO::readFileRanges(vnode, ctxt, past, 1) != 0);
+
+	return true;
+}
+
+/**
+ *  Ranges covered by cached reads are not read again
+ */
+static bool testCache(vnode_t vnode, vfs_context_t ctxt, const std::vector<uint8_t> &file) {
+	Random rnd(0x43616368);
+	std::vector<std::vector<uint8_t>> buffers;
+	std::vector<FileIO::Range> ranges;
+
+	CHECK(FileIO::enableReadCache());
+	for (size_t round = 0; round < 200; round++) {
+		generateRanges(rnd, file.size(), buffers, ranges);
+		CHECK(FileIO::readFileRanges(vnode, ctxt, ranges.data(), ranges.size()) == 0);
+
+		for (auto &b : buffers)
+			std::fill(b.begin(), b.end(), 0);
+		Host::resetReads();
+		CHECK(FileIO::readFileRanges(vnode, ctxt, ranges.data(), ranges.size()) == 0);
+		CHECK(Host::reads == 0);
+		CHECK(compareRanges(file, ranges));
+
+		// Parts of a cached range come from the cache as well
+		auto &r = ranges.front();
+		if (r.size > 2) {
+			uint8_t part[0x10000];
+			CHECK(FileIO::readFileData(part, r.offset + 1, r.size - 2, vnode, ctxt) == 0);
+			CHECK(Host::reads == 0);
+			CHECK(!memcmp(part, file.data() + r.offset + 1, r.size - 2));
+		}
+	}
+	FileIO::disableReadCache();
+
+	// Nothing is cached once disabled
+	Host::resetReads();
+	CHECK(FileIO::readFileRanges(vnode, ctxt, ranges.data(), ranges.size()) == 0);
+	CHECK(Host::reads == expectedReads(ranges));
+
+	return true;
+}
+
+/**
+ *  Open the test file and run a check on it
+ */
+template <typename F>
+static bool withFile(size_t size, F check) {
+	Random rnd(0x46696C65 + size);
+	std::vector<uint8_t> file(size);
+	for (auto &b : file)
+		b = static_cast<uint8_t>(rnd.next());
+	Host::addFile(RangesPath, file);
+
+	vnode_t vnode = NULLVP;
+	vfs_context_t ctxt = vfs_context_create(nullptr);
+	bool ok = vnode_lookup(RangesPath, 0, &vnode, ctxt) == 0;
+	if (ok) {
+		ok = check(vnode, ctxt, file);
+		vnode_put(vnode);
+	}
+	vfs_context_rele(ctxt);
+	return ok;
+}
+
+bool testFileIO() {
+	return withFile(1024*1024, testRanges) && withFile(1024*1024, testCache);
+}
+
+void benchFileIO() {
+	for (size_t num : {4, 16, 64}) {
+		withFile(16*1024*1024, [num](vnode_t vnode, vfs_context_t ctxt, const std::vector<uint8_t> &) {
+			// Clustered tables like the ones of a __LINKEDIT segment
+			Random rnd(0x42656E63 + num);
+			std::vector<std::vector<uint8_t>> buffers(num);
+			std::vector<FileIO::Range> ranges;
+			off_t pos = rnd.below(0x100000);
+			for (size_t i = 0; i < num; i++) {
+				pos += rnd.below(4) ? rnd.below(0x1000) : 0x20000 + rnd.below(0x100000);
+				buffers[i].resize(0x100 + rnd.below(0x8000));
+				ranges.push_back({buffers[i].data(), pos, buffers[i].size()});
+				pos += buffers[i].size();
+			}
+
+			Host::resetReads();
+			auto start = std::chrono::steady_clock::now();
+			for (auto &r : ranges)
+				FileIO::readFileData(r.buffer, r.offset, r.size, vnode, ctxt);
+			auto single = elapsedUs(start);
+			size_t singleReads = Host::reads;
+
+			Host::resetReads();
+			start = std::chrono::steady_clock::now();
+			FileIO::readFileRanges(vnode, ctxt, ranges.data(), ranges.size());
+			auto ranged = elapsedUs(start);
+
+			printf("  %2zu ranges: readFileData %2zu reads %5lld us, readFileRanges %2zu reads %8zu bytes %5lld us\n",
+				   num, singleReads, single, Host::reads, Host::readBytes, ranged);
+			return true;
+		});
+	}
+}
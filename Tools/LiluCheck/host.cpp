@@ -0,0 +1,344 @@
+//
+//  host.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host implementation of the kernel services Lilu sources use.
+//
+
+#include "host.hpp"
+
+#include <Headers/kern_util.hpp>
+#include <PrivateHeaders/kern_config.hpp>
+#include <IOKit/IOLocks.h>
+#include <i386/proc_reg.h>
+#include <kern/thread.h>
+#include <kern/thread_call.h>
+#include <mach/vm_map.h>
+#include <sys/fcntl.h>
+#include <sys/vnode.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdarg.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+bool Host::log {false};
+size_t Host::logged {0};
+bool Host::readOnly {false};
+size_t Host::reads {0};
+size_t Host::readBytes {0};
+unsigned Host::readLatency {0};
+
+static std::mutex statsLock;
+
+const int version_major {KernelVersion::HighSierra};
+const int version_minor {0};
+
+vm_map_t kernel_map {nullptr};
+proc_t kernproc {reinterpret_cast<proc_t>(&kernel_map)};
+struct pmap *kernel_pmap {nullptr};
+Configuration config;
+
+void IOLog(const char *format, ...) {
+	std::lock_guard<std::mutex> guard(statsLock);
+	Host::logged++;
+	if (Host::log) {
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+	}
+}
+
+void IOSleep(unsigned milliseconds) {
+	usleep(milliseconds * 1000);
+}
+
+extern "C" void *kern_os_malloc(size_t size) {
+	// Like libkern, which fails empty allocations
+	if (size == 0)
+		return nullptr;
+	return calloc(1, size);
+}
+
+extern "C" void kern_os_free(void *addr) {
+	free(addr);
+}
+
+// Lilu buffers come from new[], libkern backs it with kern_os_malloc
+
+void *operator new[](size_t size) {
+	return kern_os_malloc(size);
+}
+
+void operator delete[](void *addr) noexcept {
+	kern_os_free(addr);
+}
+
+extern "C" void *kern_os_realloc(void *addr, size_t nsize) {
+	return realloc(addr, nsize);
+}
+
+kern_return_t vm_allocate(vm_map_t, vm_address_t *addr, size_t size, int) {
+	void *p {nullptr};
+	if (posix_memalign(&p, PAGE_SIZE, size))
+		return KERN_FAILURE;
+	*addr = reinterpret_cast<vm_address_t>(p);
+	return KERN_SUCCESS;
+}
+
+kern_return_t vm_deallocate(vm_map_t, vm_address_t addr, size_t) {
+	free(reinterpret_cast<void *>(addr));
+	return KERN_SUCCESS;
+}
+
+kern_return_t vm_protect(vm_map_t, vm_address_t, size_t, boolean_t, vm_prot_t) {
+	return KERN_SUCCESS;
+}
+
+extern "C" ppnum_t pmap_find_phys(struct pmap *, addr64_t) {
+	// Everything the tests pass is host memory
+	return 1;
+}
+
+thread_t current_thread() {
+	static thread_local char thread;
+	return reinterpret_cast<thread_t>(&thread);
+}
+
+static uintptr_t cr0 {CR0_WP};
+
+uintptr_t get_cr0() {
+	return cr0;
+}
+
+void set_cr0(uintptr_t value) {
+	cr0 = value;
+}
+
+struct _IOLock {
+	std::mutex mutex;
+	std::condition_variable wakeup;
+};
+
+IOLock *IOLockAlloc() {
+	return new IOLock;
+}
+
+void IOLockFree(IOLock *lock) {
+	delete lock;
+}
+
+void IOLockLock(IOLock *lock) {
+	lock->mutex.lock();
+}
+
+void IOLockUnlock(IOLock *lock) {
+	lock->mutex.unlock();
+}
+
+int IOLockSleep(IOLock *lock, void *, int) {
+	// Sleepers recheck their condition, so waking up every one of them is fine
+	std::unique_lock<std::mutex> guard(lock->mutex, std::adopt_lock);
+	lock->wakeup.wait(guard);
+	guard.release();
+	return THREAD_AWAKENED;
+}
+
+void IOLockWakeup(IOLock *lock, void *, bool) {
+	lock->wakeup.notify_all();
+}
+
+struct thread_call {
+	thread_call_func_t func;
+	thread_call_param_t param;
+};
+
+thread_call_t thread_call_allocate(thread_call_func_t func, thread_call_param_t param0) {
+	return new thread_call {func, param0};
+}
+
+boolean_t thread_call_enter(thread_call_t call) {
+	// Every call gets its own thread, the kernel pool would run at most as many as there are CPUs
+	std::thread([call]() {
+		call->func(call->param, nullptr);
+	}).detach();
+	return false;
+}
+
+boolean_t thread_call_free(thread_call_t call) {
+	delete call;
+	return true;
+}
+
+/**
+ *  In-memory file, vnodes stay valid until the files are removed
+ */
+struct vnode {
+	std::vector<uint8_t> data;
+	uint32_t vid;
+};
+
+static std::map<std::string, std::unique_ptr<vnode>> files;
+static uint32_t lastVid {0};
+static std::mutex filesLock;
+
+void Host::addFile(const char *path, const std::vector<uint8_t> &data) {
+	std::lock_guard<std::mutex> guard(filesLock);
+	auto &file = files[path];
+	if (!file)
+		file.reset(new vnode);
+	file->data = data;
+	file->vid = ++lastVid;
+}
+
+bool Host::getFile(const char *path, std::vector<uint8_t> &data) {
+	std::lock_guard<std::mutex> guard(filesLock);
+	auto file = files.find(path);
+	if (file == files.end())
+		return false;
+	data = file->second->data;
+	return true;
+}
+
+void Host::removeFiles() {
+	std::lock_guard<std::mutex> guard(filesLock);
+	files.clear();
+}
+
+void Host::resetReads() {
+	std::lock_guard<std::mutex> guard(statsLock);
+	reads = readBytes = 0;
+}
+
+errno_t vnode_lookup(const char *path, int, vnode_t *vpp, vfs_context_t) {
+	std::lock_guard<std::mutex> guard(filesLock);
+	auto file = files.find(path);
+	if (file == files.end())
+		return ENOENT;
+	*vpp = file->second.get();
+	return 0;
+}
+
+errno_t vnode_open(const char *path, int fmode, int, int, vnode_t *vpp, vfs_context_t ctx) {
+	if (Host::readOnly && (fmode & FWRITE))
+		return EROFS;
+	if (vnode_lookup(path, 0, vpp, ctx) == 0) {
+		if (fmode & O_TRUNC)
+			(*vpp)->data.clear();
+		return 0;
+	}
+	if (!(fmode & O_CREAT))
+		return ENOENT;
+	Host::addFile(path, {});
+	return vnode_lookup(path, 0, vpp, ctx);
+}
+
+errno_t vnode_close(vnode_t, int, vfs_context_t) {
+	return 0;
+}
+
+int vnode_put(vnode_t) {
+	return 0;
+}
+
+int vnode_getattr(vnode_t vp, vnode_attr *vap, vfs_context_t) {
+	vap->va_data_size = vp->data.size();
+	vap->va_active = vap->va_wanted;
+	return 0;
+}
+
+uint32_t vnode_vid(vnode_t vp) {
+	return vp->vid;
+}
+
+mount_t vnode_mount(vnode_t vp) {
+	return reinterpret_cast<mount_t>(&files);
+}
+
+int vfs_isrdonly(mount_t) {
+	return Host::readOnly;
+}
+
+vfs_context_t vfs_context_create(vfs_context_t) {
+	return reinterpret_cast<vfs_context_t>(&files);
+}
+
+int vfs_context_rele(vfs_context_t) {
+	return 0;
+}
+
+vfs_context_t vfs_context_current() {
+	return reinterpret_cast<vfs_context_t>(&files);
+}
+
+kauth_cred_t vfs_context_ucred(vfs_context_t) {
+	return reinterpret_cast<kauth_cred_t>(&files);
+}
+
+struct uio {
+	off_t offset;
+	int direction;
+	std::vector<std::pair<user_addr_t, user_size_t>> iovs;
+	user_size_t resid;
+};
+
+uio_t uio_create(int, off_t offset, int, int iodirection) {
+	return new uio {offset, iodirection, {}, 0};
+}
+
+int uio_addiov(uio_t uio, user_addr_t baseaddr, user_size_t length) {
+	uio->iovs.emplace_back(baseaddr, length);
+	uio->resid += length;
+	return 0;
+}
+
+user_size_t uio_resid(uio_t uio) {
+	return uio->resid;
+}
+
+void uio_free(uio_t uio) {
+	delete uio;
+}
+
+int VNOP_READ(vnode_t vp, uio_t uio, int, vfs_context_t) {
+	if (Host::readLatency)
+		usleep(Host::readLatency);
+
+	size_t bytes {0};
+	for (auto &iov : uio->iovs) {
+		if (uio->offset < 0 || static_cast<size_t>(uio->offset) >= vp->data.size())
+			break;
+		size_t size = std::min<size_t>(iov.second, vp->data.size() - uio->offset);
+		memcpy(reinterpret_cast<void *>(iov.first), vp->data.data() + uio->offset, size);
+		uio->offset += size;
+		uio->resid -= size;
+		bytes += size;
+		if (size < iov.second)
+			break;
+	}
+
+	std::lock_guard<std::mutex> guard(statsLock);
+	Host::reads++;
+	Host::readBytes += bytes;
+	return 0;
+}
+
+int VNOP_WRITE(vnode_t vp, uio_t uio, int, vfs_context_t) {
+	if (Host::readOnly)
+		return EROFS;
+	for (auto &iov : uio->iovs) {
+		if (vp->data.size() < uio->offset + iov.second)
+			vp->data.resize(uio->offset + iov.second);
+		memcpy(vp->data.data() + uio->offset, reinterpret_cast<const void *>(iov.first), iov.second);
+		uio->offset += iov.second;
+		uio->resid -= iov.second;
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+//
+//  host.hpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host implementation of the kernel services Lilu sources use.
+//
+
+#ifndef host_hpp
+#define host_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ *  Host environment state and statistics
+ */
+struct Host {
+	/**
+	 *  Print IOLog messages, off by default to keep the expected failures quiet
+	 */
+	static bool log;
+
+	/**
+	 *  Number of IOLog messages since the start
+	 */
+	static size_t logged;
+
+	/**
+	 *  Add or replace a file of the in-memory file system the vnode functions use
+	 *
+	 *  @param path full file path
+	 *  @param data file contents
+	 */
+	static void addFile(const char *path, const std::vector<uint8_t> &data);
+
+	/**
+	 *  Read a file of the in-memory file system
+	 *
+	 *  @param path full file path
+	 *  @param data file contents
+	 *
+	 *  @return true if the file exists
+	 */
+	static bool getFile(const char *path, std::vector<uint8_t> &data);
+
+	/**
+	 *  Remove every file of the in-memory file system
+	 */
+	static void removeFiles();
+
+	/**
+	 *  Report the volume as mounted read-only
+	 */
+	static bool readOnly;
+
+	/**
+	 *  VNOP_READ calls and bytes they returned since the last reset, updated under a lock
+	 *  for the reads of work queue jobs
+	 */
+	static size_t reads;
+	static size_t readBytes;
+
+	/**
+	 *  Microseconds every VNOP_READ call sleeps for, models cold storage
+	 */
+	static unsigned readLatency;
+
+	/**
+	 *  Reset the read statistics
+	 */
+	static void resetReads();
+};
+
+#endif /* host_hpp */
@@ -0,0 +1,22 @@
+//
+//  proc_reg.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//  Control registers are emulated, the code writing them must not run on the host.
+//
+
+#ifndef proc_reg_h
+#define proc_reg_h
+
+#include <stdint.h>
+
+#define CR0_WP 0x00010000
+#define EFL_IF 0x00000200
+
+uintptr_t get_cr0();
+void set_cr0(uintptr_t value);
+
+#endif /* proc_reg_h */
@@ -0,0 +1,17 @@
+//
+//  thread.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef thread_h
+#define thread_h
+
+#include <mach/mach_types.h>
+
+thread_t current_thread();
+
+#endif /* thread_h */
@@ -0,0 +1,23 @@
+//
+//  thread_call.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef thread_call_h
+#define thread_call_h
+
+#include <mach/mach_types.h>
+
+typedef struct thread_call *thread_call_t;
+typedef void *thread_call_param_t;
+typedef void (*thread_call_func_t)(thread_call_param_t param0, thread_call_param_t param1);
+
+thread_call_t thread_call_allocate(thread_call_func_t func, thread_call_param_t param0);
+boolean_t thread_call_enter(thread_call_t call);
+boolean_t thread_call_free(thread_call_t call);
+
+#endif /* thread_call_h */
@@ -0,0 +1,27 @@
+//
+//  libkern.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef libkern_h
+#define libkern_h
+
+#include <mach/mach_types.h>
+
+#include <cstring>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lilu declares its own overloads clashing with the C++ library ones
+#define strstr lilu_strstr
+#define strrchr lilu_strrchr
+
+#define _OSSwapInt32(x) __builtin_bswap32(x)
+
+#endif /* libkern_h */
@@ -0,0 +1,268 @@
+//
+//  linkedit.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  MachInfo __LINKEDIT reads against reading it at init.
+//
+
+#include "checks.hpp"
+#include "host.hpp"
+#include "macho.hpp"
+
+#include <Headers/kern_compression.hpp>
+#include <Headers/kern_mach.hpp>
+#include <PrivateHeaders/kern_config.hpp>
+
+#include <algorithm>
+
+/**
+ *  Read statistics of a MachInfo step
+ */
+struct ReadStats {
+	size_t reads;
+	size_t bytes;
+	long long us;
+};
+
+/**
+ *  Init reads the header only, __LINKEDIT is read once at the first lookup
+ */
+static bool testLazy() {
+	MachLayout layout;
+	layout.linkeditSuffix = 0x10000;
+	auto image = buildMach(generateSymbols(0x4C617A79, 5000), layout);
+
+	Host::resetReads();
+	Kext kext(image);
+	CHECK(kext);
+	CHECK(Host::reads == 1 && Host::readBytes <= MachInfo::HeaderSize);
+
+	// Lookup patched kexts never need the tables
+	Host::resetReads();
+	CHECK(kext->compactSymbols() == 0);
+	CHECK(kext->setRunningAddresses(Slide) == KERN_SUCCESS);
+	CHECK(Host::reads == 0);
+
+	auto &first = image.symbols.front().name;
+	CHECK(kext->solveSymbol(first.c_str()) == solveLinear(image, first.c_str(), Slide));
+	CHECK(Host::reads > 0 && Host::readBytes >= image.symtabSize);
+
+	Host::resetReads();
+	for (auto &s : image.symbols)
+		CHECK(kext->solveSymbol(s.name.c_str()) == solveLinear(image, s.name.c_str(), Slide));
+	CHECK(kext->solveSymbol("_missing") == 0);
+	CHECK(Host::reads == 0);
+
+	return true;
+}
+
+/**
+ *  A failed __LINKEDIT read is not retried at every lookup
+ */
+static bool testMissingFile() {
+	auto image = buildMach(generateSymbols(0x4D697373, 100));
+	Kext kext(image);
+	CHECK(kext);
+
+	Host::removeFiles();
+	Host::resetReads();
+	auto name = image.symbols.front().name.c_str();
+	CHECK(kext->solveSymbol(name) == 0);
+	CHECK(kext->solveSymbol(name) == 0);
+	CHECK(Host::reads == 0);
+
+	return true;
+}
+
+/**
+ *  Only the symbol and string tables are read whatever else __LINKEDIT holds
+ */
+static bool testRanges() {
+	auto symbols = generateSymbols(0x52616E67, 3000);
+
+	for (size_t prefix : {0, 0x1000, 0x30000}) {
+		for (size_t gap : {0, 0x100, 0x20000}) {
+			for (size_t suffix : {0, 0x40000}) {
+				MachLayout layout;
+				layout.linkeditPrefix = prefix;
+				layout.tableGap = gap;
+				layout.linkeditSuffix = suffix;
+				auto image = buildMach(symbols, layout);
+				CHECK(image.linkeditSize == image.symtabSize + prefix + gap + suffix);
+
+				Kext kext(image);
+				CHECK(kext);
+				Host::resetReads();
+				for (auto &s : image.symbols)
+					CHECK(kext->solveSymbol(s.name.c_str()) == solveLinear(image, s.name.c_str(), Slide));
+
+				// Gaps small enough to be read through are the only extra bytes besides the header check,
+				// both tables come with a single read then
+				CHECK(Host::readBytes == MachInfo::HeaderSize + image.symtabSize + (gap <= 0x10000 ? gap : 0));
+				CHECK(Host::reads == 1 + (gap <= 0x10000 ? 1 : 2));
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ *  Wrap a binary into a compressed file of literal only LZSS or LZVN data
+ */
+static std::vector<uint8_t> storeCompressed(const std::vector<uint8_t> &data, uint32_t hash, uint32_t compression = CompressionLZSS) {
+	std::vector<uint8_t> file(sizeof(CompressedHeader));
+	if (compression == CompressionLZSS) {
+		for (size_t i = 0; i < data.size(); i += 8) {
+			file.push_back(0xFF);
+			file.insert(file.end(), data.begin() + i, data.begin() + std::min<size_t>(i + 8, data.size()));
+		}
+	} else {
+		// Large literal opcodes of up to 271 bytes and the end of stream opcode
+		for (size_t i = 0; i < data.size(); i += 271) {
+			size_t num = std::min<size_t>(271, data.size() - i);
+			file.push_back(0xE0);
+			file.push_back(num - 16);
+			file.insert(file.end(), data.begin() + i, data.begin() + i + num);
+		}
+		file.insert(file.end(), {0x06, 0, 0, 0, 0, 0, 0, 0});
+	}
+
+	CompressedHeader header {};
+	header.magic = CompressedMagic;
+	header.compression = compression;
+	header.hash = __builtin_bswap32(hash);
+	header.decompressed = __builtin_bswap32(static_cast<uint32_t>(data.size()));
+	header.compressed = __builtin_bswap32(static_cast<uint32_t>(file.size() - sizeof(header)));
+	header.version = __builtin_bswap32(1);
+	memcpy(file.data(), &header, sizeof(header));
+	return file;
+}
+
+/**
+ *  Compressed binaries are streamed unless their checksum has to be verified
+ */
+static bool testCompressed() {
+	auto image = buildMach(generateSymbols(0x5A697070, 3000));
+	uint32_t hash = computeAdler32(image.file.data(), image.file.size());
+	bool verify = config.verifyDecompress;
+
+	for (uint32_t compression : {CompressionLZSS, CompressionLZVN}) {
+		for (bool verifying : {false, true}) {
+			for (bool corrupt : {false, true}) {
+				config.verifyDecompress = verifying;
+				MachImage compressed = image;
+				compressed.file = storeCompressed(image.file, corrupt ? hash ^ 1 : hash, compression);
+
+				Host::resetReads();
+				Kext kext(compressed);
+				// Only the whole binary decompressed for verification has its checksum checked
+				CHECK(static_cast<bool>(kext) == !(verifying && corrupt));
+				CHECK(Host::readBytes >= compressed.file.size() - sizeof(CompressedHeader) || !verifying);
+				CHECK(Host::readBytes < compressed.file.size() / 2 || verifying);
+
+				for (size_t i = 0; kext && i < image.symbols.size(); i += 7) {
+					auto name = image.symbols[i].name.c_str();
+					CHECK(kext->solveSymbol(name) == solveLinear(image, name, Slide));
+				}
+			}
+		}
+	}
+
+	config.verifyDecompress = verify;
+
+	// Low memory flag disables streaming as well
+	MachImage compressed = image;
+	compressed.file = storeCompressed(image.file, hash);
+	config.allowDecompress = false;
+	Host::resetReads();
+	bool loaded = static_cast<bool>(Kext(compressed));
+	config.allowDecompress = true;
+	CHECK(!loaded && Host::readBytes <= MachInfo::HeaderSize);
+
+	return true;
+}
+
+/**
+ *  Tables are not read from a file replaced between init and the first lookup
+ */
+static bool testReplaced() {
+	auto symbols = generateSymbols(0x52706C63, 1000);
+	auto image = buildMach(symbols);
+	auto &name = image.symbols.front().name;
+
+	MachLayout otherUuid;
+	otherUuid.uuid[15] ^= 1;
+	MachLayout otherTables;
+	otherTables.linkeditPrefix = 0x100;
+
+	const std::vector<uint8_t> replacements[] {
+		image.file,
+		buildMach(symbols, otherUuid).file,
+		buildMach(symbols, otherTables).file,
+		std::vector<uint8_t>(image.file.size()),
+		storeCompressed(image.file, computeAdler32(image.file.data(), image.file.size()))
+	};
+
+	for (bool compressed : {false, true}) {
+		MachImage read = image;
+		if (compressed)
+			read.file = storeCompressed(image.file, computeAdler32(image.file.data(), image.file.size()));
+
+		// Rewriting the same binary is fine
+		{
+			Kext kext(read);
+			CHECK(kext);
+			Host::addFile(KextPath, read.file);
+			CHECK(kext->solveSymbol(name.c_str()) == solveLinear(image, name.c_str(), Slide));
+		}
+
+		for (auto &replacement : replacements) {
+			if (replacement == read.file)
+				continue;
+			Kext kext(read);
+			CHECK(kext);
+			Host::addFile(KextPath, replacement);
+			CHECK(kext->solveSymbol(name.c_str()) == 0);
+		}
+	}
+
+	return true;
+}
+
+bool testLinkedit() {
+	return testLazy() && testMissingFile() && testRanges() && testCompressed() && testReplaced();
+}
+
+/**
+ *  Measure init and the first lookup of a kext
+ */
+static void measure(const MachImage &image, ReadStats &init, ReadStats &lookup) {
+	// Init time would be mostly the copy into the in-memory file system
+	Host::resetReads();
+	Kext kext(image);
+	init = {Host::reads, Host::readBytes, 0};
+
+	Host::resetReads();
+	auto start = std::chrono::steady_clock::now();
+	if (kext)
+		kext->solveSymbol(image.symbols.front().name.c_str());
+	lookup = {Host::reads, Host::readBytes, elapsedUs(start)};
+}
+
+void benchLinkedit() {
+	for (size_t num : {1000, 10000, 100000}) {
+		// Code signature and other __LINKEDIT contents about the size of the symbol tables
+		auto symbols = generateSymbols(0x42656E63 + num, num);
+		MachLayout layout;
+		layout.linkeditSuffix = num * 48;
+		auto image = buildMach(symbols, layout);
+
+		ReadStats init, lookup;
+		measure(image, init, lookup);
+		printf("  %6zu symbols, %8zu byte __LINKEDIT: init %zu reads %5zu bytes, first lookup %zu reads %8zu bytes %5lld us\n",
+			   num, image.linkeditSize, init.reads, init.bytes, lookup.reads, lookup.bytes, lookup.us);
+	}
+}
@@ -0,0 +1,315 @@
+//
+//  lookup.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  KernelPatcher::applyLookupPatches against the applyLookupPatch loop it replaces.
+//
+
+#include "checks.hpp"
+
+#include <Headers/kern_util.hpp>
+#include <PrivateHeaders/kern_lookup.hpp>
+
+#include <memory>
+#include <vector>
+
+/**
+ *  Lookup patch without the kext reference
+ */
+struct Patch {
+	const uint8_t *find;
+	const uint8_t *replace;
+	size_t size;
+	size_t count;
+};
+
+/**
+ *  Patch set with its storage
+ */
+struct PatchSet {
+	std::vector<std::vector<uint8_t>> bytes;
+	std::vector<Patch> patches;
+
+	void add(const std::vector<uint8_t> &find, const std::vector<uint8_t> &replace, size_t count) {
+		bytes.push_back(find);
+		bytes.push_back(replace);
+		patches.push_back({nullptr, nullptr, find.size(), count});
+	}
+
+	void bind() {
+		for (size_t p = 0; p < patches.size(); p++) {
+			patches[p].find = bytes[p * 2].data();
+			patches[p].replace = bytes[p * 2 + 1].data();
+		}
+	}
+};
+
+/**
+ *  The loop of KernelPatcher::applyLookupPatch
+ */
+static size_t applySequential(const Patch &patch, uint8_t *off, size_t size) {
+	size_t curr {0};
+	size_t changes {0};
+	while ((changes < patch.count || patch.count == 0) && findPattern(patch.find, patch.size, off, size, curr)) {
+		for (size_t j = 0; j < patch.size; j++)
+			off[curr + j] = patch.replace[j];
+		curr += patch.size;
+		changes++;
+	}
+	return changes;
+}
+
+/**
+ *  The loop of KernelPatcher::applyLookupPatch before the lookup rework, benchmarks only
+ */
+static size_t applyByteLoop(const Patch &patch, uint8_t *off, size_t size) {
+	uint8_t *curr = off;
+	off += size - patch.size;
+	size_t changes {0};
+	for (size_t i = 0; curr < off && (i < patch.count || patch.count == 0); i++) {
+		while (curr < off && memcmp(curr, patch.find, patch.size))
+			curr++;
+		if (curr != off) {
+			for (size_t j = 0; j < patch.size; j++)
+				curr[j] = patch.replace[j];
+			changes++;
+		}
+	}
+	return changes;
+}
+
+/**
+ *  Apply the patches in a single pass without looking at their interactions
+ */
+static void applyPass(const Patch *patches, size_t num, uint8_t *off, size_t size, size_t *changes) {
+	std::unique_ptr<uint8_t[]> storage(new uint8_t[LookupAutomaton::storageSize(patches, num)]);
+	LookupAutomaton automaton;
+	automaton.init(patches, num, storage.get());
+	automaton.replaceAll(patches, num, off, size, changes, [&](size_t p, size_t start) {
+		for (size_t j = 0; j < patches[p].size; j++)
+			off[start + j] = patches[p].replace[j];
+	});
+}
+
+/**
+ *  The split of KernelPatcher::applyLookupPatches
+ */
+static size_t applyBatched(const Patch *patches, size_t num, uint8_t *off, size_t size, size_t *changes) {
+	std::unique_ptr<bool[]> conflicts(new bool[num]);
+	size_t conflictNum = LookupAutomaton::findConflicts(patches, num, conflicts.get());
+
+	std::vector<Patch> independent;
+	for (size_t p = 0; p < num; p++) {
+		if (!conflicts[p])
+			independent.push_back(patches[p]);
+	}
+
+	if (!independent.empty()) {
+		std::vector<size_t> independentChanges(independent.size());
+		applyPass(independent.data(), independent.size(), off, size, independentChanges.data());
+		for (size_t p = 0, i = 0; p < num; p++) {
+			if (!conflicts[p])
+				changes[p] = independentChanges[i++];
+		}
+	}
+
+	for (size_t p = 0; p < num; p++) {
+		if (conflicts[p])
+			changes[p] = applySequential(patches[p], off, size);
+	}
+
+	return conflictNum;
+}
+
+/**
+ *  Compare both ways of patching on a copy of the image
+ *
+ *  @param set       patches to apply
+ *  @param image     original contents
+ *  @param conflicts number of sequentially applied patches, updated
+ *  @param unsafe    whether a single pass alone would differ, updated
+ *
+ *  @return true if the results are the same
+ */
+static bool compare(const PatchSet &set, const std::vector<uint8_t> &image, size_t &conflicts, bool &unsafe) {
+	auto num = set.patches.size();
+	std::vector<uint8_t> expected(image), batched(image), single(image);
+	std::vector<size_t> expectedChanges(num), batchedChanges(num), singleChanges(num);
+
+	for (size_t p = 0; p < num; p++)
+		expectedChanges[p] = applySequential(set.patches[p], expected.data(), expected.size());
+
+	conflicts = applyBatched(set.patches.data(), num, batched.data(), batched.size(), batchedChanges.data());
+	CHECK(batched == expected);
+	CHECK(batchedChanges == expectedChanges);
+
+	applyPass(set.patches.data(), num, single.data(), single.size(), singleChanges.data());
+	unsafe = single != expected || singleChanges != expectedChanges;
+	// Without interactions a single pass must be enough
+	CHECK(conflicts > 0 || !unsafe);
+
+	return true;
+}
+
+static std::vector<uint8_t> bytes(const char *str) {
+	return std::vector<uint8_t>(str, str + strlen(str));
+}
+
+/**
+ *  Hand written sets known to differ from a single pass
+ */
+static bool testKnownSets() {
+	auto image = bytes("xxabcdxxabcdxxbcdexx");
+	size_t conflicts;
+	bool unsafe;
+
+	// Chained replacements: a second patch looks for what the first one wrote
+	PatchSet chain;
+	chain.add(bytes("abcd"), bytes("ABCD"), 0);
+	chain.add(bytes("ABCD"), bytes("1234"), 1);
+	chain.bind();
+	CHECK(compare(chain, image, conflicts, unsafe));
+	CHECK(conflicts == 2 && unsafe);
+
+	// Overlapping finds: the later patch loses its match to the earlier one
+	PatchSet overlap;
+	overlap.add(bytes("bcde"), bytes("BCDE"), 0);
+	overlap.add(bytes("xbcd"), bytes("XBCD"), 0);
+	overlap.bind();
+	CHECK(compare(overlap, image, conflicts, unsafe));
+	CHECK(conflicts == 2 && unsafe);
+
+	// A replacement creating a match across its border
+	PatchSet border;
+	border.add(bytes("dxxb"), bytes("dxxa"), 0);
+	border.add(bytes("xxab"), bytes("yyab"), 0);
+	border.bind();
+	CHECK(compare(border, image, conflicts, unsafe));
+	CHECK(conflicts == 2);
+
+	// Unrelated patches stay in a single pass next to the interacting ones
+	PatchSet independent;
+	independent.add(bytes("abcd"), bytes("ABCD"), 1);
+	independent.add(bytes("bcde"), bytes("1234"), 0);
+	independent.add(bytes("zzzz"), bytes("0000"), 1);
+	independent.bind();
+	CHECK(compare(independent, image, conflicts, unsafe));
+	CHECK(conflicts == 2);
+
+	PatchSet distinct;
+	distinct.add(bytes("abc"), bytes("ABC"), 0);
+	distinct.add(bytes("dex"), bytes("DEX"), 1);
+	distinct.bind();
+	CHECK(compare(distinct, image, conflicts, unsafe));
+	CHECK(conflicts == 0 && !unsafe);
+
+	return true;
+}
+
+/**
+ *  Random sets over tiny alphabets, so that patterns chain and overlap a lot
+ */
+static bool testRandomSets() {
+	Random rnd(0x4C696C75);
+	size_t unsafeSets {0}, conflictSets {0};
+	constexpr size_t Rounds {20000};
+
+	for (size_t round = 0; round < Rounds; round++) {
+		uint32_t alphabet = 2 + rnd.below(3);
+		std::vector<uint8_t> image(64 + rnd.below(512));
+		for (auto &b : image)
+			b = 'a' + rnd.below(alphabet);
+
+		PatchSet set;
+		size_t num = 1 + rnd.below(6);
+		for (size_t p = 0; p < num; p++) {
+			std::vector<uint8_t> find(1 + rnd.below(5));
+			// Take the patterns from the image to get matches
+			size_t start = rnd.below(static_cast<uint32_t>(image.size() - find.size()));
+			for (size_t i = 0; i < find.size(); i++)
+				find[i] = rnd.below(4) ? image[start + i] : 'a' + rnd.below(alphabet);
+			// Sometimes look for what an earlier patch writes
+			if (p > 0 && rnd.below(4) == 0)
+				find = set.bytes[(p - 1) * 2 + 1];
+			std::vector<uint8_t> replace(find.size());
+			for (auto &b : replace)
+				b = 'a' + rnd.below(alphabet + 1);
+			set.add(find, replace, rnd.below(4));
+		}
+		set.bind();
+
+		size_t conflicts;
+		bool unsafe;
+		if (!compare(set, image, conflicts, unsafe)) {
+			fprintf(stderr, "lookup: random set %zu differs\n", round);
+			return false;
+		}
+		unsafeSets += unsafe;
+		conflictSets += conflicts > 0;
+	}
+
+	printf("  %zu random sets, %zu with sequential patches, %zu would break in a single pass\n", Rounds, conflictSets, unsafeSets);
+	// Make sure the sets do exercise the fallback
+	CHECK(unsafeSets > 0);
+
+	return true;
+}
+
+bool testLookup() {
+	return testKnownSets() && testRandomSets();
+}
+
+void benchLookup() {
+	Random rnd(0x42656E63);
+	constexpr size_t Repeat {5};
+
+	for (size_t size : {1u << 20, 8u << 20, 32u << 20}) {
+		std::vector<uint8_t> image(size);
+		for (auto &b : image)
+			b = static_cast<uint8_t>(rnd.next());
+
+		for (size_t num : {4, 16, 64}) {
+			// Unique patches with a single match each, like AppleALC kext patches
+			PatchSet set;
+			for (size_t p = 0; p < num; p++) {
+				std::vector<uint8_t> find(8 + rnd.below(24)), replace(find.size());
+				for (size_t i = 0; i < find.size(); i++) {
+					find[i] = static_cast<uint8_t>(rnd.next());
+					replace[i] = static_cast<uint8_t>(rnd.next());
+				}
+				memcpy(image.data() + rnd.below(static_cast<uint32_t>(size - find.size())), find.data(), find.size());
+				set.add(find, replace, 1);
+			}
+			set.bind();
+
+			std::vector<size_t> changes(num);
+			long long old {0}, sequential {0}, batched {0};
+			for (size_t r = 0; r < Repeat; r++) {
+				std::vector<uint8_t> copy(image);
+				auto start = std::chrono::steady_clock::now();
+				for (auto &patch : set.patches)
+					applyByteLoop(patch, copy.data(), copy.size());
+				old += elapsedUs(start);
+
+				copy = image;
+				start = std::chrono::steady_clock::now();
+				for (auto &patch : set.patches)
+					applySequential(patch, copy.data(), copy.size());
+				sequential += elapsedUs(start);
+
+				copy = image;
+				start = std::chrono::steady_clock::now();
+				applyBatched(set.patches.data(), num, copy.data(), copy.size(), changes.data());
+				batched += elapsedUs(start);
+			}
+
+			old /= Repeat;
+			sequential /= Repeat;
+			batched /= Repeat;
+			printf("  %2zu MB, %2zu patches: byte loop %8lld us, findPattern loop %8lld us, single pass %8lld us\n",
+				   size >> 20, num, old, sequential, batched);
+		}
+	}
+}
@@ -0,0 +1,31 @@
+//
+//  fat.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the Mach-O header, keep in sync.
+//
+
+#ifndef fat_h
+#define fat_h
+
+#include <mach/mach_types.h>
+
+#define FAT_MAGIC 0xcafebabe
+#define FAT_CIGAM 0xbebafeca
+
+struct fat_header {
+	uint32_t magic;
+	uint32_t nfat_arch;
+};
+
+struct fat_arch {
+	cpu_type_t cputype;
+	int32_t cpusubtype;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t align;
+};
+
+#endif /* fat_h */
@@ -0,0 +1,34 @@
+//
+//  nlist.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the Mach-O header, keep in sync.
+//
+
+#ifndef nlist_h
+#define nlist_h
+
+#include <stdint.h>
+
+struct nlist_64 {
+	union {
+		uint32_t n_strx;
+	} n_un;
+	uint8_t n_type;
+	uint8_t n_sect;
+	uint16_t n_desc;
+	uint64_t n_value;
+};
+
+#define N_STAB 0xe0
+#define N_PEXT 0x10
+#define N_TYPE 0x0e
+#define N_EXT  0x01
+
+#define N_UNDF 0x0
+#define N_ABS  0x2
+#define N_SECT 0xe
+
+#endif /* nlist_h */
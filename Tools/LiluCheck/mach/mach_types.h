@@ -0,0 +1,39 @@
+//
+//  mach_types.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel mach types Lilu uses, keep in sync.
+//
+
+#ifndef mach_types_h
+#define mach_types_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int kern_return_t;
+typedef int errno_t;
+typedef int boolean_t;
+typedef int cpu_type_t;
+typedef uint64_t mach_vm_address_t;
+typedef uintptr_t vm_address_t;
+typedef uint64_t addr64_t;
+typedef uint32_t ppnum_t;
+typedef struct vm_map *vm_map_t;
+typedef struct proc *proc_t;
+typedef struct thread *thread_t;
+
+#define KERN_SUCCESS 0
+#define KERN_FAILURE 5
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define CPU_TYPE_X86_64 0x01000007
+
+#endif /* mach_types_h */
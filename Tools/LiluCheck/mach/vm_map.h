@@ -0,0 +1,22 @@
+//
+//  vm_map.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef vm_map_h
+#define vm_map_h
+
+#include <mach/vm_param.h>
+#include <mach/vm_prot.h>
+
+#define VM_FLAGS_ANYWHERE 1
+
+kern_return_t vm_allocate(vm_map_t map, vm_address_t *addr, size_t size, int flags);
+kern_return_t vm_deallocate(vm_map_t map, vm_address_t addr, size_t size);
+kern_return_t vm_protect(vm_map_t map, vm_address_t addr, size_t size, boolean_t setMax, vm_prot_t prot);
+
+#endif /* vm_map_h */
@@ -0,0 +1,21 @@
+//
+//  vm_param.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef vm_param_h
+#define vm_param_h
+
+#include <mach/mach_types.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define PAGE_SIZE_64 4096ULL
+#define PAGE_MASK_64 (PAGE_SIZE_64 - 1)
+#define trunc_page_64(x) ((x) & ~PAGE_MASK_64)
+
+#endif /* vm_param_h */
@@ -0,0 +1,22 @@
+//
+//  vm_prot.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef vm_prot_h
+#define vm_prot_h
+
+#include <mach/mach_types.h>
+
+typedef int vm_prot_t;
+
+#define VM_PROT_NONE    0x00
+#define VM_PROT_READ    0x01
+#define VM_PROT_WRITE   0x02
+#define VM_PROT_EXECUTE 0x04
+
+#endif /* vm_prot_h */
@@ -0,0 +1,174 @@
+//
+//  macho.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Synthetic Mach-O binaries for the MachInfo checks.
+//
+
+#include "macho.hpp"
+#include "checks.hpp"
+#include "host.hpp"
+
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#include <cstring>
+
+MachImage buildMach(const std::vector<MachSymbol> &symbols, const MachLayout &layout) {
+	MachImage image;
+
+	// Symbol tables are grouped like the linker does
+	auto local = [](const MachSymbol &s) { return !(s.type & N_EXT) || (s.type & N_STAB); };
+	auto undefined = [](const MachSymbol &s) { return (s.type & N_EXT) && !(s.type & N_STAB) && (s.type & N_TYPE) == N_UNDF; };
+	uint32_t localNum {0}, extdefNum {0};
+	for (auto &s : symbols) if (local(s)) { image.symbols.push_back(s); localNum++; }
+	for (auto &s : symbols) if (!local(s) && !undefined(s)) { image.symbols.push_back(s); extdefNum++; }
+	for (auto &s : symbols) if (undefined(s)) image.symbols.push_back(s);
+
+	std::vector<nlist_64> nlists;
+	std::vector<uint8_t> strings {' ', '\0'};
+	for (auto &s : image.symbols) {
+		nlist_64 n {};
+		n.n_un.n_strx = static_cast<uint32_t>(strings.size());
+		n.n_type = s.type;
+		n.n_sect = (s.type & N_TYPE) == N_SECT ? 1 : 0;
+		n.n_value = s.value;
+		nlists.push_back(n);
+		strings.insert(strings.end(), s.name.begin(), s.name.end());
+		strings.push_back('\0');
+	}
+	while (strings.size() % 8)
+		strings.push_back('\0');
+
+	size_t symbolSize = nlists.size() * sizeof(nlist_64);
+	size_t linkeditOff = layout.textSize;
+	size_t symoff = linkeditOff + layout.linkeditPrefix;
+	size_t stroff = symoff + symbolSize + layout.tableGap;
+	image.symoff = symoff;
+	image.stroff = stroff;
+	image.symtabSize = symbolSize + strings.size();
+	image.linkeditSize = stroff + strings.size() + layout.linkeditSuffix - linkeditOff;
+	image.file.assign(linkeditOff + image.linkeditSize, 0);
+
+	// Recognisable filler for the parts that should never be read
+	for (size_t i = linkeditOff; i < image.file.size(); i++)
+		image.file[i] = 0xA5;
+	memcpy(image.file.data() + symoff, nlists.data(), symbolSize);
+	memcpy(image.file.data() + stroff, strings.data(), strings.size());
+
+	mach_header_64 mh {};
+	mh.magic = MH_MAGIC_64;
+	mh.cputype = CPU_TYPE_X86_64;
+	mh.filetype = MH_KEXT_BUNDLE;
+
+	std::vector<uint8_t> cmds;
+	auto add = [&](const void *cmd, size_t size) {
+		cmds.insert(cmds.end(), static_cast<const uint8_t *>(cmd), static_cast<const uint8_t *>(cmd) + size);
+		mh.ncmds++;
+	};
+
+	segment_command_64 text {};
+	text.cmd = LC_SEGMENT_64;
+	text.cmdsize = sizeof(text);
+	strncpy(text.segname, "__TEXT", sizeof(text.segname));
+	text.vmaddr = layout.textAddr;
+	text.vmsize = layout.textSize;
+	text.filesize = layout.textSize;
+	text.maxprot = text.initprot = VM_PROT_READ | VM_PROT_EXECUTE;
+	add(&text, sizeof(text));
+
+	segment_command_64 linkedit {};
+	linkedit.cmd = LC_SEGMENT_64;
+	linkedit.cmdsize = sizeof(linkedit);
+	strncpy(linkedit.segname, "__LINKEDIT", sizeof(linkedit.segname));
+	linkedit.vmaddr = layout.textAddr + layout.textSize;
+	linkedit.vmsize = image.linkeditSize;
+	linkedit.fileoff = linkeditOff;
+	linkedit.filesize = image.linkeditSize;
+	linkedit.maxprot = linkedit.initprot = VM_PROT_READ;
+	add(&linkedit, sizeof(linkedit));
+
+	symtab_command symtab {};
+	symtab.cmd = LC_SYMTAB;
+	symtab.cmdsize = sizeof(symtab);
+	symtab.symoff = static_cast<uint32_t>(symoff);
+	symtab.nsyms = static_cast<uint32_t>(nlists.size());
+	symtab.stroff = static_cast<uint32_t>(stroff);
+	symtab.strsize = static_cast<uint32_t>(strings.size());
+	add(&symtab, sizeof(symtab));
+
+	dysymtab_command dysymtab {};
+	dysymtab.cmd = LC_DYSYMTAB;
+	dysymtab.cmdsize = sizeof(dysymtab);
+	dysymtab.ilocalsym = 0;
+	dysymtab.nlocalsym = localNum;
+	dysymtab.iextdefsym = localNum;
+	dysymtab.nextdefsym = extdefNum;
+	dysymtab.iundefsym = localNum + extdefNum;
+	dysymtab.nundefsym = static_cast<uint32_t>(nlists.size()) - localNum - extdefNum;
+	add(&dysymtab, sizeof(dysymtab));
+
+	uuid_command uuid {};
+	uuid.cmd = LC_UUID;
+	uuid.cmdsize = sizeof(uuid);
+	memcpy(uuid.uuid, layout.uuid, sizeof(uuid.uuid));
+	add(&uuid, sizeof(uuid));
+
+	mh.sizeofcmds = static_cast<uint32_t>(cmds.size());
+	memcpy(image.file.data(), &mh, sizeof(mh));
+	memcpy(image.file.data() + sizeof(mh), cmds.data(), cmds.size());
+
+	return image;
+}
+
+std::vector<MachSymbol> generateSymbols(uint64_t seed, size_t num) {
+	static const char * const classes[] {"IOService", "OSObject", "AppleHDAController", "IOAudioEngine", "IOPCIDevice", "OSMetaClass"};
+	static const char * const methods[] {"start", "probe", "init", "free", "getProperty", "setProperty", "message", "newUserClient"};
+	Random rnd(seed);
+	std::vector<MachSymbol> symbols;
+
+	for (size_t i = 0; i < num; i++) {
+		auto cls = classes[rnd.below(sizeof(classes) / sizeof(classes[0]))];
+		auto method = methods[rnd.below(sizeof(methods) / sizeof(methods[0]))];
+		// Unique names sharing long prefixes like C++ mangling produces
+		auto member = method + std::to_string(i);
+		auto name = "__ZN" + std::to_string(strlen(cls)) + cls + std::to_string(member.size()) + member + "EP9IOService";
+		uint8_t type = i % 10 == 0 ? N_SECT : N_SECT | N_EXT;
+		symbols.push_back({name, type, 0xFFFFFF7F80001000ULL + i * 16});
+	}
+
+	return symbols;
+}
+
+uint64_t solveLinear(const MachImage &image, const char *symbol, uint64_t slide) {
+	auto nlists = reinterpret_cast<const nlist_64 *>(image.file.data() + image.symoff);
+	auto strings = reinterpret_cast<const char *>(image.file.data() + image.stroff);
+	for (size_t i = 0; i < image.symbols.size(); i++) {
+		if (!strncmp(symbol, strings + nlists[i].n_un.n_strx, strlen(symbol) + 1))
+			return nlists[i].n_value + slide;
+	}
+	return 0;
+}
+
+const char * const KextPath {"/System/Library/Extensions/LiluCheck.kext/Contents/MacOS/LiluCheck"};
+
+Kext::Kext(const MachImage &image) {
+	Host::addFile(KextPath, image.file);
+	info = MachInfo::create(false, "LiluCheck");
+	const char * const paths[] {KextPath};
+	if (info->init(paths) != KERN_SUCCESS || info->setRunningAddresses(Slide) != KERN_SUCCESS) {
+		info->deinit();
+		MachInfo::deleter(info);
+		info = nullptr;
+	}
+}
+
+Kext::~Kext() {
+	if (info) {
+		info->deinit();
+		MachInfo::deleter(info);
+	}
+	Host::removeFiles();
+}
@@ -0,0 +1,112 @@
+//
+//  macho.hpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Synthetic Mach-O binaries for the MachInfo checks.
+//
+
+#ifndef macho_hpp
+#define macho_hpp
+
+#include <Headers/kern_mach.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ *  Symbol table entry
+ */
+struct MachSymbol {
+	std::string name;
+	uint8_t type;
+	uint64_t value;
+};
+
+/**
+ *  Binary layout
+ */
+struct MachLayout {
+	uint64_t textAddr {0xFFFFFF7F80000000ULL};
+	size_t textSize {0x4000};
+	size_t linkeditPrefix {0};  // other __LINKEDIT contents before the symbol table
+	size_t tableGap {0};        // bytes between the symbol and the string tables
+	size_t linkeditSuffix {0};  // other __LINKEDIT contents after the string table
+	uint8_t uuid[16] {0x4C, 0x69, 0x6C, 0x75, 0x43, 0x68, 0x65, 0x63, 0x6B, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+};
+
+/**
+ *  Built binary
+ */
+struct MachImage {
+	std::vector<uint8_t> file;
+	std::vector<MachSymbol> symbols;  // in symbol table order: locals, external defined, undefined
+	size_t symoff {0};                // symbol table file offset
+	size_t stroff {0};                // string table file offset
+	size_t symtabSize {0};            // symbol and string table bytes
+	size_t linkeditSize {0};          // __LINKEDIT bytes
+};
+
+/**
+ *  Build a 64-bit x86_64 kext binary with LC_SYMTAB, LC_DYSYMTAB and LC_UUID
+ *
+ *  @param symbols symbols to put into the table, grouped by kind keeping their order
+ *  @param layout  binary layout
+ *
+ *  @return binary
+ */
+MachImage buildMach(const std::vector<MachSymbol> &symbols, const MachLayout &layout=MachLayout());
+
+/**
+ *  Generate symbol names looking like mangled kernel ones
+ *
+ *  @param seed random seed
+ *  @param num  number of symbols
+ *
+ *  @return defined symbols, every tenth one is local
+ */
+std::vector<MachSymbol> generateSymbols(uint64_t seed, size_t num);
+
+/**
+ *  The symbol table walk of MachInfo::solveSymbol before the hash index
+ *
+ *  @param image  binary
+ *  @param symbol symbol name
+ *  @param slide  load slide
+ *
+ *  @return running symbol address or 0
+ */
+uint64_t solveLinear(const MachImage &image, const char *symbol, uint64_t slide);
+
+/**
+ *  Path the synthetic kext binaries are read from
+ */
+extern const char * const KextPath;
+
+/**
+ *  Load slide of the synthetic kexts
+ */
+static constexpr uint64_t Slide {0x12345000};
+
+/**
+ *  Kext MachInfo reading a synthetic binary
+ */
+class Kext {
+	MachInfo *info {nullptr};
+
+public:
+	explicit Kext(const MachImage &image);
+	~Kext();
+
+	MachInfo *operator->() {
+		return info;
+	}
+
+	explicit operator bool() const {
+		return info != nullptr;
+	}
+};
+
+#endif /* macho_hpp */
@@ -0,0 +1,85 @@
+//
+//  main.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host self tests and benchmarks for the Lilu parts, which do not need a running kernel.
+//  Every check compares the optimised code against the straightforward implementation
+//  it replaced, benchmarks report both.
+//
+
+#include "checks.hpp"
+#include "host.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+static const Check checks[] {
+	{"fileio", testFileIO, benchFileIO},
+	{"linkedit", testLinkedit, benchLinkedit},
+	{"lookup", testLookup, benchLookup},
+	{"pattern", testPattern, benchPattern},
+	{"symcache", testSymcache, benchSymcache},
+	{"symbols", testSymbols, benchSymbols},
+	{"workqueue", testWorkQueue, benchWorkQueue},
+};
+
+static void usage(const char *self) {
+	fprintf(stderr,
+		"Usage: %s [-b] [-v] [check...]\n"
+		"  -b  run benchmarks instead of tests\n"
+		"  -v  print kernel log messages\n"
+		"Checks:",
+		self);
+	for (auto &check : checks)
+		fprintf(stderr, " %s", check.name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[]) {
+	bool bench {false};
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-b")) {
+			bench = true;
+		} else if (!strcmp(argv[i], "-v")) {
+			Host::log = true;
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (int j = i; j < argc; j++) {
+		bool known {false};
+		for (auto &check : checks)
+			known |= !strcmp(check.name, argv[j]);
+		if (!known) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bool ok {true};
+	for (auto &check : checks) {
+		bool selected = i == argc;
+		for (int j = i; j < argc; j++)
+			selected |= !strcmp(check.name, argv[j]);
+		if (!selected)
+			continue;
+
+		if (bench) {
+			printf("%s:\n", check.name);
+			check.bench();
+		} else {
+			auto start = std::chrono::steady_clock::now();
+			bool passed = check.test();
+			printf("%s: %s in %lld us\n", check.name, passed ? "ok" : "FAILED", elapsedUs(start));
+			ok &= passed;
+		}
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+//
+//  pattern.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  findPattern against the memcmp loop it replaces.
+//
+
+#include "checks.hpp"
+
+#include <Headers/kern_util.hpp>
+
+#include <vector>
+
+/**
+ *  The search loop findPattern replaced
+ */
+static bool findBytes(const uint8_t *pattern, size_t patternSize, const uint8_t *data, size_t dataSize, size_t &dataOffset) {
+	if (patternSize == 0 || dataOffset > dataSize || patternSize > dataSize - dataOffset)
+		return false;
+
+	for (size_t i = dataOffset; i <= dataSize - patternSize; i++) {
+		if (!memcmp(data + i, pattern, patternSize)) {
+			dataOffset = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ *  Compare both searches over every start offset
+ */
+static bool compareAll(const uint8_t *pattern, size_t patternSize, const uint8_t *data, size_t dataSize) {
+	for (size_t start = 0; start <= dataSize + 1; start++) {
+		size_t expected = start, found = start;
+		bool expectedOk = findBytes(pattern, patternSize, data, dataSize, expected);
+		bool foundOk = findPattern(pattern, patternSize, data, dataSize, found);
+		CHECK(expectedOk == foundOk);
+		CHECK(!foundOk || found == expected);
+		CHECK(foundOk || found == start);
+	}
+	return true;
+}
+
+/**
+ *  Matches at the buffer edges and around the word boundaries
+ */
+static bool testEdges() {
+	const uint8_t pattern[] {0x48, 0x8B, 0x05, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+
+	for (size_t patternSize = 1; patternSize <= sizeof(pattern); patternSize++) {
+		for (size_t dataSize = 0; dataSize < 40; dataSize++) {
+			for (size_t at = 0; at + patternSize <= dataSize; at++) {
+				std::vector<uint8_t> data(dataSize, 0x90);
+				memcpy(data.data() + at, pattern, patternSize);
+				CHECK(compareAll(pattern, patternSize, data.data(), data.size()));
+			}
+			// No match, yet the first and the last bytes occur everywhere
+			std::vector<uint8_t> data(dataSize);
+			for (size_t i = 0; i < dataSize; i++)
+				data[i] = i % 2 ? pattern[patternSize - 1] : pattern[0];
+			CHECK(compareAll(pattern, patternSize, data.data(), data.size()));
+		}
+	}
+
+	size_t offset {0};
+	CHECK(!findPattern(pattern, 0, pattern, sizeof(pattern), offset));
+	offset = sizeof(pattern) + 1;
+	CHECK(!findPattern(pattern, 1, pattern, sizeof(pattern), offset));
+
+	return true;
+}
+
+/**
+ *  Random buffers over small alphabets to get many partial matches
+ */
+static bool testRandom() {
+	Random rnd(0x46696E64);
+
+	for (size_t round = 0; round < 3000; round++) {
+		uint32_t alphabet = 1 + rnd.below(4);
+		std::vector<uint8_t> data(rnd.below(200));
+		for (auto &b : data)
+			b = static_cast<uint8_t>(0x80 + rnd.below(alphabet));
+
+		std::vector<uint8_t> pattern(1 + rnd.below(12));
+		for (auto &b : pattern)
+			b = static_cast<uint8_t>(0x80 + rnd.below(alphabet));
+
+		if (!compareAll(pattern.data(), pattern.size(), data.data(), data.size())) {
+			fprintf(stderr, "pattern: random round %zu differs\n", round);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool testPattern() {
+	return testEdges() && testRandom();
+}
+
+/**
+ *  Count every occurrence to scan the whole buffer whatever the matches are
+ */
+template <typename F>
+static size_t countAll(F find, const std::vector<uint8_t> &pattern, const std::vector<uint8_t> &data) {
+	size_t count {0};
+	for (size_t off = 0; find(pattern.data(), pattern.size(), data.data(), data.size(), off); off++)
+		count++;
+	return count;
+}
+
+void benchPattern() {
+	Random rnd(0x42656E63);
+
+	for (size_t size : {1u << 20, 16u << 20, 64u << 20}) {
+		// Code-like data with many common opcode bytes
+		std::vector<uint8_t> data(size);
+		static const uint8_t common[] {0x48, 0x89, 0x8B, 0x00, 0xFF, 0xE8, 0x0F, 0x85, 0xC3, 0x55};
+		for (auto &b : data)
+			b = rnd.below(2) ? common[rnd.below(sizeof(common))] : static_cast<uint8_t>(rnd.next());
+
+		for (size_t patternSize : {2, 4, 8, 16, 32}) {
+			std::vector<uint8_t> pattern(patternSize);
+			for (auto &b : pattern)
+				b = common[rnd.below(sizeof(common))];
+
+			auto start = std::chrono::steady_clock::now();
+			size_t expected = countAll(findBytes, pattern, data);
+			auto memcmpUs = elapsedUs(start);
+
+			start = std::chrono::steady_clock::now();
+			size_t found = countAll([](const uint8_t *p, size_t ps, const uint8_t *d, size_t ds, size_t &off) {
+				return findPattern(p, ps, d, ds, off);
+			}, pattern, data);
+			auto fastUs = elapsedUs(start);
+
+			printf("  %2zu MB, %2zu byte pattern, %6zu matches: memcmp loop %5.2f GB/s, findPattern %5.2f GB/s%s\n",
+				   size >> 20, patternSize, found, memcmpUs ? size / 1000.0 / memcmpUs : 0.0,
+				   fastUs ? size / 1000.0 / fastUs : 0.0, found != expected ? ", results DIFFER" : "");
+		}
+	}
+}
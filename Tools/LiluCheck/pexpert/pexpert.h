@@ -0,0 +1,17 @@
+//
+//  pexpert.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef pexpert_h
+#define pexpert_h
+
+#include <mach/mach_types.h>
+
+boolean_t PE_parse_boot_argn(const char *arg_string, void *arg_ptr, int max_arg);
+
+#endif /* pexpert_h */
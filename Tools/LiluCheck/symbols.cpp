@@ -0,0 +1,368 @@
+//
+//  symbols.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  MachInfo symbol solving against the symbol table walk it replaced.
+//
+
+#include "checks.hpp"
+#include "host.hpp"
+#include "macho.hpp"
+
+#include <Headers/kern_mach.hpp>
+
+#include <mach-o/nlist.h>
+
+#include <algorithm>
+
+/**
+ *  Compare every symbol, a few missing ones and a few prefixes of existing ones
+ */
+static bool compareSolved(Kext &kext, const MachImage &image) {
+	for (auto &s : image.symbols) {
+		auto expected = solveLinear(image, s.name.c_str(), Slide);
+		CHECK(kext->solveSymbol(s.name.c_str()) == expected);
+	}
+
+	for (auto name : {"", "_", "__ZN", "_missing", "__ZN9IOService5startEP9IOService_"})
+		CHECK(kext->solveSymbol(name) == solveLinear(image, name, Slide));
+
+	return true;
+}
+
+/**
+ *  Duplicate names resolve to the first entry, undefined symbols are still found
+ */
+static bool testSymbolKinds() {
+	std::vector<MachSymbol> symbols {
+		{"_local", N_SECT, 0x1000},
+		{"_dup", N_SECT | N_EXT, 0x2000},
+		{"_dup", N_SECT | N_EXT, 0x3000},
+		{"_undef", N_UNDF | N_EXT, 0},
+		{"_abs", N_ABS | N_EXT, 0x4000},
+		{"_stab", N_STAB, 0x5000},
+	};
+
+	auto image = buildMach(symbols);
+	Kext kext(image);
+	CHECK(kext);
+	CHECK(compareSolved(kext, image));
+	CHECK(kext->solveSymbol("_dup") == 0x2000 + Slide);
+
+	return true;
+}
+
+/**
+ *  Tables of many sizes to get different index sizes and collision chains
+ */
+static bool testTables() {
+	for (size_t num : {1, 2, 3, 7, 64, 1000, 5000}) {
+		auto image = buildMach(generateSymbols(num, num));
+		Kext kext(image);
+		CHECK(kext);
+		if (!compareSolved(kext, image)) {
+			fprintf(stderr, "symbols: table of %zu symbols differs\n", num);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ *  Batches with missing and repeated names match solving the names one by one
+ */
+static bool testBatches() {
+	auto image = buildMach(generateSymbols(0x42617463, 2000));
+	Random rnd(0x68);
+
+	for (size_t round = 0; round < 200; round++) {
+		// A fresh MachInfo per round, so the first batch loads the tables and builds the index
+		Kext kext(image);
+		CHECK(kext);
+
+		for (size_t batch = 0; batch < 4; batch++) {
+			std::vector<std::string> names(1 + rnd.below(24));
+			for (auto &name : names) {
+				switch (rnd.below(4)) {
+					case 0:
+						name = "_missing" + std::to_string(rnd.below(10));
+						break;
+					case 1:
+						name = names[0];
+						break;
+					default:
+						name = image.symbols[rnd.below(static_cast<uint32_t>(image.symbols.size()))].name;
+				}
+			}
+
+			std::vector<const char *> symbols;
+			for (auto &name : names)
+				symbols.push_back(name.c_str());
+			std::vector<mach_vm_address_t> addresses(symbols.size(), 1);
+			size_t solved = kext->solveSymbols(symbols.data(), addresses.data(), symbols.size());
+
+			size_t expected {0};
+			for (size_t i = 0; i < symbols.size(); i++) {
+				CHECK(addresses[i] == solveLinear(image, symbols[i], Slide));
+				CHECK(addresses[i] == kext->solveSymbol(symbols[i]));
+				expected += addresses[i] != 0;
+			}
+			CHECK(solved == expected);
+		}
+	}
+
+	return true;
+}
+
+/**
+ *  Prefix lookup result
+ */
+struct PrefixMatch {
+	std::string name;
+	mach_vm_address_t address;
+
+	bool operator ==(const PrefixMatch &other) const {
+		return name == other.name && address == other.address;
+	}
+};
+
+/**
+ *  Prefix lookup by a walk over the whole symbol table, in name and then table order
+ */
+static std::vector<PrefixMatch> solvePrefixLinear(const MachImage &image, const std::string &prefix) {
+	std::vector<PrefixMatch> matches;
+	for (auto &s : image.symbols) {
+		if (!s.name.compare(0, prefix.size(), prefix))
+			matches.push_back({s.name, s.value + Slide});
+	}
+	std::stable_sort(matches.begin(), matches.end(), [](const PrefixMatch &a, const PrefixMatch &b) {
+		return a.name < b.name;
+	});
+	return matches;
+}
+
+/**
+ *  Prefix lookup by MachInfo stopping after limit matches
+ */
+static std::vector<PrefixMatch> solvePrefix(Kext &kext, const std::string &prefix, size_t limit, size_t &found) {
+	struct Context {
+		std::vector<PrefixMatch> matches;
+		size_t limit;
+	} context {{}, limit};
+
+	found = kext->solveSymbolsWithPrefix(prefix.c_str(), [](void *user, const char *symbol, mach_vm_address_t address) {
+		auto context = static_cast<Context *>(user);
+		context->matches.push_back({symbol, address});
+		return context->matches.size() < context->limit;
+	}, &context);
+
+	return context.matches;
+}
+
+/**
+ *  Prefix lookups in name order, stopping early, and exact lookups through the sorted index
+ */
+static bool testPrefixes() {
+	auto symbols = generateSymbols(0x50726566, 3000);
+	symbols.push_back({"__ZN9IOService5startEP9IOService", N_SECT | N_EXT, 0x7000});
+	symbols.push_back({"__ZN9IOService5startEP9IOService", N_SECT | N_EXT, 0x8000});
+	symbols.push_back({"__ZN9IOService", N_SECT | N_EXT, 0x9000});
+	auto image = buildMach(symbols);
+
+	// Exact lookups prefer the sorted index once it exists
+	Kext kext(image);
+	CHECK(kext);
+	size_t found;
+	CHECK(solvePrefix(kext, "__ZN", 1, found).size() == 1);
+	CHECK(found == 1);
+	CHECK(compareSolved(kext, image));
+	CHECK(kext->solveSymbol("__ZN9IOService5startEP9IOService") == 0x7000 + Slide);
+
+	std::vector<std::string> prefixes {"", "_", "__ZN", "__ZN9IOService", "__ZN9IOService5startEP9IOService",
+		"__ZN9IOService5startEP9IOServicf", "__ZN18AppleHDAController", "__ZN8OSObject4init1", "_missing", "~"};
+	Random rnd(0x70);
+	for (size_t i = 0; i < 50; i++) {
+		auto &name = image.symbols[rnd.below(static_cast<uint32_t>(image.symbols.size()))].name;
+		prefixes.push_back(name.substr(0, 1 + rnd.below(static_cast<uint32_t>(name.size()))));
+	}
+
+	for (auto &prefix : prefixes) {
+		auto expected = solvePrefixLinear(image, prefix);
+		CHECK(solvePrefix(kext, prefix, SIZE_MAX, found) == expected);
+		CHECK(found == expected.size());
+
+		// The handler stops the walk after the current symbol
+		if (expected.size() > 1) {
+			size_t limit = 1 + rnd.below(static_cast<uint32_t>(expected.size() - 1));
+			auto matches = solvePrefix(kext, prefix, limit, found);
+			CHECK(found == limit && matches.size() == limit);
+			CHECK(std::equal(matches.begin(), matches.end(), expected.begin()));
+		}
+	}
+
+	return true;
+}
+
+/**
+ *  Compare lookups after compaction against the table walk for the kept symbols
+ */
+template <typename F>
+static bool compareCompacted(Kext &kext, const MachImage &image, F kept) {
+	size_t keptNum {0}, keptPrefixed {0};
+	for (auto &s : image.symbols) {
+		bool keep = kept(s);
+		keptNum += keep;
+		keptPrefixed += keep && !s.name.compare(0, 4, "__ZN");
+		CHECK(kext->solveSymbol(s.name.c_str()) == (keep ? solveLinear(image, s.name.c_str(), Slide) : 0));
+	}
+
+	size_t found;
+	CHECK(solvePrefix(kext, "", SIZE_MAX, found).size() == keptNum);
+	CHECK(solvePrefix(kext, "__ZN", SIZE_MAX, found).size() == keptPrefixed);
+	return true;
+}
+
+/**
+ *  Compaction keeps every defined, external or listed symbol once __LINKEDIT is read
+ */
+static bool testCompaction() {
+	auto symbols = generateSymbols(0x436F6D70, 2000);
+	symbols.push_back({"_undef", N_UNDF | N_EXT, 0});
+	symbols.push_back({"_stab", N_STAB, 0x5000});
+	symbols.push_back({"_abs", N_ABS | N_EXT, 0x6000});
+	auto image = buildMach(symbols);
+
+	auto defined = [](const MachSymbol &s) {
+		return !(s.type & N_STAB) && (s.type & N_TYPE) != N_UNDF;
+	};
+
+	std::vector<const char *> keep {"_undef", "_stab", "_abs", "_missing"};
+	Random rnd(0x4B656570);
+	for (size_t i = 0; i < 100; i++)
+		keep.push_back(image.symbols[rnd.below(static_cast<uint32_t>(image.symbols.size()))].name.c_str());
+	auto listed = [&](const MachSymbol &s) {
+		return defined(s) && std::find(keep.begin(), keep.end(), s.name) != keep.end();
+	};
+
+	for (size_t mode = 0; mode < 3; mode++) {
+		Kext kext(image);
+		CHECK(kext);
+
+		// Nothing is read or compacted before the first lookup
+		Host::resetReads();
+		CHECK(kext->compactSymbols() == 0);
+		CHECK(Host::reads == 0);
+		CHECK(kext->solveSymbol("_abs") == 0x6000 + Slide);
+
+		if (mode == 0) {
+			CHECK(kext->compactSymbols() > 0);
+			CHECK(kext->compactSymbols(keep.data(), keep.size()) == 0);
+			CHECK(compareCompacted(kext, image, defined));
+		} else if (mode == 1) {
+			CHECK(kext->compactSymbols(nullptr, 0, true) > 0);
+			CHECK(compareCompacted(kext, image, [&](const MachSymbol &s) {
+				return defined(s) && (s.type & N_EXT);
+			}));
+		} else {
+			CHECK(kext->compactSymbols(keep.data(), keep.size()) > 0);
+			CHECK(kext->compactSymbols() == 0);
+			CHECK(compareCompacted(kext, image, listed));
+
+			// Batches see the same compact table
+			std::vector<mach_vm_address_t> addresses(keep.size());
+			size_t solved = kext->solveSymbols(keep.data(), addresses.data(), keep.size());
+			size_t expected {0};
+			for (size_t i = 0; i < keep.size(); i++) {
+				auto address = solveLinear(image, keep[i], Slide);
+				if (!strcmp(keep[i], "_undef") || !strcmp(keep[i], "_stab"))
+					address = 0;
+				CHECK(addresses[i] == address);
+				expected += address != 0;
+			}
+			CHECK(solved == expected);
+		}
+
+		// The compact tables are never read again, the first lookup reads the header check and the tables
+		CHECK(Host::reads == 2);
+	}
+
+	return true;
+}
+
+bool testSymbols() {
+	return testSymbolKinds() && testTables() && testBatches() && testPrefixes() && testCompaction();
+}
+
+void benchSymbols() {
+	constexpr size_t Lookups {50};
+
+	for (size_t num : {10000, 100000}) {
+		auto image = buildMach(generateSymbols(0x53796D62, num));
+		Random rnd(num);
+		std::vector<const char *> names;
+		for (size_t i = 0; i < Lookups; i++)
+			names.push_back(image.symbols[rnd.below(static_cast<uint32_t>(num))].name.c_str());
+		names.push_back("_missing");
+
+		auto start = std::chrono::steady_clock::now();
+		uint64_t expected {0};
+		for (auto name : names)
+			expected += solveLinear(image, name, Slide);
+		auto linearUs = elapsedUs(start);
+
+		Kext kext(image);
+		start = std::chrono::steady_clock::now();
+		uint64_t found = kext->solveSymbol(names[0]);
+		auto firstUs = elapsedUs(start);
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 1; i < names.size(); i++)
+			found += kext->solveSymbol(names[i]);
+		auto indexedUs = elapsedUs(start);
+
+		printf("  %6zu symbols, %zu lookups: table walk %6lld us, first lookup with tables and index %5lld us, rest %4lld us%s\n",
+			   num, names.size(), linearUs, firstUs, indexedUs, found != expected ? ", results DIFFER" : "");
+
+		// Prefix queries ending inside the member numbers, a few to a hundred matches each
+		std::vector<std::string> prefixes;
+		for (size_t i = 0; i < Lookups; i++) {
+			auto &name = image.symbols[rnd.below(static_cast<uint32_t>(num))].name;
+			prefixes.push_back(name.substr(0, name.size() - strlen("EP9IOService") - rnd.below(3)));
+		}
+
+		auto nlists = reinterpret_cast<const nlist_64 *>(image.file.data() + image.symoff);
+		auto strings = reinterpret_cast<const char *>(image.file.data() + image.stroff);
+		start = std::chrono::steady_clock::now();
+		size_t expectedMatches {0};
+		for (auto &prefix : prefixes) {
+			for (size_t i = 0; i < image.symbols.size(); i++)
+				expectedMatches += !strncmp(prefix.c_str(), strings + nlists[i].n_un.n_strx, prefix.size());
+		}
+		linearUs = elapsedUs(start);
+
+		auto count = [](void *user, const char *, mach_vm_address_t) {
+			(*static_cast<size_t *>(user))++;
+			return true;
+		};
+
+		Kext sorted(image);
+		size_t matches {0};
+		start = std::chrono::steady_clock::now();
+		sorted->solveSymbolsWithPrefix(prefixes[0].c_str(), count, &matches);
+		firstUs = elapsedUs(start);
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 1; i < prefixes.size(); i++)
+			sorted->solveSymbolsWithPrefix(prefixes[i].c_str(), count, &matches);
+		for (auto name : names)
+			sorted->solveSymbol(name);
+		auto sortedUs = elapsedUs(start);
+
+		printf("  %6zu symbols, %zu prefixes, %zu matches: table walk %6lld us, first query with tables and sorted index %5lld us, "
+			   "rest with %zu exact lookups %4lld us%s\n", num, prefixes.size(), matches, linearUs, firstUs, names.size(), sortedUs,
+			   matches != expectedMatches ? ", results DIFFER" : "");
+	}
+}
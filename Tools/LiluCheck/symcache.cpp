@@ -0,0 +1,286 @@
+//
+//  symcache.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  SymbolCache file format and MachInfo lookups through it against reading __LINKEDIT.
+//
+
+#include "checks.hpp"
+#include "host.hpp"
+#include "macho.hpp"
+
+#include <Headers/kern_mach.hpp>
+#include <PrivateHeaders/kern_symcache.hpp>
+
+#include <mach-o/loader.h>
+
+#include <cstring>
+
+static const char *CachePath {"/LiluCheck/symbols"};
+
+/**
+ *  Symbols a plugin would ask for, the last one is missing
+ */
+static constexpr size_t Wanted {50};
+
+/**
+ *  Kext with every symbol inside its __TEXT segment
+ */
+static MachImage cacheImage(uint8_t uuid=0) {
+	auto symbols = generateSymbols(0x53796D43, 2000);
+	for (size_t i = 0; i < symbols.size(); i++)
+		symbols[i].value = 0x1000 + i * 16;
+
+	MachLayout layout;
+	layout.textAddr = 0;
+	layout.textSize = 0x1000 + symbols.size() * 16;
+	layout.uuid[15] ^= uuid;
+	return buildMach(symbols, layout);
+}
+
+/**
+ *  Loaded copy of the kext header, segments are at their running addresses
+ */
+class Running {
+	std::vector<uint64_t> header;
+
+public:
+	Running(const MachImage &image, uint8_t uuid=0) {
+		auto mh = reinterpret_cast<const mach_header_64 *>(image.file.data());
+		size_t size = sizeof(mach_header_64) + mh->sizeofcmds;
+		header.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		memcpy(header.data(), image.file.data(), size);
+
+		auto addr = reinterpret_cast<uint8_t *>(header.data()) + sizeof(mach_header_64);
+		for (uint32_t i = 0; i < mh->ncmds; i++) {
+			auto cmd = reinterpret_cast<load_command *>(addr);
+			if (cmd->cmd == LC_SEGMENT_64)
+				reinterpret_cast<segment_command_64 *>(cmd)->vmaddr += base();
+			else if (cmd->cmd == LC_UUID)
+				reinterpret_cast<uuid_command *>(cmd)->uuid[15] ^= uuid;
+			addr += cmd->cmdsize;
+		}
+	}
+
+	uint64_t base() const {
+		return reinterpret_cast<uint64_t>(header.data());
+	}
+};
+
+/**
+ *  Kext MachInfo using a symbol cache
+ *
+ *  @param image   kext binary
+ *  @param cache   symbol cache
+ *  @param running loaded header or nullptr to only set the slide
+ *
+ *  @return MachInfo or nullptr
+ */
+static MachInfo *loadKext(const MachImage &image, SymbolCache &cache, const Running *running) {
+	Host::addFile(KextPath, image.file);
+	auto info = MachInfo::create(false, "LiluCheck");
+	const char * const paths[] {KextPath};
+	info->setSymbolCache(&cache);
+	if (info->init(paths) != KERN_SUCCESS ||
+		(running ? info->getRunningAddresses(running->base()) : info->setRunningAddresses(Slide)) != KERN_SUCCESS) {
+		info->deinit();
+		MachInfo::deleter(info);
+		return nullptr;
+	}
+	return info;
+}
+
+static void unloadKext(MachInfo *info) {
+	info->deinit();
+	MachInfo::deleter(info);
+}
+
+/**
+ *  Solve the wanted symbols and compare them with the symbol table
+ */
+static bool solveWanted(MachInfo *info, const MachImage &image, uint64_t slide) {
+	const char *names[Wanted];
+	mach_vm_address_t addresses[Wanted];
+	for (size_t i = 0; i < Wanted - 1; i++)
+		names[i] = image.symbols[i * 37].name.c_str();
+	names[Wanted - 1] = "__ZN9IOService7missingEv";
+
+	CHECK(info->solveSymbols(names, addresses, Wanted) == Wanted - 1);
+	for (size_t i = 0; i < Wanted; i++)
+		CHECK(addresses[i] == solveLinear(image, names[i], slide));
+	return true;
+}
+
+/**
+ *  Solve the wanted symbols of a kext with the cache file, then write the file back
+ *
+ *  @param image   kext binary
+ *  @param running loaded header or nullptr
+ *  @param warm    whether __LINKEDIT is expected to be left unread
+ */
+static bool bootWith(const MachImage &image, const Running *running, bool warm) {
+	SymbolCache cache;
+	CHECK(cache.init());
+	Host::resetReads();
+	cache.load(CachePath);
+	CHECK(Host::reads <= 1);
+
+	auto info = loadKext(image, cache, running);
+	CHECK(info);
+	Host::resetReads();
+	bool solved = solveWanted(info, image, running ? running->base() : Slide);
+	size_t reads = Host::reads;
+	unloadKext(info);
+
+	cache.flush(CachePath);
+	cache.deinit();
+
+	CHECK(solved);
+	CHECK(warm ? reads == 0 : reads > 0);
+	return true;
+}
+
+/**
+ *  Entries survive a round trip, any damage makes the whole file invalid
+ */
+static bool testFormat() {
+	SymbolCache cache;
+	CHECK(cache.init());
+	uint8_t uuid[SymbolCache::UUIDSize] {1, 2, 3};
+	cache.store(uuid, "_first", 0x1000, true);
+	cache.store(uuid, "_second", 0x2000, true);
+	cache.store(uuid, "_missing", 0, false);
+
+	size_t size {0};
+	auto data = cache.serialize(size);
+	CHECK(data);
+
+	SymbolCache copy;
+	CHECK(copy.init());
+	CHECK(copy.deserialize(data, size));
+	uint64_t value {0};
+	bool found {false};
+	CHECK(copy.lookup(uuid, "_second", value, found) && value == 0x2000 && found);
+	CHECK(copy.lookup(uuid, "_missing", value, found) && !found);
+	uuid[0]++;
+	CHECK(!copy.lookup(uuid, "_first", value, found));
+
+	bool ok {true};
+	for (size_t i = 0; i < size && ok; i++) {
+		data[i] ^= 0x20;
+		ok = !copy.deserialize(data, size);
+		data[i] ^= 0x20;
+	}
+	for (size_t i = 0; i < size && ok; i++)
+		ok = !copy.deserialize(data, i);
+
+	Buffer::deleter(data);
+	copy.deinit();
+	cache.deinit();
+	CHECK(ok);
+	return true;
+}
+
+/**
+ *  A warm boot solves every symbol from the cache file alone
+ */
+static bool testWarm() {
+	auto image = cacheImage();
+	Running running(image);
+
+	Host::addFile(CachePath, {});
+	CHECK(bootWith(image, &running, false));
+	CHECK(bootWith(image, &running, true));
+	CHECK(bootWith(image, &running, true));
+
+	Host::removeFiles();
+	return true;
+}
+
+/**
+ *  The cache is not used unless the running binary is known to be the read one
+ */
+static bool testMismatch() {
+	auto image = cacheImage();
+	Running running(image);
+	Host::addFile(CachePath, {});
+	CHECK(bootWith(image, &running, false));
+
+	// Unknown running binary
+	CHECK(bootWith(image, nullptr, false));
+
+	// Running binary differs from the one on disk
+	Running other(image, 1);
+	CHECK(bootWith(image, &other, false));
+
+	// Updated binary on disk matching the running one
+	auto updated = cacheImage(1);
+	CHECK(bootWith(updated, &other, false));
+	CHECK(bootWith(updated, &other, true));
+	CHECK(bootWith(image, &running, true));
+
+	Host::removeFiles();
+	return true;
+}
+
+/**
+ *  Cached values pointing outside of the running binary are not used and get replaced
+ */
+static bool testTampered() {
+	auto image = cacheImage();
+	Running running(image);
+	Host::addFile(CachePath, {});
+	CHECK(bootWith(image, &running, false));
+
+	auto mh = reinterpret_cast<const mach_header_64 *>(image.file.data());
+	auto uuid = reinterpret_cast<const uuid_command *>(image.file.data() + sizeof(mach_header_64) + mh->sizeofcmds - sizeof(uuid_command));
+	CHECK(uuid->cmd == LC_UUID);
+
+	// Past the end of __TEXT, inside __LINKEDIT and far away
+	for (uint64_t value : {uint64_t {image.symbols.size() * 16 + 0x1000}, uint64_t {image.file.size() - 0x10}, uint64_t {0x7FFFF000}}) {
+		SymbolCache cache;
+		CHECK(cache.init());
+		CHECK(cache.load(CachePath));
+		cache.store(uuid->uuid, image.symbols[37].name.c_str(), value, true);
+		CHECK(cache.flush(CachePath));
+		cache.deinit();
+
+		CHECK(bootWith(image, &running, false));
+		CHECK(bootWith(image, &running, true));
+	}
+
+	Host::removeFiles();
+	return true;
+}
+
+bool testSymcache() {
+	return testFormat() && testWarm() && testMismatch() && testTampered();
+}
+
+void benchSymcache() {
+	auto image = cacheImage();
+	Running running(image);
+	Host::addFile(CachePath, {});
+
+	for (int boot = 0; boot < 2; boot++) {
+		SymbolCache cache;
+		cache.init();
+		Host::resetReads();
+		auto start = std::chrono::steady_clock::now();
+		cache.load(CachePath);
+		auto info = loadKext(image, cache, &running);
+		if (info) {
+			solveWanted(info, image, running.base());
+			unloadKext(info);
+		}
+		auto us = elapsedUs(start);
+		printf("  %s boot, %zu symbols of %zu: %zu reads %6zu bytes %5lld us\n",
+			   boot ? "warm" : "cold", Wanted, image.symbols.size(), Host::reads, Host::readBytes, us);
+		cache.flush(CachePath);
+		cache.deinit();
+	}
+
+	Host::removeFiles();
+}
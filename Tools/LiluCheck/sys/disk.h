@@ -0,0 +1,8 @@
+//
+//  disk.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, nothing from it is used.
+//
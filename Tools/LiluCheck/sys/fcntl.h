@@ -0,0 +1,19 @@
+//
+//  fcntl.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef sys_fcntl_h
+#define sys_fcntl_h
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define FWRITE      0x0002
+#define FWASWRITTEN 0x10000
+
+#endif /* sys_fcntl_h */
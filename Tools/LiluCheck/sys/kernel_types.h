@@ -0,0 +1,23 @@
+//
+//  kernel_types.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//
+
+#ifndef kernel_types_h
+#define kernel_types_h
+
+#include <mach/mach_types.h>
+
+typedef struct vnode *vnode_t;
+typedef struct mount *mount_t;
+typedef struct vfs_context *vfs_context_t;
+typedef struct uio *uio_t;
+typedef struct ucred *kauth_cred_t;
+typedef uint64_t user_addr_t;
+typedef uint64_t user_size_t;
+
+#endif /* kernel_types_h */
@@ -0,0 +1,60 @@
+//
+//  vnode.h
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for the kernel header, keep in sync.
+//  The functions work on the in-memory file system of host.cpp.
+//
+
+#ifndef vnode_h
+#define vnode_h
+
+#include <sys/kernel_types.h>
+#include <sys/types.h>
+
+#define NULLVP nullptr
+
+#define VNODE_LOOKUP_NOFOLLOW 0x01
+
+#define UIO_SYSSPACE 2
+#define UIO_READ     0
+#define UIO_WRITE    1
+
+#define CAST_USER_ADDR_T(x) static_cast<user_addr_t>(reinterpret_cast<uintptr_t>(x))
+
+struct vnode_attr {
+	uint64_t va_active;
+	uint64_t va_wanted;
+	uint64_t va_data_size;
+};
+
+#define VNODE_ATTR_va_data_size 0x04
+
+#define VATTR_INIT(v)       do { (v)->va_active = (v)->va_wanted = 0; } while (0)
+#define VATTR_WANTED(v, a)  ((v)->va_wanted |= VNODE_ATTR_ ## a)
+
+errno_t vnode_lookup(const char *path, int flags, vnode_t *vpp, vfs_context_t ctx);
+errno_t vnode_open(const char *path, int fmode, int cmode, int flags, vnode_t *vpp, vfs_context_t ctx);
+errno_t vnode_close(vnode_t vp, int flags, vfs_context_t ctx);
+int vnode_put(vnode_t vp);
+int vnode_getattr(vnode_t vp, vnode_attr *vap, vfs_context_t ctx);
+uint32_t vnode_vid(vnode_t vp);
+mount_t vnode_mount(vnode_t vp);
+int vfs_isrdonly(mount_t mp);
+
+vfs_context_t vfs_context_create(vfs_context_t ctx);
+int vfs_context_rele(vfs_context_t ctx);
+vfs_context_t vfs_context_current();
+kauth_cred_t vfs_context_ucred(vfs_context_t ctx);
+
+uio_t uio_create(int iovcount, off_t offset, int spacetype, int iodirection);
+int uio_addiov(uio_t uio, user_addr_t baseaddr, user_size_t length);
+user_size_t uio_resid(uio_t uio);
+void uio_free(uio_t uio);
+
+int VNOP_READ(vnode_t vp, uio_t uio, int ioflag, vfs_context_t ctx);
+int VNOP_WRITE(vnode_t vp, uio_t uio, int ioflag, vfs_context_t ctx);
+
+#endif /* vnode_h */
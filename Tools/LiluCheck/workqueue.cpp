@@ -0,0 +1,289 @@
+//
+//  workqueue.cpp
+//  LiluCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  WorkQueue jobs and MachInfo preparation on it against running them in order.
+//
+
+#include "checks.hpp"
+#include "host.hpp"
+#include "macho.hpp"
+
+#include <Headers/kern_file.hpp>
+#include <PrivateHeaders/kern_workqueue.hpp>
+
+#include <atomic>
+#include <string>
+#include <unistd.h>
+
+/**
+ *  Job writing a value derived from its seed after a random delay
+ */
+struct Hashed {
+	uint64_t seed;
+	uint64_t value;
+};
+
+static void hashJob(void *param) {
+	auto job = static_cast<Hashed *>(param);
+	Random rnd(job->seed);
+	usleep(rnd.below(500));
+	for (int i = 0; i < 1000; i++)
+		rnd.next();
+	job->value = rnd.next();
+}
+
+/**
+ *  Run the hashing jobs on a queue and compare the values with running them in order
+ */
+static bool runHashed(WorkQueue &queue, size_t num) {
+	std::vector<Hashed> queued(num), serial(num);
+	for (size_t i = 0; i < num; i++) {
+		queued[i] = serial[i] = {0x576F726B + i, 0};
+		hashJob(&serial[i]);
+	}
+
+	for (auto &job : queued)
+		queue.submit(hashJob, &job);
+	queue.join();
+
+	for (size_t i = 0; i < num; i++)
+		CHECK(queued[i].value == serial[i].value);
+	return true;
+}
+
+/**
+ *  Run the hashing jobs on a queue and wait for each of them in order
+ */
+static bool runWaited(WorkQueue &queue, size_t num) {
+	std::vector<Hashed> queued(num), serial(num);
+	for (size_t i = 0; i < num; i++) {
+		queued[i] = serial[i] = {0x57616974 + i, 0};
+		hashJob(&serial[i]);
+	}
+
+	for (auto &job : queued)
+		queue.submit(hashJob, &job);
+	for (size_t i = 0; i < num; i++) {
+		queue.wait(&queued[i]);
+		CHECK(queued[i].value == serial[i].value);
+	}
+	queue.join();
+	return true;
+}
+
+/**
+ *  Kext binary prepared like KernelPatcher::prepareKinfo does
+ */
+struct Prepared {
+	std::string path;
+	MachInfo *info;
+	kern_return_t result;
+};
+
+/**
+ *  Add kext binaries to the file system
+ */
+static std::vector<MachImage> addKexts(size_t num) {
+	std::vector<MachImage> images;
+	for (size_t i = 0; i < num; i++) {
+		images.push_back(buildMach(generateSymbols(0x5072706B + i, 2000)));
+		Host::addFile(("/LiluCheck/kext" + std::to_string(i)).c_str(), images.back().file);
+	}
+	return images;
+}
+
+/**
+ *  Create and init MachInfo for every kext, on a queue when it is initialised
+ */
+static std::vector<Prepared> prepareKexts(WorkQueue &queue, size_t num) {
+	std::vector<Prepared> kexts(num);
+	for (size_t i = 0; i < num; i++)
+		kexts[i] = {"/LiluCheck/kext" + std::to_string(i), MachInfo::create(false, "LiluCheck"), KERN_FAILURE};
+
+	for (auto &kext : kexts) {
+		queue.submit([](void *param) {
+			auto kext = static_cast<Prepared *>(param);
+			const char * const paths[] {kext->path.c_str()};
+			kext->result = kext->info->init(paths);
+		}, &kext);
+	}
+	queue.join();
+	return kexts;
+}
+
+static void releaseKexts(std::vector<Prepared> &kexts) {
+	for (auto &kext : kexts) {
+		kext.info->deinit();
+		MachInfo::deleter(kext.info);
+	}
+}
+
+/**
+ *  File read ahead of its processing like UserPatcher::loadFilesForPatching does
+ */
+struct Pending {
+	std::string path;
+	uint8_t *buffer;
+	size_t size;
+};
+
+static std::atomic<size_t> liveBuffers, peakBuffers;
+
+static void readPending(void *param) {
+	auto file = static_cast<Pending *>(param);
+	file->buffer = FileIO::readFileToBuffer(file->path.c_str(), file->size);
+	size_t live = ++liveBuffers, peak = peakBuffers;
+	while (live > peak && !peakBuffers.compare_exchange_weak(peak, live))
+		;
+}
+
+/**
+ *  Read the kexts at most ahead of the one compared with its image, in order
+ *
+ *  @return number of kexts read with the expected contents
+ */
+static size_t readAhead(WorkQueue &queue, const std::vector<MachImage> &images, size_t ahead) {
+	std::vector<Pending> files(images.size());
+	size_t submitted {0}, same {0};
+	liveBuffers = peakBuffers = 0;
+
+	for (size_t i = 0; i < images.size(); i++) {
+		for (; submitted < images.size() && submitted <= i + ahead; submitted++) {
+			files[submitted] = {"/LiluCheck/kext" + std::to_string(submitted), nullptr, 0};
+			queue.submit(readPending, &files[submitted]);
+		}
+		queue.wait(&files[i]);
+
+		auto &file = images[i].file;
+		if (files[i].buffer && files[i].size == file.size() && !memcmp(files[i].buffer, file.data(), file.size()))
+			same++;
+		Buffer::deleter(files[i].buffer);
+		liveBuffers--;
+	}
+
+	queue.join();
+	return same;
+}
+
+/**
+ *  Jobs complete by join and write the results running them in order would
+ */
+static bool testJobs() {
+	WorkQueue queue;
+	CHECK(queue.init());
+
+	// Nothing to wait for
+	queue.join();
+	CHECK(runHashed(queue, 1));
+	CHECK(runHashed(queue, 200));
+	// The queue is reusable after a join
+	CHECK(runHashed(queue, 50));
+	// Results are complete once their job is waited for, unknown jobs are not waited for
+	CHECK(runWaited(queue, 50));
+	queue.wait(nullptr);
+	queue.deinit();
+
+	// Jobs run right away without the resources
+	WorkQueue direct;
+	CHECK(runHashed(direct, 20));
+	CHECK(runWaited(direct, 20));
+	direct.deinit();
+
+	return true;
+}
+
+/**
+ *  Kexts prepared concurrently solve the same symbols with one header read each
+ */
+static bool testPrepare() {
+	constexpr size_t Num {16};
+	auto images = addKexts(Num);
+
+	WorkQueue queue;
+	CHECK(queue.init());
+	Host::resetReads();
+	auto kexts = prepareKexts(queue, Num);
+	queue.deinit();
+	size_t reads = Host::reads;
+
+	bool ok {reads == Num};
+	for (size_t i = 0; i < Num && ok; i++) {
+		ok = kexts[i].result == KERN_SUCCESS && kexts[i].info->setRunningAddresses(Slide) == KERN_SUCCESS;
+		for (size_t s = 0; s < images[i].symbols.size() && ok; s += 13) {
+			auto name = images[i].symbols[s].name.c_str();
+			ok = kexts[i].info->solveSymbol(name) == solveLinear(images[i], name, Slide);
+		}
+	}
+
+	releaseKexts(kexts);
+	Host::removeFiles();
+	CHECK(ok);
+	return true;
+}
+
+/**
+ *  Files read ahead arrive complete and in order with a bounded number of buffers
+ */
+static bool testReadAhead() {
+	constexpr size_t Num {12};
+	auto images = addKexts(Num);
+
+	WorkQueue queue;
+	CHECK(queue.init());
+	Host::readLatency = 1000;
+	size_t same = readAhead(queue, images, 2);
+	Host::readLatency = 0;
+	queue.deinit();
+	size_t peak = peakBuffers;
+
+	Host::removeFiles();
+	CHECK(same == Num);
+	CHECK(peak <= 3);
+	return true;
+}
+
+bool testWorkQueue() {
+	return testJobs() && testPrepare() && testReadAhead();
+}
+
+void benchWorkQueue() {
+	for (unsigned latency : {0, 4000}) {
+		Host::readLatency = latency;
+		for (size_t num : {8, 16, 32}) {
+			addKexts(num);
+			long long us[2];
+			for (int queued = 0; queued < 2; queued++) {
+				WorkQueue queue;
+				if (queued)
+					queue.init();
+				auto start = std::chrono::steady_clock::now();
+				auto kexts = prepareKexts(queue, num);
+				us[queued] = elapsedUs(start);
+				queue.deinit();
+				releaseKexts(kexts);
+			}
+			Host::removeFiles();
+			printf("  %2zu kexts, %4u us per read: serial %6lld us, queued %6lld us\n", num, latency, us[0], us[1]);
+		}
+	}
+
+	// Whole files read ahead of their processing, with the most buffers held at once
+	constexpr size_t Num {16};
+	auto images = addKexts(Num);
+	Host::readLatency = 4000;
+	for (size_t ahead : {size_t {0}, size_t {1}, size_t {2}, size_t {4}, Num}) {
+		WorkQueue queue;
+		if (ahead > 0)
+			queue.init();
+		auto start = std::chrono::steady_clock::now();
+		readAhead(queue, images, ahead);
+		long long us = elapsedUs(start);
+		queue.deinit();
+		printf("  %2zu kexts, %2zu read ahead: %6lld us, %2zu buffers\n", Num, ahead, us, static_cast<size_t>(peakBuffers));
+	}
+	Host::removeFiles();
+	Host::readLatency = 0;
+}
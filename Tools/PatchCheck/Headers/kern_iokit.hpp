@@ -0,0 +1,26 @@
+//
+//  kern_iokit.hpp
+//  PatchCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for Lilu kern_iokit.hpp, keep in sync with the original.
+//
+
+#ifndef kern_iokit_hpp
+#define kern_iokit_hpp
+
+namespace WIOKit {
+	/**
+	 *  Model variants
+	 */
+	struct ComputerModel {
+		enum {
+			ComputerLaptop = 0x1,
+			ComputerDesktop = 0x2,
+			ComputerAny = ComputerLaptop | ComputerDesktop
+		};
+	};
+}
+
+#endif /* kern_iokit_hpp */
@@ -0,0 +1,48 @@
+//
+//  kern_patcher.hpp
+//  PatchCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for Lilu kern_patcher.hpp, keep the structures in sync with the original.
+//
+
+#ifndef kern_patcher_hpp
+#define kern_patcher_hpp
+
+#include <Headers/kern_util.hpp>
+
+class KernelPatcher {
+public:
+	/**
+	 *  Any kernel
+	 */
+	static constexpr uint32_t KernelAny {0};
+
+	/**
+	 *  Kext information
+	 */
+	struct KextInfo {
+		static constexpr size_t Unloaded {0};
+		const char *id;
+		const char **paths;
+		size_t pathNum;
+		bool loaded; // invoke for kext if it is already loaded
+		bool reloadable; // allow the kext to unload and get patched again
+		bool user[6];
+		size_t loadIndex; // Updated after loading
+	};
+
+	/**
+	 *  Arbitrary kext find/replace patch
+	 */
+	struct LookupPatch {
+		KextInfo *kext;
+		const uint8_t *find;
+		const uint8_t *replace;
+		size_t size;
+		size_t count;
+	};
+};
+
+#endif /* kern_patcher_hpp */
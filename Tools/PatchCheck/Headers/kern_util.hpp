@@ -0,0 +1,31 @@
+//
+//  kern_util.hpp
+//  PatchCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host replacement for Lilu kern_util.hpp providing just enough
+//  to compile generated AppleALC resources without the kernel SDK.
+//
+
+#ifndef kern_util_hpp
+#define kern_util_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef PRODUCT_NAME
+#define PRODUCT_NAME AppleALC
+#endif
+
+#define xConcat(a, b) Concat(a, b)
+#define Concat(a, b) a ## b
+
+/**
+ *  Prefix name with your plugin name (to ease symbolication and avoid conflicts)
+ */
+#define ADDPR(a) xConcat(xConcat(PRODUCT_NAME, _), a)
+
+#define EXPORT
+
+#endif /* kern_util_hpp */
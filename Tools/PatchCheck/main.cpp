@@ -0,0 +1,459 @@
+//
+//  main.cpp
+//  PatchCheck
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Offline AppleALC kext patch checker, builds on any host with a C++11 compiler.
+//  Applies the generated patch tables to Mach-O binaries on disk with the same
+//  lookup code as KernelPatcher::applyLookupPatches and reports the results.
+//
+
+#include <Headers/kern_patcher.hpp>
+#include <PrivateHeaders/kern_lookup.hpp>
+
+#include "kern_resources.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ *  Mach-O definitions we need, the host may have no SDK
+ */
+namespace Mach {
+	static constexpr uint32_t FatMagic {0xCAFEBABE};
+	static constexpr uint32_t Magic64 {0xFEEDFACF};
+	static constexpr uint32_t CpuX86_64 {0x01000007};
+	static constexpr uint32_t SegmentCmd64 {0x19};
+	static constexpr uint32_t UUIDCmd {0x1B};
+
+	struct Header64 {
+		uint32_t magic;
+		uint32_t cputype;
+		uint32_t cpusubtype;
+		uint32_t filetype;
+		uint32_t ncmds;
+		uint32_t sizeofcmds;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	struct LoadCommand {
+		uint32_t cmd;
+		uint32_t cmdsize;
+	};
+
+	struct Segment64 {
+		uint32_t cmd;
+		uint32_t cmdsize;
+		char segname[16];
+		uint64_t vmaddr;
+		uint64_t vmsize;
+		uint64_t fileoff;
+		uint64_t filesize;
+		uint32_t maxprot;
+		uint32_t initprot;
+		uint32_t nsects;
+		uint32_t flags;
+	};
+
+	struct FatArch {
+		uint32_t cputype;
+		uint32_t cpusubtype;
+		uint32_t offset;
+		uint32_t size;
+		uint32_t align;
+	};
+}
+
+/**
+ *  Loaded binary laid out as it would be in memory
+ */
+struct Image {
+	std::vector<uint8_t> data;
+	uint8_t uuid[16] {};
+	bool hasUUID {false};
+};
+
+/**
+ *  Major kernel versions AppleALC patches are checked for, MountainLion to HighSierra
+ */
+static constexpr uint32_t FirstKernel {12};
+static constexpr uint32_t LastKernel {17};
+
+/**
+ *  Checker options
+ */
+struct Options {
+	uint32_t kernel {KernelPatcher::KernelAny};
+	const char *kextId {nullptr};
+};
+
+/**
+ *  Read big-endian 32-bit value
+ */
+static uint32_t readBE32(const uint8_t *p) {
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+		(static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+/**
+ *  Read the whole file
+ *
+ *  @param path file path
+ *  @param out  file contents
+ *
+ *  @return true on success
+ */
+static bool readFile(const char *path, std::vector<uint8_t> &out) {
+	auto fh = fopen(path, "rb");
+	if (!fh)
+		return false;
+
+	uint8_t buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fh)) > 0)
+		out.insert(out.end(), buf, buf + n);
+
+	bool ok = !ferror(fh);
+	fclose(fh);
+	return ok;
+}
+
+/**
+ *  Find x86_64 slice and map its segments like the kernel does
+ *
+ *  @param file  file contents
+ *  @param image resulting image
+ *
+ *  @return true on success
+ */
+static bool loadImage(const std::vector<uint8_t> &file, Image &image) {
+	size_t off {0}, size {file.size()};
+
+	if (size >= 8 && readBE32(file.data()) == Mach::FatMagic) {
+		uint32_t num = readBE32(file.data() + 4);
+		size_t archs = 8;
+		bool found {false};
+		for (uint32_t i = 0; i < num && archs + sizeof(Mach::FatArch) <= file.size(); i++, archs += sizeof(Mach::FatArch)) {
+			if (readBE32(file.data() + archs) == Mach::CpuX86_64) {
+				off = readBE32(file.data() + archs + 8);
+				size = readBE32(file.data() + archs + 12);
+				found = true;
+				break;
+			}
+		}
+
+		if (!found || off > file.size() || file.size() - off < size) {
+			fprintf(stderr, "no valid x86_64 slice found\n");
+			return false;
+		}
+	}
+
+	auto base = file.data() + off;
+	Mach::Header64 mh;
+	if (size < sizeof(mh)) {
+		fprintf(stderr, "file is too small\n");
+		return false;
+	}
+
+	memcpy(&mh, base, sizeof(mh));
+	if (mh.magic != Mach::Magic64 || mh.cputype != Mach::CpuX86_64 || sizeof(mh) + mh.sizeofcmds > size) {
+		fprintf(stderr, "not a 64-bit x86_64 mach-o\n");
+		return false;
+	}
+
+	// Collect the segments first to find the image bounds
+	std::vector<Mach::Segment64> segments;
+	size_t cmdoff = sizeof(mh);
+	for (uint32_t i = 0; i < mh.ncmds; i++) {
+		Mach::LoadCommand lc;
+		if (cmdoff + sizeof(lc) > sizeof(mh) + mh.sizeofcmds)
+			break;
+		memcpy(&lc, base + cmdoff, sizeof(lc));
+		if (lc.cmdsize < sizeof(lc) || cmdoff + lc.cmdsize > sizeof(mh) + mh.sizeofcmds)
+			break;
+
+		if (lc.cmd == Mach::SegmentCmd64 && lc.cmdsize >= sizeof(Mach::Segment64)) {
+			Mach::Segment64 seg;
+			memcpy(&seg, base + cmdoff, sizeof(seg));
+			if (seg.vmsize > 0)
+				segments.push_back(seg);
+		} else if (lc.cmd == Mach::UUIDCmd && lc.cmdsize >= sizeof(lc) + sizeof(image.uuid)) {
+			memcpy(image.uuid, base + cmdoff + sizeof(lc), sizeof(image.uuid));
+			image.hasUUID = true;
+		}
+
+		cmdoff += lc.cmdsize;
+	}
+
+	if (segments.empty()) {
+		fprintf(stderr, "no segments found\n");
+		return false;
+	}
+
+	uint64_t start = segments[0].vmaddr, end = 0;
+	for (auto &seg : segments) {
+		if (seg.vmaddr < start) start = seg.vmaddr;
+		if (seg.vmaddr + seg.vmsize > end) end = seg.vmaddr + seg.vmsize;
+	}
+
+	image.data.assign(static_cast<size_t>(end - start), 0);
+	for (auto &seg : segments) {
+		uint64_t copy = seg.filesize < seg.vmsize ? seg.filesize : seg.vmsize;
+		if (seg.fileoff > size || size - seg.fileoff < copy) {
+			fprintf(stderr, "segment %.16s is out of file bounds\n", seg.segname);
+			return false;
+		}
+		memcpy(image.data.data() + (seg.vmaddr - start), base + seg.fileoff, static_cast<size_t>(copy));
+	}
+
+	return true;
+}
+
+/**
+ *  Find the kext the binary belongs to
+ *
+ *  @param path binary path
+ *  @param opts checker options
+ *
+ *  @return kext info or nullptr
+ */
+static KernelPatcher::KextInfo *findKext(const char *path, const Options &opts) {
+	auto name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+
+	for (size_t i = 0; i < ADDPR(kextListSize); i++) {
+		auto &kext = ADDPR(kextList)[i];
+		if (opts.kextId) {
+			if (!strcmp(kext.id, opts.kextId))
+				return &kext;
+			continue;
+		}
+
+		for (size_t p = 0; p < kext.pathNum; p++) {
+			auto kname = strrchr(kext.paths[p], '/');
+			if (kname && !strcmp(kname + 1, name))
+				return &kext;
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ *  Check kernel compatibility like KernelPatcher::compatibleKernel does
+ */
+static bool compatibleKernel(uint32_t kernel, uint32_t min, uint32_t max) {
+	return (min == KernelPatcher::KernelAny || min <= kernel) &&
+		(max == KernelPatcher::KernelAny || max >= kernel);
+}
+
+/**
+ *  Print uuid in canonical form
+ */
+static void printUUID(const uint8_t *uuid) {
+	for (size_t i = 0; i < 16; i++)
+		printf(i == 4 || i == 6 || i == 8 || i == 10 ? "-%02X" : "%02X", uuid[i]);
+}
+
+/**
+ *  Apply a patch table the way AlcEnabler does for a single device and report the results
+ *
+ *  @param name       table name
+ *  @param kext       kext the image belongs to
+ *  @param image      loaded image
+ *  @param patches    patch table
+ *  @param patchesNum patch number
+ *  @param kernel     major kernel version to select patches for
+ *
+ *  @return true if all the counted patches were fully applied
+ */
+static bool checkTable(const std::string &name, KernelPatcher::KextInfo *kext, const Image &image, const KextPatch *patches, size_t patchesNum, uint32_t kernel) {
+	std::vector<KernelPatcher::LookupPatch> suitable;
+	for (size_t i = 0; i < patchesNum; i++) {
+		if (patches[i].patch.kext == kext && compatibleKernel(kernel, patches[i].minKernel, patches[i].maxKernel))
+			suitable.push_back(patches[i].patch);
+	}
+
+	if (suitable.empty())
+		return true;
+
+	auto num = suitable.size();
+	std::vector<size_t> changes(num);
+	std::vector<std::vector<size_t>> offsets(num);
+
+	// Split the patches like KernelPatcher::applyLookupPatches does
+	std::unique_ptr<bool[]> conflicts(new bool[num]);
+	size_t conflictNum = LookupAutomaton::findConflicts(suitable.data(), num, conflicts.get());
+	std::vector<KernelPatcher::LookupPatch> independent;
+	std::vector<size_t> independentIndex;
+	for (size_t p = 0; p < num; p++) {
+		if (!conflicts[p]) {
+			independent.push_back(suitable[p]);
+			independentIndex.push_back(p);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<uint8_t> patched;
+	if (conflictNum > 0)
+		patched = image.data;
+
+	if (!independent.empty()) {
+		std::vector<uint8_t> storage(LookupAutomaton::storageSize(independent.data(), independent.size()));
+		std::vector<size_t> independentChanges(independent.size());
+		LookupAutomaton automaton;
+
+		if (!automaton.init(independent.data(), independent.size(), storage.data())) {
+			printf("%s: failed to prepare lookup automaton\n", name.c_str());
+			return false;
+		}
+		automaton.replaceAll(independent.data(), independent.size(), image.data.data(), image.data.size(), independentChanges.data(), [&](size_t p, size_t off) {
+			offsets[independentIndex[p]].push_back(off);
+			if (!patched.empty())
+				memcpy(patched.data() + off, independent[p].replace, independent[p].size);
+		});
+		for (size_t p = 0; p < independent.size(); p++)
+			changes[independentIndex[p]] = independentChanges[p];
+	}
+
+	// Patches affecting each other are applied one after another on the partially patched image
+	for (size_t p = 0; p < num; p++) {
+		auto &patch = suitable[p];
+		if (!conflicts[p] || patch.size == 0)
+			continue;
+		auto curr = patched.begin();
+		while (patch.count == 0 || changes[p] < patch.count) {
+			curr = std::search(curr, patched.end(), patch.find, patch.find + patch.size);
+			if (curr == patched.end())
+				break;
+			offsets[p].push_back(static_cast<size_t>(curr - patched.begin()));
+			curr = std::copy(patch.replace, patch.replace + patch.size, curr);
+			changes[p]++;
+		}
+	}
+	auto usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	bool ok {true};
+	printf("%s: %zu patches, %zu sequential, %lld us\n", name.c_str(), num, conflictNum, static_cast<long long>(usec));
+	for (size_t p = 0; p < num; p++) {
+		auto &patch = suitable[p];
+		bool done = patch.count == 0 ? changes[p] > 0 : changes[p] == patch.count;
+		ok &= patch.count == 0 || done;
+
+		printf("  %2zu: %3zu bytes, %zu/%zu %s", p, patch.size, changes[p], patch.count, done ? "ok" : "MISSING");
+		for (auto off : offsets[p])
+			printf(" 0x%zX", off);
+		printf("\n");
+	}
+
+	return ok;
+}
+
+/**
+ *  Check all the patch tables against a binary
+ *
+ *  @param path binary path
+ *  @param opts checker options
+ *
+ *  @return true if all the counted patches were fully applied
+ */
+static bool checkFile(const char *path, const Options &opts) {
+	auto kext = findKext(path, opts);
+	if (!kext) {
+		fprintf(stderr, "%s: unknown kext, pass -i <bundle id>\n", path);
+		return false;
+	}
+
+	std::vector<uint8_t> file;
+	Image image;
+	auto start = std::chrono::steady_clock::now();
+	if (!readFile(path, file)) {
+		fprintf(stderr, "%s: failed to read\n", path);
+		return false;
+	}
+	if (!loadImage(file, image)) {
+		fprintf(stderr, "%s: failed to load\n", path);
+		return false;
+	}
+	auto usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%s: %s, %zu bytes image, uuid ", path, kext->id, image.data.size());
+	if (image.hasUUID)
+		printUUID(image.uuid);
+	else
+		printf("none");
+	printf(", loaded in %lld us\n", static_cast<long long>(usec));
+
+	// Patches for different kernels may be mutually exclusive, so every version is checked on its own
+	bool ok {true};
+	uint32_t first = opts.kernel == KernelPatcher::KernelAny ? FirstKernel : opts.kernel;
+	uint32_t last = opts.kernel == KernelPatcher::KernelAny ? LastKernel : opts.kernel;
+
+	for (uint32_t kernel = first; kernel <= last; kernel++) {
+		bool kernelOk {true};
+		auto prefix = "kernel " + std::to_string(kernel) + " ";
+		start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < ADDPR(controllerModSize); i++) {
+			auto &ctrl = ADDPR(controllerMod)[i];
+			kernelOk &= checkTable(prefix + "controller " + ctrl.name, kext, image, ctrl.patches, ctrl.patchNum, kernel);
+		}
+
+		for (size_t v = 0; v < ADDPR(vendorModSize); v++) {
+			auto &vendor = ADDPR(vendorMod)[v];
+			for (size_t c = 0; c < vendor.codecsNum; c++) {
+				auto &codec = vendor.codecs[c];
+				kernelOk &= checkTable(prefix + "codec " + vendor.name + " " + codec.name, kext, image, codec.patches, codec.patchNum, kernel);
+			}
+		}
+
+		usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		printf("%s: kernel %u: %s in %lld us\n", path, kernel, kernelOk ? "all patches applied" : "some patches are missing", static_cast<long long>(usec));
+		ok &= kernelOk;
+	}
+
+	return ok;
+}
+
+static void usage(const char *self) {
+	fprintf(stderr,
+		"Usage: %s [-k kernel] [-i bundle id] binary...\n"
+		"  -k  major kernel version to select patches for (each of 12 to 17 by default)\n"
+		"  -i  kext bundle id if the binary name is not a known kext name\n",
+		self);
+}
+
+int main(int argc, char *argv[]) {
+	Options opts;
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+			opts.kernel = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+		} else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+			opts.kextId = argv[++i];
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (i == argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	bool ok {true};
+	for (; i < argc; i++)
+		ok &= checkFile(argv[i], opts);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
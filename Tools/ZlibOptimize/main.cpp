@@ -0,0 +1,701 @@
+//
+//  main.cpp
+//  ZlibOptimize
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+//  Host recompressor of AppleHDA .zlib resources, builds on any host with a C++11 compiler and zlib.
+//  Every file is inflated and encoded again with an iterated optimal parse, the result is a regular
+//  zlib stream that is inflated back and compared before the file is replaced. Files are only
+//  rewritten when they get smaller, so running it repeatedly is harmless.
+//
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ *  Deflate format limits
+ */
+namespace Deflate {
+	static constexpr size_t Window {32768};
+	static constexpr size_t MinMatch {3};
+	static constexpr size_t MaxMatch {258};
+	static constexpr size_t LitLenCodes {286};
+	static constexpr size_t DistCodes {30};
+	static constexpr size_t CodeLenCodes {19};
+	static constexpr size_t MaxBits {15};
+	static constexpr size_t MaxCodeLenBits {7};
+	static constexpr uint16_t EndOfBlock {256};
+
+	static const uint16_t lengthBase[29] {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const uint8_t lengthExtra[29] {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+	static const uint16_t distBase[30] {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+	};
+	static const uint8_t distExtra[30] {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+	};
+	static const uint8_t codeLenOrder[CodeLenCodes] {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+	};
+
+	static size_t lengthSymbol(size_t len) {
+		size_t i = 28;
+		while (lengthBase[i] > len)
+			i--;
+		return i;
+	}
+
+	static size_t distSymbol(size_t dist) {
+		size_t i = 29;
+		while (distBase[i] > dist)
+			i--;
+		return i;
+	}
+}
+
+/**
+ *  Parsed deflate item, a literal when dist is 0
+ */
+struct Item {
+	uint16_t value;
+	uint16_t dist;
+};
+
+/**
+ *  Every distinct match available at each position
+ *  Candidates are walked from the closest one, so only the ones longer than all the closer
+ *  candidates are kept, and each length is best served by the first entry covering it.
+ */
+class MatchTable {
+	struct Match {
+		uint16_t len;
+		uint16_t dist;
+	};
+
+	std::vector<uint32_t> start;
+	std::vector<Match> matches;
+
+public:
+	MatchTable(const std::vector<uint8_t> &data, size_t maxChain) : start(data.size() + 1, 0) {
+		static constexpr size_t HashBits {16};
+		auto hash = [&data](size_t i) {
+			return ((data[i] << 16 | data[i+1] << 8 | data[i+2]) * 2654435761U) >> (32 - HashBits);
+		};
+
+		std::vector<int64_t> head(1 << HashBits, -1);
+		std::vector<int64_t> prev(data.size(), -1);
+		size_t size = data.size();
+
+		for (size_t i = 0; i < size; i++) {
+			start[i] = static_cast<uint32_t>(matches.size());
+			if (i + Deflate::MinMatch > size)
+				continue;
+
+			auto h = hash(i);
+			size_t limit = std::min(Deflate::MaxMatch, size - i);
+			size_t best {Deflate::MinMatch - 1};
+			size_t chain {0};
+			for (int64_t c = head[h]; c >= 0 && i - c <= Deflate::Window && chain < maxChain && best < limit; c = prev[c], chain++) {
+				size_t len {0};
+				while (len < limit && data[c + len] == data[i + len])
+					len++;
+				if (len > best) {
+					best = len;
+					matches.push_back({static_cast<uint16_t>(len), static_cast<uint16_t>(i - c)});
+				}
+			}
+
+			prev[i] = head[h];
+			head[h] = static_cast<int64_t>(i);
+		}
+
+		start[size] = static_cast<uint32_t>(matches.size());
+	}
+
+	/**
+	 *  Walk the lengths available at a position with the closest distance for each
+	 */
+	template <typename F>
+	void forEach(size_t pos, F func) const {
+		size_t len {Deflate::MinMatch};
+		for (size_t m = start[pos]; m < start[pos+1]; m++) {
+			for (; len <= matches[m].len; len++)
+				func(len, matches[m].dist);
+		}
+	}
+};
+
+/**
+ *  Symbol statistics of a parse
+ */
+struct Stats {
+	size_t litLen[Deflate::LitLenCodes] {};
+	size_t dist[Deflate::DistCodes] {};
+
+	explicit Stats(const std::vector<Item> &items) {
+		for (auto &item : items) {
+			if (item.dist) {
+				litLen[257 + Deflate::lengthSymbol(item.value)]++;
+				dist[Deflate::distSymbol(item.dist)]++;
+			} else {
+				litLen[item.value]++;
+			}
+		}
+		litLen[Deflate::EndOfBlock]++;
+	}
+};
+
+/**
+ *  Symbol costs in bits used by the optimal parse
+ */
+struct CostModel {
+	float litLen[Deflate::LitLenCodes];
+	float dist[Deflate::DistCodes];
+
+	/**
+	 *  Costs of the fixed Huffman codes
+	 */
+	CostModel() {
+		for (size_t i = 0; i < Deflate::LitLenCodes; i++)
+			litLen[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+		for (size_t i = 0; i < Deflate::DistCodes; i++)
+			dist[i] = 5;
+	}
+
+	/**
+	 *  Entropy costs of a previous parse
+	 */
+	explicit CostModel(const Stats &stats) {
+		entropy(stats.litLen, litLen, Deflate::LitLenCodes);
+		entropy(stats.dist, dist, Deflate::DistCodes);
+	}
+
+	static void entropy(const size_t *count, float *cost, size_t num) {
+		size_t total {0};
+		for (size_t i = 0; i < num; i++)
+			total += count[i];
+		float log2total = total ? std::log2(static_cast<float>(total)) : 0;
+		for (size_t i = 0; i < num; i++) {
+			// Unused symbols get a rarely used symbol cost
+			cost[i] = count[i] ? log2total - std::log2(static_cast<float>(count[i])) : log2total + 1;
+		}
+	}
+
+	float match(size_t len, size_t distance) const {
+		auto ls = Deflate::lengthSymbol(len);
+		auto ds = Deflate::distSymbol(distance);
+		return litLen[257 + ls] + Deflate::lengthExtra[ls] + dist[ds] + Deflate::distExtra[ds];
+	}
+};
+
+/**
+ *  Find the cheapest parse under a cost model
+ */
+static std::vector<Item> optimalParse(const std::vector<uint8_t> &data, const MatchTable &table, const CostModel &model) {
+	size_t size = data.size();
+	std::vector<float> cost(size + 1, INFINITY);
+	std::vector<Item> step(size + 1, {0, 0});
+	cost[0] = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		float curr = cost[i];
+		float lit = curr + model.litLen[data[i]];
+		if (lit < cost[i+1]) {
+			cost[i+1] = lit;
+			step[i+1] = {data[i], 0};
+		}
+
+		table.forEach(i, [&](size_t len, size_t distance) {
+			float c = curr + model.match(len, distance);
+			if (c < cost[i+len]) {
+				cost[i+len] = c;
+				step[i+len] = {static_cast<uint16_t>(len), static_cast<uint16_t>(distance)};
+			}
+		});
+	}
+
+	std::vector<Item> items;
+	for (size_t i = size; i > 0; ) {
+		auto &s = step[i];
+		items.push_back(s);
+		i -= s.dist ? s.value : 1;
+	}
+	std::reverse(items.begin(), items.end());
+	return items;
+}
+
+/**
+ *  Build Huffman code lengths limited to maxBits
+ *  Frequencies are flattened until the code fits, which is rarely needed for these inputs.
+ */
+static void huffmanLengths(const size_t *freq, size_t num, size_t maxBits, uint8_t *lengths) {
+	std::vector<size_t> count(freq, freq + num);
+
+	while (true) {
+		std::fill(lengths, lengths + num, 0);
+
+		struct Node {
+			size_t weight;
+			int left;
+			int right;
+		};
+		std::vector<Node> nodes;
+		std::vector<int> active;
+		for (size_t i = 0; i < num; i++) {
+			if (count[i]) {
+				nodes.push_back({count[i], -1, static_cast<int>(i)});
+				active.push_back(static_cast<int>(nodes.size() - 1));
+			}
+		}
+
+		if (active.size() == 0)
+			return;
+		if (active.size() == 1) {
+			lengths[nodes[active[0]].right] = 1;
+			return;
+		}
+
+		while (active.size() > 1) {
+			std::sort(active.begin(), active.end(), [&nodes](int a, int b) {
+				return nodes[a].weight != nodes[b].weight ? nodes[a].weight > nodes[b].weight : a > b;
+			});
+			int a = active.back();
+			active.pop_back();
+			int b = active.back();
+			active.pop_back();
+			nodes.push_back({nodes[a].weight + nodes[b].weight, a, b});
+			active.push_back(static_cast<int>(nodes.size() - 1));
+		}
+
+		size_t longest {0};
+		std::vector<std::pair<int, size_t>> stack {{active[0], 0}};
+		while (!stack.empty()) {
+			auto curr = stack.back();
+			stack.pop_back();
+			auto &node = nodes[curr.first];
+			if (node.left < 0) {
+				lengths[node.right] = static_cast<uint8_t>(curr.second);
+				longest = std::max(longest, curr.second);
+			} else {
+				stack.push_back({node.left, curr.second + 1});
+				stack.push_back({node.right, curr.second + 1});
+			}
+		}
+
+		if (longest <= maxBits)
+			return;
+
+		for (auto &c : count) {
+			if (c)
+				c = (c >> 1) | 1;
+		}
+	}
+}
+
+/**
+ *  Canonical codes for code lengths, bit reversed for LSB first output
+ */
+static void canonicalCodes(const uint8_t *lengths, size_t num, uint16_t *codes) {
+	size_t blCount[Deflate::MaxBits + 1] {};
+	for (size_t i = 0; i < num; i++)
+		blCount[lengths[i]]++;
+	blCount[0] = 0;
+
+	uint16_t next[Deflate::MaxBits + 1] {};
+	uint16_t code {0};
+	for (size_t bits = 1; bits <= Deflate::MaxBits; bits++) {
+		code = (code + blCount[bits - 1]) << 1;
+		next[bits] = code;
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		size_t len = lengths[i];
+		codes[i] = 0;
+		if (len) {
+			uint16_t c = next[len]++;
+			for (size_t b = 0; b < len; b++)
+				codes[i] |= ((c >> b) & 1) << (len - 1 - b);
+		}
+	}
+}
+
+/**
+ *  LSB first bit output
+ */
+class BitWriter {
+	std::vector<uint8_t> &out;
+	uint32_t acc {0};
+	size_t bits {0};
+
+public:
+	size_t total {0};
+
+	explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+	void put(uint32_t value, size_t num) {
+		total += num;
+		acc |= value << bits;
+		bits += num;
+		while (bits >= 8) {
+			out.push_back(acc & 0xFF);
+			acc >>= 8;
+			bits -= 8;
+		}
+	}
+
+	void flush() {
+		if (bits > 0)
+			out.push_back(acc & 0xFF);
+		acc = 0;
+		bits = 0;
+	}
+};
+
+/**
+ *  Code length sequence item, extra is the repeat count argument
+ */
+struct CodeLenItem {
+	uint8_t symbol;
+	uint8_t extra;
+};
+
+/**
+ *  Run length encode code lengths with the allowed repeat codes
+ */
+static std::vector<CodeLenItem> encodeCodeLengths(const std::vector<uint8_t> &lengths, bool use16, bool use17, bool use18) {
+	std::vector<CodeLenItem> items;
+	size_t num = lengths.size();
+	for (size_t i = 0; i < num; ) {
+		uint8_t value = lengths[i];
+		size_t run {1};
+		while (i + run < num && lengths[i + run] == value)
+			run++;
+
+		size_t left = run;
+		if (value == 0) {
+			while (use18 && left >= 11) {
+				size_t n = std::min<size_t>(left, 138);
+				items.push_back({18, static_cast<uint8_t>(n - 11)});
+				left -= n;
+			}
+			while (use17 && left >= 3) {
+				size_t n = std::min<size_t>(left, 10);
+				items.push_back({17, static_cast<uint8_t>(n - 3)});
+				left -= n;
+			}
+		} else if (use16 && left >= 4) {
+			items.push_back({value, 0});
+			left--;
+			while (left >= 3) {
+				size_t n = std::min<size_t>(left, 6);
+				items.push_back({16, static_cast<uint8_t>(n - 3)});
+				left -= n;
+			}
+		}
+
+		for (; left > 0; left--)
+			items.push_back({value, 0});
+		i += run;
+	}
+	return items;
+}
+
+/**
+ *  Write one final block of a parse
+ *
+ *  @param items parsed data
+ *  @param fixed use fixed Huffman codes
+ *  @param out   output bits
+ */
+static void writeBlock(const std::vector<Item> &items, bool fixed, BitWriter &out) {
+	uint8_t litLenBits[Deflate::LitLenCodes + 2] {};
+	uint8_t distBits[Deflate::DistCodes + 2] {};
+
+	out.put(1, 1);
+
+	if (fixed) {
+		out.put(1, 2);
+		for (size_t i = 0; i < 288; i++)
+			litLenBits[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+		for (size_t i = 0; i < 32; i++)
+			distBits[i] = 5;
+	} else {
+		out.put(2, 2);
+		Stats stats(items);
+		huffmanLengths(stats.litLen, Deflate::LitLenCodes, Deflate::MaxBits, litLenBits);
+		huffmanLengths(stats.dist, Deflate::DistCodes, Deflate::MaxBits, distBits);
+
+		// A single unused distance code keeps the code valid for inflaters
+		size_t usedDist {0};
+		for (size_t i = 0; i < Deflate::DistCodes; i++)
+			usedDist += distBits[i] != 0;
+		if (usedDist == 0)
+			distBits[0] = 1;
+
+		size_t hlit {Deflate::LitLenCodes};
+		while (hlit > 257 && litLenBits[hlit - 1] == 0)
+			hlit--;
+		size_t hdist {Deflate::DistCodes};
+		while (hdist > 1 && distBits[hdist - 1] == 0)
+			hdist--;
+
+		std::vector<uint8_t> lengths(litLenBits, litLenBits + hlit);
+		lengths.insert(lengths.end(), distBits, distBits + hdist);
+
+		// Pick the repeat codes giving the shortest header
+		size_t bestBits {SIZE_MAX};
+		std::vector<CodeLenItem> bestItems;
+		uint8_t bestCodeLenBits[Deflate::CodeLenCodes] {};
+		for (int mask = 0; mask < 8; mask++) {
+			auto seq = encodeCodeLengths(lengths, mask & 1, mask & 2, mask & 4);
+			size_t freq[Deflate::CodeLenCodes] {};
+			for (auto &s : seq)
+				freq[s.symbol]++;
+			uint8_t codeLenBits[Deflate::CodeLenCodes] {};
+			huffmanLengths(freq, Deflate::CodeLenCodes, Deflate::MaxCodeLenBits, codeLenBits);
+
+			size_t hclen {Deflate::CodeLenCodes};
+			while (hclen > 4 && codeLenBits[Deflate::codeLenOrder[hclen - 1]] == 0)
+				hclen--;
+			size_t bits = hclen * 3;
+			for (auto &s : seq)
+				bits += codeLenBits[s.symbol] + (s.symbol == 16 ? 2 : s.symbol == 17 ? 3 : s.symbol == 18 ? 7 : 0);
+
+			if (bits < bestBits) {
+				bestBits = bits;
+				bestItems = seq;
+				memcpy(bestCodeLenBits, codeLenBits, sizeof(codeLenBits));
+			}
+		}
+
+		size_t hclen {Deflate::CodeLenCodes};
+		while (hclen > 4 && bestCodeLenBits[Deflate::codeLenOrder[hclen - 1]] == 0)
+			hclen--;
+
+		out.put(static_cast<uint32_t>(hlit - 257), 5);
+		out.put(static_cast<uint32_t>(hdist - 1), 5);
+		out.put(static_cast<uint32_t>(hclen - 4), 4);
+		for (size_t i = 0; i < hclen; i++)
+			out.put(bestCodeLenBits[Deflate::codeLenOrder[i]], 3);
+
+		uint16_t codeLenCodes[Deflate::CodeLenCodes] {};
+		canonicalCodes(bestCodeLenBits, Deflate::CodeLenCodes, codeLenCodes);
+		for (auto &s : bestItems) {
+			out.put(codeLenCodes[s.symbol], bestCodeLenBits[s.symbol]);
+			if (s.symbol == 16)
+				out.put(s.extra, 2);
+			else if (s.symbol == 17)
+				out.put(s.extra, 3);
+			else if (s.symbol == 18)
+				out.put(s.extra, 7);
+		}
+	}
+
+	uint16_t litLenCodes[Deflate::LitLenCodes + 2] {};
+	uint16_t distCodes[Deflate::DistCodes + 2] {};
+	canonicalCodes(litLenBits, fixed ? 288 : Deflate::LitLenCodes, litLenCodes);
+	canonicalCodes(distBits, fixed ? 32 : Deflate::DistCodes, distCodes);
+
+	for (auto &item : items) {
+		if (item.dist) {
+			auto ls = Deflate::lengthSymbol(item.value);
+			out.put(litLenCodes[257 + ls], litLenBits[257 + ls]);
+			out.put(item.value - Deflate::lengthBase[ls], Deflate::lengthExtra[ls]);
+			auto ds = Deflate::distSymbol(item.dist);
+			out.put(distCodes[ds], distBits[ds]);
+			out.put(item.dist - Deflate::distBase[ds], Deflate::distExtra[ds]);
+		} else {
+			out.put(litLenCodes[item.value], litLenBits[item.value]);
+		}
+	}
+
+	out.put(litLenCodes[Deflate::EndOfBlock], litLenBits[Deflate::EndOfBlock]);
+}
+
+/**
+ *  Wrap a single block into a zlib stream with the maximum compression level flags
+ */
+static std::vector<uint8_t> writeZlib(const std::vector<uint8_t> &data, const std::vector<Item> &items, bool fixed) {
+	std::vector<uint8_t> out {0x78, 0xDA};
+	BitWriter bits(out);
+	writeBlock(items, fixed, bits);
+	bits.flush();
+
+	uint32_t adler = static_cast<uint32_t>(adler32(adler32(0, nullptr, 0), data.data(), static_cast<uInt>(data.size())));
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((adler >> shift) & 0xFF);
+	return out;
+}
+
+/**
+ *  Smallest zlib stream found for the data
+ *
+ *  @param data       data to compress
+ *  @param iterations cost model refinements
+ *  @param maxChain   match candidates checked per position
+ */
+static std::vector<uint8_t> compress(const std::vector<uint8_t> &data, size_t iterations, size_t maxChain) {
+	MatchTable table(data, maxChain);
+
+	CostModel model;
+	auto items = optimalParse(data, table, model);
+	auto best = writeZlib(data, items, true);
+
+	for (size_t i = 0; i < iterations; i++) {
+		auto curr = writeZlib(data, items, false);
+		if (curr.size() < best.size())
+			best = curr;
+		model = CostModel(Stats(items));
+		items = optimalParse(data, table, model);
+	}
+
+	return best;
+}
+
+/**
+ *  Inflate a whole zlib stream
+ *
+ *  @return true if the stream was complete and valid
+ */
+static bool inflateAll(const std::vector<uint8_t> &in, std::vector<uint8_t> &out) {
+	z_stream stream {};
+	if (inflateInit(&stream) != Z_OK)
+		return false;
+
+	out.clear();
+	stream.next_in = const_cast<Bytef *>(in.data());
+	stream.avail_in = static_cast<uInt>(in.size());
+
+	int status {Z_OK};
+	uint8_t chunk[16384];
+	while (status == Z_OK) {
+		stream.next_out = chunk;
+		stream.avail_out = sizeof(chunk);
+		status = inflate(&stream, Z_NO_FLUSH);
+		out.insert(out.end(), chunk, chunk + (sizeof(chunk) - stream.avail_out));
+		if (status == Z_BUF_ERROR && stream.avail_in == 0)
+			break;
+	}
+
+	inflateEnd(&stream);
+	return status == Z_STREAM_END && stream.avail_in == 0;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+	auto file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	data.clear();
+	uint8_t chunk[16384];
+	size_t num;
+	while ((num = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + num);
+
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+static bool writeFile(const char *path, const std::vector<uint8_t> &data) {
+	auto tmp = std::string(path) + ".tmp";
+	auto file = fopen(tmp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	ok = fclose(file) == 0 && ok;
+	if (ok)
+		ok = rename(tmp.c_str(), path) == 0;
+	if (!ok)
+		remove(tmp.c_str());
+	return ok;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-n] [-i iterations] [-c chain] file.zlib...\n", name);
+	fprintf(stderr, "  -n  only report the savings, do not rewrite the files\n");
+	fprintf(stderr, "  -i  cost model refinements (default 15)\n");
+	fprintf(stderr, "  -c  match candidates checked per position (default 8192)\n");
+}
+
+int main(int argc, char *argv[]) {
+	bool dryRun {false};
+	size_t iterations {15};
+	size_t maxChain {8192};
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++) {
+		if (!strcmp(argv[arg], "-n")) {
+			dryRun = true;
+		} else if (!strcmp(argv[arg], "-i") && arg + 1 < argc) {
+			iterations = strtoul(argv[++arg], nullptr, 0);
+		} else if (!strcmp(argv[arg], "-c") && arg + 1 < argc) {
+			maxChain = strtoul(argv[++arg], nullptr, 0);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (arg == argc || iterations == 0 || maxChain == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	size_t totalOld {0}, totalNew {0};
+	int failures {0};
+
+	for (; arg < argc; arg++) {
+		const char *path = argv[arg];
+		std::vector<uint8_t> packed, data;
+		if (!readFile(path, packed) || !inflateAll(packed, data)) {
+			fprintf(stderr, "%s: not a valid zlib stream\n", path);
+			failures++;
+			continue;
+		}
+
+		auto optimized = compress(data, iterations, maxChain);
+
+		// Only zlib decides whether the stream is acceptable
+		std::vector<uint8_t> check;
+		if (!inflateAll(optimized, check) || check != data) {
+			fprintf(stderr, "%s: recompressed stream failed verification\n", path);
+			failures++;
+			continue;
+		}
+
+		size_t result = std::min(optimized.size(), packed.size());
+		totalOld += packed.size();
+		totalNew += result;
+		printf("%-48s %7zu -> %7zu %6.2f%%\n", path, packed.size(), result,
+			   100.0 * (static_cast<double>(packed.size()) - result) / packed.size());
+
+		if (!dryRun && optimized.size() < packed.size() && !writeFile(path, optimized)) {
+			fprintf(stderr, "%s: failed to write\n", path);
+			failures++;
+		}
+	}
+
+	if (totalOld > 0)
+		printf("%-48s %7zu -> %7zu %6.2f%%\n", "total", totalOld, totalNew,
+			   100.0 * (static_cast<double>(totalOld) - totalNew) / totalOld);
+
+	return failures ? 1 : 0;
+}